@@ -122,6 +122,9 @@ typedef int64 off64_t;
 #define	UNIX_CONTROL	"/tmp/lmbench.ctl"
 #define	UNIX_DATA	"/tmp/lmbench.data"
 #define	UNIX_LAT	"/tmp/lmbench.lat"
+#define	UNIX_RPC	"/tmp/lmbench.rpc"
+#define	TCP_RPC		-31240		/* no portmapper */
+#define	CALIBRATION	"/tmp/lmbench.calibration"	/* .<uid> */
 
 /*
  * socket send/recv buffer optimizations
@@ -131,6 +134,7 @@ typedef int64 off64_t;
 #define	SOCKOPT_RDWR	0x0003
 #define	SOCKOPT_PID	0x0004
 #define	SOCKOPT_REUSE	0x0008
+#define	SOCKOPT_REUSEPORT 0x0010
 #define	SOCKOPT_NONE	0
 
 #ifndef SOCKBUF
@@ -324,6 +328,7 @@ extern void sigchld_wait_handler(int signo);
  */
 extern int handle_scheduler(int childno, int benchproc, int nbenchprocs);
 extern int sched_pin(int cpu);
+extern int sched_ncpus();
 
 #include	"lib_mem.h"
 
@@ -1,9 +1,10 @@
 /*
  * bw_file_rd.c - time reading & summing of a file
  *
- * Usage: bw_file_rd [-C] [-P <parallelism] [-W <warmup>] [-N <repetitions>] size file
+ * Usage: bw_file_rd [-C] [-c cold|warm] [-P <parallelism] [-W <warmup>] [-N <repetitions>] size file
  *
- * The intent is that the file is in memory.
+ * The intent is that the file is in memory, unless -c cold is given, in
+ * which case the file is evicted from the buffer cache before each read.
  * Disk benchmarking is done with lmdd.
  *
  * Copyright (c) 1994 Larry McVoy.  Distributed under the FSF GPL with
@@ -32,6 +33,7 @@ typedef struct _state {
 	char filename[256];
 	int fd;
 	int clone;
+	int cold;
 } state_t;
 
 void doit(int fd)
@@ -50,6 +52,23 @@ void doit(int fd)
 	}
 }
 
+/*
+ * Evict the file from the buffer cache without charging the time
+ * to the benchmark
+ */
+void
+evict(state_t* state, int fd)
+{
+	static int warned = 0;
+	uint64	t = now();
+
+	if (evict_file(fd) != 0 && !warned) {
+		fprintf(stderr, "bw_file_rd: could not evict %s from the buffer cache\n", state->filename);
+		warned = 1;
+	}
+	adjust((int)(now() - t));
+}
+
 void
 initialize(iter_t iterations, void* cookie)
 {
@@ -97,6 +116,7 @@ time_with_open(iter_t iterations, void * cookie)
 
 	while (iterations-- > 0) {
 		fd = open(filename, O_RDONLY);
+		if (state->cold) evict(state, fd);
 		doit(fd);
 		close(fd);
 	}
@@ -110,6 +130,7 @@ time_io_only(iter_t iterations,void * cookie)
 
 	while (iterations-- > 0) {
 		lseek(fd, 0, SEEK_SET);
+		if (state->cold) evict(state, fd);
 		doit(fd);
 	}
 }
@@ -136,12 +157,13 @@ main(int ac, char **av)
 	int	c;
 	char	usage[1024];
 	
-	sprintf(usage,"[-C] [-P <parallelism>] [-W <warmup>] [-N <repetitions>] <size> open2close|io_only <filename>"
+	sprintf(usage,"[-C] [-c cold|warm] [-P <parallelism>] [-W <warmup>] [-N <repetitions>] <size> open2close|io_only <filename>"
 		"\nmin size=%d\n",(int) (XFERSIZE>>10)) ;
 
 	state.clone = 0;
+	state.cold = 0;
 
-	while (( c = getopt(ac, av, "P:W:N:C")) != EOF) {
+	while (( c = getopt(ac, av, "P:W:N:Cc:")) != EOF) {
 		switch(c) {
 		case 'P':
 			parallel = atoi(optarg);
@@ -156,6 +178,11 @@ main(int ac, char **av)
 		case 'C':
 			state.clone = 1;
 			break;
+		case 'c':
+			if (!strcmp(optarg, "cold")) state.cold = 1;
+			else if (!strcmp(optarg, "warm")) state.cold = 0;
+			else lmbench_usage(ac, av, usage);
+			break;
 		default:
 			lmbench_usage(ac, av, usage);
 			break;
@@ -1,8 +1,9 @@
 /*
  * bw_mem.c - simple memory write bandwidth benchmark
  *
- * Usage: bw_mem [-P <parallelism>] [-W <warmup>] [-N <repetitions>] size what
+ * Usage: bw_mem [-P <parallelism>] [-W <warmup>] [-N <repetitions>] [-t type] size what
  *        what: rd wr rdwr cp fwr frd fcp bzero bcopy
+ *        type: int int64 float double ldouble int128
  *
  * Copyright (c) 1994-1996 Larry McVoy.  Distributed under the FSF GPL with
  * additional restriction that results may published only if
@@ -14,62 +15,200 @@ char	*id = "$Id$";
 
 #include "bench.h"
 
-#define TYPE    int
-
 /*
- * rd - 4 byte read, 32 byte stride
- * wr - 4 byte write, 32 byte stride
- * rdwr - 4 byte read followed by 4 byte write to same place, 32 byte stride
- * cp - 4 byte read then 4 byte write to different place, 32 byte stride
- * fwr - write every 4 byte word
- * frd - read every 4 byte word
- * fcp - copy every 4 byte word
- *
- * All tests do 512 byte chunks in a loop.
+ * rd - read one element in four, 16 bytes apart for int
+ * wr - write one element in four
+ * rdwr - read followed by write to the same place, one element in four
+ * cp - read then write to a different place, one element in four
+ * fwr - write every element
+ * frd - read every element
+ * fcp - copy every element
  *
- * XXX - do a 64bit version of this.
+ * Each kernel is generated for each type by BW_KERNELS, and does
+ * 128 elements (512 bytes of int) per pass of its loop, so that the
+ * unrolling is the same for every type and only the width of the
+ * loads and stores changes.  Reads are summed into four accumulators
+ * so that floating point add latency does not limit them, except for
+ * int, whose rd, rdwr and frd keep the single sum they have always
+ * had so that the default results stay comparable with old ones.
  */
-void	rd(iter_t iterations, void *cookie);
-void	wr(iter_t iterations, void *cookie);
-void	rdwr(iter_t iterations, void *cookie);
-void	mcp(iter_t iterations, void *cookie);
-void	fwr(iter_t iterations, void *cookie);
-void	frd(iter_t iterations, void *cookie);
-void	fcp(iter_t iterations, void *cookie);
-void	loop_bzero(iter_t iterations, void *cookie);
-void	loop_bcopy(iter_t iterations, void *cookie);
-void	init_overhead(iter_t iterations, void *cookie);
-void	init_loop(iter_t iterations, void *cookie);
-void	cleanup(iter_t iterations, void *cookie);
-
 typedef struct _state {
 	double	overhead;
 	size_t	nbytes;
 	int	need_buf2;
 	int	aligned;
-	TYPE	*buf;
-	TYPE	*buf2;
-	TYPE	*buf2_orig;
-	TYPE	*lastone;
+	void	*buf;
+	void	*buf2;
+	void	*buf2_orig;
+	char	*lastone;
+	size_t	chunk;	/* bytes per pass of the kernel loop */
 	size_t	N;
 } state_t;
 
+#define	S16(m, i)	m(i) m(i+4) m(i+8) m(i+12)
+#define	S128(m)		S16(m, 0) S16(m, 16) S16(m, 32) S16(m, 48)	\
+			S16(m, 64) S16(m, 80) S16(m, 96) S16(m, 112)
+#define	E4(m, i)	m(i) m(i+1) m(i+2) m(i+3)
+#define	E16(m, i)	E4(m, i) E4(m, i+4) E4(m, i+8) E4(m, i+12)
+#define	E128(m)		E16(m, 0) E16(m, 16) E16(m, 32) E16(m, 48)	\
+			E16(m, 64) E16(m, 80) E16(m, 96) E16(m, 112)
+
+#define	RD(i)		sum[((i)>>2)&3] += p[i];
+#define	FRD(i)		sum[(i)&3] += p[i];
+#define	WR(i)		p[i] = 1;
+#define	RDWR(i)		sum[((i)>>2)&3] += p[i]; p[i] = 1;
+#define	CP(i)		dst[i] = p[i];
+#define	RD1(i)		p[i] +
+#define	RDWR1(i)	sum += p[i]; p[i] = 1;
+
+#define	BW_READ(name, T, type, unroll, op)				\
+void									\
+name##_##T(iter_t iterations, void *cookie)				\
+{									\
+	state_t *state = (state_t *) cookie;				\
+	register type *lastone = (type*)state->lastone;			\
+	type sum[4];							\
+									\
+	sum[0] = sum[1] = sum[2] = sum[3] = 0;				\
+	while (iterations-- > 0) {					\
+	    register type *p = (type*)state->buf;			\
+	    while (p <= lastone) {					\
+		unroll(op)						\
+		p += 128;						\
+	    }								\
+	}								\
+	use_int((int)(sum[0] + sum[1] + sum[2] + sum[3]));		\
+}
+
+/* one sum, with the whole pass in body */
+#define	BW_SUM(name, T, type, body)					\
+void									\
+name##_##T(iter_t iterations, void *cookie)				\
+{									\
+	state_t *state = (state_t *) cookie;				\
+	register type *lastone = (type*)state->lastone;			\
+	register int sum = 0;						\
+									\
+	while (iterations-- > 0) {					\
+	    register type *p = (type*)state->buf;			\
+	    while (p <= lastone) {					\
+		body							\
+		p += 128;						\
+	    }								\
+	}								\
+	use_int(sum);							\
+}
+
+#define	BW_WRITE(name, T, type, unroll, op)				\
+void									\
+name##_##T(iter_t iterations, void *cookie)				\
+{									\
+	state_t *state = (state_t *) cookie;				\
+	register type *lastone = (type*)state->lastone;			\
+	type* p_save = NULL;						\
+									\
+	while (iterations-- > 0) {					\
+	    register type *p = (type*)state->buf;			\
+	    while (p <= lastone) {					\
+		unroll(op)						\
+		p += 128;						\
+	    }								\
+	    p_save = p;							\
+	}								\
+	use_pointer(p_save);						\
+}
+
+#define	BW_COPY(name, T, type, unroll, op)				\
+void									\
+name##_##T(iter_t iterations, void *cookie)				\
+{									\
+	state_t *state = (state_t *) cookie;				\
+	register type *lastone = (type*)state->lastone;			\
+	type* p_save = NULL;						\
+									\
+	while (iterations-- > 0) {					\
+	    register type *p = (type*)state->buf;			\
+	    register type *dst = (type*)state->buf2;			\
+	    while (p <= lastone) {					\
+		unroll(op)						\
+		p += 128;						\
+		dst += 128;						\
+	    }								\
+	    p_save = p;							\
+	}								\
+	use_pointer(p_save);						\
+}
+
+#define	BW_STORES(T, type)						\
+	BW_WRITE(wr, T, type, S128, WR)					\
+	BW_COPY(cp, T, type, S128, CP)					\
+	BW_WRITE(fwr, T, type, E128, WR)				\
+	BW_COPY(fcp, T, type, E128, CP)
+
+#define	BW_KERNELS(T, type)						\
+	BW_READ(rd, T, type, S128, RD)					\
+	BW_READ(rdwr, T, type, S128, RDWR)				\
+	BW_READ(frd, T, type, E128, FRD)				\
+	BW_STORES(T, type)
+
+#define	BW_TYPE(T, type)						\
+	{ #T, sizeof(type),						\
+	  { rd_##T, wr_##T, rdwr_##T, cp_##T, fwr_##T, frd_##T, fcp_##T } },
+
+BW_SUM(rd, int, int, sum += S128(RD1) 0;)
+BW_SUM(rdwr, int, int, S128(RDWR1))
+BW_SUM(frd, int, int, sum += E128(RD1) 0;)
+BW_STORES(int, int)
+BW_KERNELS(int64, int64)
+BW_KERNELS(float, float)
+BW_KERNELS(double, double)
+BW_KERNELS(ldouble, long double)
+#ifdef __SIZEOF_INT128__
+BW_KERNELS(int128, __int128)
+#endif
+
+char	*ops[] = { "rd", "wr", "rdwr", "cp", "fwr", "frd", "fcp", NULL };
+
+struct bw_type {
+	char	*name;
+	size_t	size;
+	benchmp_f kernels[7];	/* in the order of ops[] */
+} types[] = {
+	BW_TYPE(int, int)
+	BW_TYPE(int64, int64)
+	BW_TYPE(float, float)
+	BW_TYPE(double, double)
+	BW_TYPE(ldouble, long double)
+#ifdef __SIZEOF_INT128__
+	BW_TYPE(int128, __int128)
+#endif
+	{ NULL, 0 }
+};
+
+void	loop_bzero(iter_t iterations, void *cookie);
+void	loop_bcopy(iter_t iterations, void *cookie);
+void	init_overhead(iter_t iterations, void *cookie);
+void	init_loop(iter_t iterations, void *cookie);
+void	cleanup(iter_t iterations, void *cookie);
+
 void	adjusted_bandwidth(uint64 t, uint64 b, uint64 iter, double ovrhd);
 
 int
 main(int ac, char **av)
 {
+	int	i;
 	int	parallel = 1;
 	int	warmup = 0;
 	int	repetitions = -1;
 	size_t	nbytes;
 	state_t	state;
 	int	c;
-	char	*usage = "[-P <parallelism>] [-W <warmup>] [-N <repetitions>] <size> what [conflict]\nwhat: rd wr rdwr cp fwr frd fcp bzero bcopy\n<size> must be larger than 512";
+	struct bw_type *type = &types[0];
+	char	*usage = "[-P <parallelism>] [-W <warmup>] [-N <repetitions>] [-t int|int64|float|double|ldouble|int128] <size> what [conflict]\nwhat: rd wr rdwr cp fwr frd fcp bzero bcopy\n<size> must be larger than 128 elements";
 
 	state.overhead = 0;
 
-	while (( c = getopt(ac, av, "P:W:N:")) != EOF) {
+	while (( c = getopt(ac, av, "P:W:N:t:")) != EOF) {
 		switch(c) {
 		case 'P':
 			parallel = atoi(optarg);
@@ -81,6 +220,12 @@ main(int ac, char **av)
 		case 'N':
 			repetitions = atoi(optarg);
 			break;
+		case 't':
+			for (type = types; type->name; ++type) {
+				if (streq(optarg, type->name)) break;
+			}
+			if (!type->name) lmbench_usage(ac, av, usage);
+			break;
 		default:
 			lmbench_usage(ac, av, usage);
 			break;
@@ -96,7 +241,8 @@ main(int ac, char **av)
 	}
 
 	nbytes = state.nbytes = bytes(av[optind]);
-	if (state.nbytes < 512) { /* this is the number of bytes in the loop */
+	state.chunk = 128 * type->size;
+	if (state.nbytes < state.chunk) { /* the bytes in the loop */
 		lmbench_usage(ac, av, usage);
 	}
 
@@ -104,27 +250,11 @@ main(int ac, char **av)
 	    streq(av[optind+1], "fcp") || streq(av[optind+1], "bcopy")) {
 		state.need_buf2 = 1;
 	}
-		
-	if (streq(av[optind+1], "rd")) {
-		benchmp(init_loop, rd, cleanup, 0, parallel, 
-			warmup, repetitions, &state);
-	} else if (streq(av[optind+1], "wr")) {
-		benchmp(init_loop, wr, cleanup, 0, parallel, 
-			warmup, repetitions, &state);
-	} else if (streq(av[optind+1], "rdwr")) {
-		benchmp(init_loop, rdwr, cleanup, 0, parallel, 
-			warmup, repetitions, &state);
-	} else if (streq(av[optind+1], "cp")) {
-		benchmp(init_loop, mcp, cleanup, 0, parallel, 
-			warmup, repetitions, &state);
-	} else if (streq(av[optind+1], "frd")) {
-		benchmp(init_loop, frd, cleanup, 0, parallel, 
-			warmup, repetitions, &state);
-	} else if (streq(av[optind+1], "fwr")) {
-		benchmp(init_loop, fwr, cleanup, 0, parallel, 
-			warmup, repetitions, &state);
-	} else if (streq(av[optind+1], "fcp")) {
-		benchmp(init_loop, fcp, cleanup, 0, parallel, 
+
+	for (i = 0; ops[i] && !streq(av[optind+1], ops[i]); ++i)
+		;
+	if (ops[i]) {
+		benchmp(init_loop, type->kernels[i], cleanup, 0, parallel, 
 			warmup, repetitions, &state);
 	} else if (streq(av[optind+1], "bzero")) {
 		benchmp(init_loop, loop_bzero, cleanup, 0, parallel, 
@@ -152,10 +282,9 @@ init_loop(iter_t iterations, void *cookie)
 
 	if (iterations) return;
 
-        state->buf = (TYPE *)valloc(state->nbytes);
+        state->buf = valloc(state->nbytes);
 	state->buf2_orig = NULL;
-	state->lastone = (TYPE*)state->buf - 1;
-	state->lastone = (TYPE*)((char *)state->buf + state->nbytes - 512);
+	state->lastone = (char *)state->buf + state->nbytes - state->chunk;
 	state->N = state->nbytes;
 
 	if (!state->buf) {
@@ -165,7 +294,7 @@ init_loop(iter_t iterations, void *cookie)
 	bzero((void*)state->buf, state->nbytes);
 
 	if (state->need_buf2 == 1) {
-		state->buf2_orig = state->buf2 = (TYPE *)valloc(state->nbytes + 2048);
+		state->buf2_orig = state->buf2 = valloc(state->nbytes + 2048);
 		if (!state->buf2) {
 			perror("malloc");
 			exit(1);
@@ -177,7 +306,7 @@ init_loop(iter_t iterations, void *cookie)
 			char	*tmp = (char *)state->buf2;
 
 			tmp += 2048 - 128;
-			state->buf2 = (TYPE *)tmp;
+			state->buf2 = (void *)tmp;
 		}
 	}
 }
@@ -193,227 +322,11 @@ cleanup(iter_t iterations, void *cookie)
 	if (state->buf2_orig) free(state->buf2_orig);
 }
 
-void
-rd(iter_t iterations, void *cookie)
-{	
-	state_t *state = (state_t *) cookie;
-	register TYPE *lastone = state->lastone;
-	register int sum = 0;
-
-	while (iterations-- > 0) {
-	    register TYPE *p = state->buf;
-	    while (p <= lastone) {
-		sum += 
-#define	DOIT(i)	p[i]+
-		DOIT(0) DOIT(4) DOIT(8) DOIT(12) DOIT(16) DOIT(20) DOIT(24)
-		DOIT(28) DOIT(32) DOIT(36) DOIT(40) DOIT(44) DOIT(48) DOIT(52)
-		DOIT(56) DOIT(60) DOIT(64) DOIT(68) DOIT(72) DOIT(76)
-		DOIT(80) DOIT(84) DOIT(88) DOIT(92) DOIT(96) DOIT(100)
-		DOIT(104) DOIT(108) DOIT(112) DOIT(116) DOIT(120) 
-		p[124];
-		p +=  128;
-	    }
-	}
-	use_int(sum);
-}
-#undef	DOIT
-
-void
-wr(iter_t iterations, void *cookie)
-{	
-	state_t *state = (state_t *) cookie;
-	register TYPE *lastone = state->lastone;
-
-	while (iterations-- > 0) {
-	    register TYPE *p = state->buf;
-	    while (p <= lastone) {
-#define	DOIT(i)	p[i] = 1;
-		DOIT(0) DOIT(4) DOIT(8) DOIT(12) DOIT(16) DOIT(20) DOIT(24)
-		DOIT(28) DOIT(32) DOIT(36) DOIT(40) DOIT(44) DOIT(48) DOIT(52)
-		DOIT(56) DOIT(60) DOIT(64) DOIT(68) DOIT(72) DOIT(76)
-		DOIT(80) DOIT(84) DOIT(88) DOIT(92) DOIT(96) DOIT(100)
-		DOIT(104) DOIT(108) DOIT(112) DOIT(116) DOIT(120) DOIT(124);
-		p +=  128;
-	    }
-	}
-}
-#undef	DOIT
-
-void
-rdwr(iter_t iterations, void *cookie)
-{	
-	state_t *state = (state_t *) cookie;
-	register TYPE *lastone = state->lastone;
-	register int sum = 0;
-
-	while (iterations-- > 0) {
-	    register TYPE *p = state->buf;
-	    while (p <= lastone) {
-#define	DOIT(i)	sum += p[i]; p[i] = 1;
-		DOIT(0) DOIT(4) DOIT(8) DOIT(12) DOIT(16) DOIT(20) DOIT(24)
-		DOIT(28) DOIT(32) DOIT(36) DOIT(40) DOIT(44) DOIT(48) DOIT(52)
-		DOIT(56) DOIT(60) DOIT(64) DOIT(68) DOIT(72) DOIT(76)
-		DOIT(80) DOIT(84) DOIT(88) DOIT(92) DOIT(96) DOIT(100)
-		DOIT(104) DOIT(108) DOIT(112) DOIT(116) DOIT(120) DOIT(124);
-		p +=  128;
-	    }
-	}
-	use_int(sum);
-}
-#undef	DOIT
-
-void
-mcp(iter_t iterations, void *cookie)
-{	
-	state_t *state = (state_t *) cookie;
-	register TYPE *lastone = state->lastone;
-	TYPE* p_save = NULL;
-
-	while (iterations-- > 0) {
-	    register TYPE *p = state->buf;
-	    register TYPE *dst = state->buf2;
-	    while (p <= lastone) {
-#define	DOIT(i)	dst[i] = p[i];
-		DOIT(0) DOIT(4) DOIT(8) DOIT(12) DOIT(16) DOIT(20) DOIT(24)
-		DOIT(28) DOIT(32) DOIT(36) DOIT(40) DOIT(44) DOIT(48) DOIT(52)
-		DOIT(56) DOIT(60) DOIT(64) DOIT(68) DOIT(72) DOIT(76)
-		DOIT(80) DOIT(84) DOIT(88) DOIT(92) DOIT(96) DOIT(100)
-		DOIT(104) DOIT(108) DOIT(112) DOIT(116) DOIT(120) DOIT(124);
-		p += 128;
-		dst += 128;
-	    }
-	    p_save = p;
-	}
-	use_pointer(p_save);
-}
-#undef	DOIT
-
-void
-fwr(iter_t iterations, void *cookie)
-{	
-	state_t *state = (state_t *) cookie;
-	register TYPE *lastone = state->lastone;
-	TYPE* p_save = NULL;
-
-	while (iterations-- > 0) {
-	    register TYPE *p = state->buf;
-	    while (p <= lastone) {
-#define	DOIT(i)	p[i]=
-		DOIT(0) DOIT(1) DOIT(2) DOIT(3) DOIT(4) DOIT(5) DOIT(6)
-		DOIT(7) DOIT(8) DOIT(9) DOIT(10) DOIT(11) DOIT(12)
-		DOIT(13) DOIT(14) DOIT(15) DOIT(16) DOIT(17) DOIT(18)
-		DOIT(19) DOIT(20) DOIT(21) DOIT(22) DOIT(23) DOIT(24)
-		DOIT(25) DOIT(26) DOIT(27) DOIT(28) DOIT(29) DOIT(30)
-		DOIT(31) DOIT(32) DOIT(33) DOIT(34) DOIT(35) DOIT(36)
-		DOIT(37) DOIT(38) DOIT(39) DOIT(40) DOIT(41) DOIT(42)
-		DOIT(43) DOIT(44) DOIT(45) DOIT(46) DOIT(47) DOIT(48)
-		DOIT(49) DOIT(50) DOIT(51) DOIT(52) DOIT(53) DOIT(54)
-		DOIT(55) DOIT(56) DOIT(57) DOIT(58) DOIT(59) DOIT(60)
-		DOIT(61) DOIT(62) DOIT(63) DOIT(64) DOIT(65) DOIT(66)
-		DOIT(67) DOIT(68) DOIT(69) DOIT(70) DOIT(71) DOIT(72)
-		DOIT(73) DOIT(74) DOIT(75) DOIT(76) DOIT(77) DOIT(78)
-		DOIT(79) DOIT(80) DOIT(81) DOIT(82) DOIT(83) DOIT(84)
-		DOIT(85) DOIT(86) DOIT(87) DOIT(88) DOIT(89) DOIT(90)
-		DOIT(91) DOIT(92) DOIT(93) DOIT(94) DOIT(95) DOIT(96)
-		DOIT(97) DOIT(98) DOIT(99) DOIT(100) DOIT(101) DOIT(102)
-		DOIT(103) DOIT(104) DOIT(105) DOIT(106) DOIT(107)
-		DOIT(108) DOIT(109) DOIT(110) DOIT(111) DOIT(112)
-		DOIT(113) DOIT(114) DOIT(115) DOIT(116) DOIT(117)
-		DOIT(118) DOIT(119) DOIT(120) DOIT(121) DOIT(122)
-		DOIT(123) DOIT(124) DOIT(125) DOIT(126) DOIT(127) 1;
-		p += 128;
-	    }
-	    p_save = p;
-	}
-	use_pointer(p_save);
-}
-#undef	DOIT
-
-void
-frd(iter_t iterations, void *cookie)
-{	
-	state_t *state = (state_t *) cookie;
-	register int sum = 0;
-	register TYPE *lastone = state->lastone;
-
-	while (iterations-- > 0) {
-	    register TYPE *p = state->buf;
-	    while (p <= lastone) {
-		sum +=
-#define	DOIT(i)	p[i]+
-		DOIT(0) DOIT(1) DOIT(2) DOIT(3) DOIT(4) DOIT(5) DOIT(6)
-		DOIT(7) DOIT(8) DOIT(9) DOIT(10) DOIT(11) DOIT(12)
-		DOIT(13) DOIT(14) DOIT(15) DOIT(16) DOIT(17) DOIT(18)
-		DOIT(19) DOIT(20) DOIT(21) DOIT(22) DOIT(23) DOIT(24)
-		DOIT(25) DOIT(26) DOIT(27) DOIT(28) DOIT(29) DOIT(30)
-		DOIT(31) DOIT(32) DOIT(33) DOIT(34) DOIT(35) DOIT(36)
-		DOIT(37) DOIT(38) DOIT(39) DOIT(40) DOIT(41) DOIT(42)
-		DOIT(43) DOIT(44) DOIT(45) DOIT(46) DOIT(47) DOIT(48)
-		DOIT(49) DOIT(50) DOIT(51) DOIT(52) DOIT(53) DOIT(54)
-		DOIT(55) DOIT(56) DOIT(57) DOIT(58) DOIT(59) DOIT(60)
-		DOIT(61) DOIT(62) DOIT(63) DOIT(64) DOIT(65) DOIT(66)
-		DOIT(67) DOIT(68) DOIT(69) DOIT(70) DOIT(71) DOIT(72)
-		DOIT(73) DOIT(74) DOIT(75) DOIT(76) DOIT(77) DOIT(78)
-		DOIT(79) DOIT(80) DOIT(81) DOIT(82) DOIT(83) DOIT(84)
-		DOIT(85) DOIT(86) DOIT(87) DOIT(88) DOIT(89) DOIT(90)
-		DOIT(91) DOIT(92) DOIT(93) DOIT(94) DOIT(95) DOIT(96)
-		DOIT(97) DOIT(98) DOIT(99) DOIT(100) DOIT(101) DOIT(102)
-		DOIT(103) DOIT(104) DOIT(105) DOIT(106) DOIT(107)
-		DOIT(108) DOIT(109) DOIT(110) DOIT(111) DOIT(112)
-		DOIT(113) DOIT(114) DOIT(115) DOIT(116) DOIT(117)
-		DOIT(118) DOIT(119) DOIT(120) DOIT(121) DOIT(122)
-		DOIT(123) DOIT(124) DOIT(125) DOIT(126) p[127];
-		p += 128;
-	    }
-	}
-	use_int(sum);
-}
-#undef	DOIT
-
-void
-fcp(iter_t iterations, void *cookie)
-{	
-	state_t *state = (state_t *) cookie;
-	register TYPE *lastone = state->lastone;
-
-	while (iterations-- > 0) {
-	    register TYPE *p = state->buf;
-	    register TYPE *dst = state->buf2;
-	    while (p <= lastone) {
-#define	DOIT(i)	dst[i]=p[i];
-		DOIT(0) DOIT(1) DOIT(2) DOIT(3) DOIT(4) DOIT(5) DOIT(6)
-		DOIT(7) DOIT(8) DOIT(9) DOIT(10) DOIT(11) DOIT(12)
-		DOIT(13) DOIT(14) DOIT(15) DOIT(16) DOIT(17) DOIT(18)
-		DOIT(19) DOIT(20) DOIT(21) DOIT(22) DOIT(23) DOIT(24)
-		DOIT(25) DOIT(26) DOIT(27) DOIT(28) DOIT(29) DOIT(30)
-		DOIT(31) DOIT(32) DOIT(33) DOIT(34) DOIT(35) DOIT(36)
-		DOIT(37) DOIT(38) DOIT(39) DOIT(40) DOIT(41) DOIT(42)
-		DOIT(43) DOIT(44) DOIT(45) DOIT(46) DOIT(47) DOIT(48)
-		DOIT(49) DOIT(50) DOIT(51) DOIT(52) DOIT(53) DOIT(54)
-		DOIT(55) DOIT(56) DOIT(57) DOIT(58) DOIT(59) DOIT(60)
-		DOIT(61) DOIT(62) DOIT(63) DOIT(64) DOIT(65) DOIT(66)
-		DOIT(67) DOIT(68) DOIT(69) DOIT(70) DOIT(71) DOIT(72)
-		DOIT(73) DOIT(74) DOIT(75) DOIT(76) DOIT(77) DOIT(78)
-		DOIT(79) DOIT(80) DOIT(81) DOIT(82) DOIT(83) DOIT(84)
-		DOIT(85) DOIT(86) DOIT(87) DOIT(88) DOIT(89) DOIT(90)
-		DOIT(91) DOIT(92) DOIT(93) DOIT(94) DOIT(95) DOIT(96)
-		DOIT(97) DOIT(98) DOIT(99) DOIT(100) DOIT(101) DOIT(102)
-		DOIT(103) DOIT(104) DOIT(105) DOIT(106) DOIT(107)
-		DOIT(108) DOIT(109) DOIT(110) DOIT(111) DOIT(112)
-		DOIT(113) DOIT(114) DOIT(115) DOIT(116) DOIT(117)
-		DOIT(118) DOIT(119) DOIT(120) DOIT(121) DOIT(122)
-		DOIT(123) DOIT(124) DOIT(125) DOIT(126) DOIT(127)
-		p += 128;
-		dst += 128;
-	    }
-	}
-}
-
 void
 loop_bzero(iter_t iterations, void *cookie)
 {	
 	state_t *state = (state_t *) cookie;
-	register TYPE *p = state->buf;
+	register void *p = state->buf;
 	register size_t  N = state->N;
 
 	while (iterations-- > 0) {
@@ -425,8 +338,8 @@ void
 loop_bcopy(iter_t iterations, void *cookie)
 {	
 	state_t *state = (state_t *) cookie;
-	register TYPE *p = state->buf;
-	register TYPE *dst = state->buf2;
+	register void *p = state->buf;
+	register void *dst = state->buf2;
 	register size_t  N = state->N;
 
 	while (iterations-- > 0) {
@@ -32,6 +32,7 @@ typedef struct _state {
 	char	filename[256];
 	int	fd;
 	int	clone;
+	int	cold;
 	void	*buf;
 } state_t;
 
@@ -40,6 +41,7 @@ void time_with_open(iter_t iterations, void * cookie);
 void initialize(iter_t iterations, void *cookie);
 void init_open(iter_t iterations, void *cookie);
 void cleanup(iter_t iterations, void *cookie);
+void evict(state_t *state, int fd);
 
 int
 main(int ac, char **av)
@@ -51,11 +53,12 @@ main(int ac, char **av)
 	size_t	nbytes;
 	state_t	state;
 	int	c;
-	char	*usage = "[-C] [-P <parallelism>] [-W <warmup>] [-N <repetitions>] <size> open2close|mmap_only <filename>";
+	char	*usage = "[-C] [-c cold|warm] [-P <parallelism>] [-W <warmup>] [-N <repetitions>] <size> open2close|mmap_only <filename>";
 
 	state.clone = 0;
+	state.cold = 0;
 
-	while (( c = getopt(ac, av, "P:W:N:C")) != EOF) {
+	while (( c = getopt(ac, av, "P:W:N:Cc:")) != EOF) {
 		switch(c) {
 		case 'P':
 			parallel = atoi(optarg);
@@ -70,6 +73,11 @@ main(int ac, char **av)
 		case 'C':
 			state.clone = 1;
 			break;
+		case 'c':
+			if (!strcmp(optarg, "cold")) state.cold = 1;
+			else if (!strcmp(optarg, "warm")) state.cold = 0;
+			else lmbench_usage(ac, av, usage);
+			break;
 		default:
 			lmbench_usage(ac, av, usage);
 			break;
@@ -160,6 +168,13 @@ time_no_open(iter_t iterations, void * cookie)
 	state_t *state = (state_t *) cookie;
 
 	while (iterations-- > 0) {
+	    if (state->cold) {
+		/* our own mapping would keep the pages resident */
+#ifdef MADV_DONTNEED
+		madvise(state->buf, state->nbytes, MADV_DONTNEED);
+#endif
+		evict(state, state->fd);
+	    }
 	    bread(state->buf, state->nbytes);
 	}
 }
@@ -175,9 +190,27 @@ time_with_open(iter_t iterations, void *cookie)
 
 	while (iterations-- > 0) {
 	    CHK(fd = open(filename, 0));
+	    if (state->cold) evict(state, fd);
 	    CHK(p = mmap(0, nbytes, PROT_READ, MMAP_FLAGS, fd, 0));
 	    bread(p, nbytes);
 	    close(fd);
 	    munmap(p, nbytes);
 	}
 }
+
+/*
+ * Evict the file from the buffer cache without charging the time
+ * to the benchmark
+ */
+void
+evict(state_t *state, int fd)
+{
+	static int warned = 0;
+	uint64	t = now();
+
+	if (evict_file(fd) != 0 && !warned) {
+		fprintf(stderr, "bw_mmap_rd: could not evict %s from the buffer cache\n", state->filename);
+		warned = 1;
+	}
+	adjust((int)(now() - t));
+}
@@ -1,7 +1,8 @@
 /*
  * bw_pipe.c - pipe bandwidth benchmark.
  *
- * Usage: bw_pipe [-m <message size>] [-M <total bytes>] \
+ * Usage: bw_pipe [-m <message size>] [-M <total bytes>] [-s <pipe size>] \
+ *		[-D] [-S capacity|xfer] \
  *		[-P <parallelism>] [-W <warmup>] [-N <repetitions>]
  *
  * Copyright (c) 1994 Larry McVoy.  
@@ -14,6 +15,10 @@
  */
 char	*id = "$Id$\n";
 
+#if defined(linux) || defined(__linux__)
+#define _GNU_SOURCE	/* O_DIRECT */
+#endif
+
 #include "bench.h"
 
 void	reader(iter_t iterations, void* cookie);
@@ -27,8 +32,26 @@ struct _state {
 	size_t	bytes;	/* bytes to read/write in one iteration */
 	char	*buf;	/* buffer memory space */
 	int	readfd;
+	int	size;	/* requested pipe capacity, 0 for the default */
+	int	packet;	/* O_DIRECT packet mode */
 };
 
+/*
+ * The largest capacity an unprivileged process may ask for
+ */
+int
+pipe_max_size()
+{
+	int	max = 1024 * 1024;
+	FILE*	f = fopen("/proc/sys/fs/pipe-max-size", "r");
+
+	if (f) {
+		if (fscanf(f, "%d", &max) != 1) max = 1024 * 1024;
+		fclose(f);
+	}
+	return (max);
+}
+
 void
 initialize(iter_t iterations, void *cookie)
 {
@@ -37,8 +60,8 @@ initialize(iter_t iterations, void *cookie)
 
 	if (iterations) return;
 
-	if (pipe(pipes) == -1) {
-		perror("pipe");
+	if (make_pipe(pipes, state->size, state->packet) == -1) {
+		perror("bw_pipe: pipe");
 		exit(1);
 	}
 	handle_scheduler(benchmp_childid(), 0, 1);
@@ -125,6 +148,29 @@ writer(int writefd, char* buf, size_t xfer)
 	}
 }
 
+/*
+ * Round up total byte count to a multiple of xfer
+ */
+void
+round_bytes(struct _state* state)
+{
+	if (state->bytes < state->xfer) {
+		state->bytes = state->xfer;
+	} else if (state->bytes % state->xfer) {
+		state->bytes += state->bytes - state->bytes % state->xfer;
+	}
+}
+
+/*
+ * returns the bandwidth of the last run in MB/sec
+ */
+double
+bandwidth_mb(struct _state* state, int parallel)
+{
+	if (gettime() == 0) return (0.);
+	return ((double)get_n() * parallel * state->bytes / (double)gettime());
+}
+
 int
 main(int ac, char *av[])
 {
@@ -133,12 +179,17 @@ main(int ac, char *av[])
 	int warmup = 0;
 	int repetitions = -1;
 	int c;
-	char* usage = "[-m <message size>] [-M <total bytes>] [-P <parallelism>] [-W <warmup>] [-N <repetitions>]\n";
+	int capacity;
+	int pipes[2];
+	char* sweep = NULL;
+	char* usage = "[-m <message size>] [-M <total bytes>] [-s <pipe size>] [-D] [-S capacity|xfer] [-P <parallelism>] [-W <warmup>] [-N <repetitions>]\n";
 
 	state.xfer = XFERSIZE;	/* per-packet size */
 	state.bytes = XFER;	/* total bytes per call */
+	state.size = 0;
+	state.packet = 0;
 
-	while (( c = getopt(ac, av, "m:M:P:W:N:")) != EOF) {
+	while (( c = getopt(ac, av, "m:M:s:DS:P:W:N:")) != EOF) {
 		switch(c) {
 		case 'm':
 			state.xfer = bytes(optarg);
@@ -146,6 +197,22 @@ main(int ac, char *av[])
 		case 'M':
 			state.bytes = bytes(optarg);
 			break;
+		case 's':
+			state.size = bytes(optarg);
+			if (state.size <= 0) lmbench_usage(ac, av, usage);
+			break;
+		case 'D':
+#ifndef O_DIRECT
+			fprintf(stderr, "bw_pipe: no packet mode pipes\n");
+			exit(1);
+#endif
+			state.packet = 1;
+			break;
+		case 'S':
+			sweep = optarg;
+			if (strcmp(sweep, "capacity") && strcmp(sweep, "xfer"))
+				lmbench_usage(ac, av, usage);
+			break;
 		case 'P':
 			parallel = atoi(optarg);
 			if (parallel <= 0) lmbench_usage(ac, av, usage);
@@ -164,17 +231,73 @@ main(int ac, char *av[])
 	if (optind < ac) {
 		lmbench_usage(ac, av, usage);
 	}
-	/* round up total byte count to a multiple of xfer */
-	if (state.bytes < state.xfer) {
-		state.bytes = state.xfer;
-	} else if (state.bytes % state.xfer) {
-		state.bytes += state.bytes - state.bytes % state.xfer;
+	round_bytes(&state);
+
+	/*
+	 * Sweeps print "x y" pairs for graph(1): the pipe capacity or the
+	 * message size in KB against MB/sec.
+	 */
+	if (sweep && !strcmp(sweep, "capacity")) {
+		int	max = pipe_max_size();
+
+		fprintf(stderr, "\"%s%d byte messages\n",
+			state.packet ? "packet mode, " : "", (int)state.xfer);
+		for (state.size = getpagesize(); state.size <= max;
+		     state.size *= 2) {
+			if ((capacity = make_pipe(pipes, state.size,
+						  state.packet)) == -1) {
+				perror("bw_pipe: pipe");
+				exit(1);
+			}
+			close(pipes[0]);
+			close(pipes[1]);
+			benchmp(initialize, reader, cleanup, MEDIUM, parallel,
+				warmup, repetitions, &state);
+			fprintf(stderr, "%d %.2f\n", capacity / 1024,
+				bandwidth_mb(&state, parallel));
+		}
+		return (0);
+	} else if (sweep) {
+		size_t	bytes = state.bytes;
+
+		if ((capacity = make_pipe(pipes, state.size,
+					  state.packet)) == -1) {
+			perror("bw_pipe: pipe");
+			exit(1);
+		}
+		close(pipes[0]);
+		close(pipes[1]);
+		fprintf(stderr, "\"%spipe capacity %d\n",
+			state.packet ? "packet mode, " : "", capacity);
+		for (state.xfer = 512; state.xfer <= 1024 * 1024;
+		     state.xfer *= 2) {
+			state.bytes = bytes;
+			round_bytes(&state);
+			benchmp(initialize, reader, cleanup, MEDIUM, parallel,
+				warmup, repetitions, &state);
+			fprintf(stderr, "%.1f %.2f\n", state.xfer / 1024.,
+				bandwidth_mb(&state, parallel));
+		}
+		return (0);
 	}
+
 	benchmp(initialize, reader, cleanup, MEDIUM, parallel, 
 		warmup, repetitions, &state);
 
 	if (gettime() > 0) {
-		fprintf(stderr, "Pipe bandwidth: ");
+		if (state.size || state.packet) {
+			if ((capacity = make_pipe(pipes, state.size,
+						  state.packet)) == -1) {
+				perror("bw_pipe: pipe");
+				exit(1);
+			}
+			close(pipes[0]);
+			close(pipes[1]);
+			fprintf(stderr, "Pipe bandwidth, %scapacity %d: ",
+				state.packet ? "packet mode, " : "", capacity);
+		} else {
+			fprintf(stderr, "Pipe bandwidth: ");
+		}
 		mb(get_n() * parallel * state.bytes);
 	}
 	return(0);
@@ -3,9 +3,18 @@
  *
  * Three programs in one -
  *	server usage:	bw_tcp -s
- *	client usage:	bw_tcp [-m <message size>] [-M <total bytes>] [-P <parallelism>] [-W <warmup>] [-N <repetitions>] hostname 
+ *	client usage:	bw_tcp [-m <message size>] [-M <total bytes>] [-n <streams>] [-b <sockbuf>[,<sockbuf>...]] [-T] [-P <parallelism>] [-W <warmup>] [-N <repetitions>] hostname
  *	shutdown:	bw_tcp -hostname
  *
+ * With -n, each benchmark process reads from several connections at
+ * once, servicing whichever has data ready.  -b sets the socket buffer
+ * sizes on both ends of each connection instead of the largest size
+ * the system allows; given a list of sizes it measures each in turn.
+ * -T skips the usual measurement and instead records when each message
+ * of each stream arrived, printing the bandwidth of each message as a
+ * function of the offset in its stream, to show slow start, buffer
+ * autotuning and how fairly the streams share the link.
+ *
  * Copyright (c) 2000 Carl Staelin.
  * Copyright (c) 1994 Larry McVoy.  Distributed under the FSF GPL with
  * additional restriction that results may published only if
@@ -16,12 +25,23 @@
 char	*id = "$Id$\n";
 #include "bench.h"
 
+#if defined(linux) || defined(__linux__)
+#include <sys/epoll.h>
+#endif
+
+#define	MAX_SOCKBUFS	64
+#define	TIMELINE_MOVE	(64*1024*1024)
+
 typedef struct _state {
-	int	sock;
-	uint64	move;
+	int	nstreams;
+	int	*socks;
+	uint64	*done;		/* bytes read from each stream */
+	uint64	**timeline;	/* -T: arrival time of each message */
+	uint64	move;		/* per stream */
 	size_t	msize;
+	int	sockbuf;
 	char	*server;
-	int	fd;
+	int	epfd;
 	char	*buf;
 } state_t;
 
@@ -32,23 +52,33 @@ void	source(int data);
 void	initialize(iter_t iterations, void* cookie);
 void	loop_transfer(iter_t iterations, void *cookie);
 void	cleanup(iter_t iterations, void* cookie);
+void	transfer(state_t *state);
+void	timeline(state_t *state);
 
 int
 main(int ac, char **av)
 {
+	int	i;
 	int	parallel = 1;
 	int	warmup = LONGER;
 	int	repetitions = -1;
 	int	shutdown = 0;
+	int	do_timeline = 0;
+	int	nsockbufs = 0;
+	int	sockbufs[MAX_SOCKBUFS];
+	char	*p;
 	state_t state;
-	char	*usage = "-s\n OR [-m <message size>] [-M <bytes to move>] [-P <parallelism>] [-W <warmup>] [-N <repetitions>] server\n OR -S serverhost\n";
+	char	*usage = "-s\n OR [-m <message size>] [-M <bytes to move>] [-n <streams>] [-b <sockbuf>[,<sockbuf>...]] [-T] [-P <parallelism>] [-W <warmup>] [-N <repetitions>] server\n OR -S serverhost\n";
 	int	c;
-	
+
 	state.msize = 0;
 	state.move = 0;
+	state.nstreams = 1;
+	state.sockbuf = 0;
+	state.timeline = NULL;
 
 	/* Rest is client argument processing */
-	while (( c = getopt(ac, av, "sS:m:M:P:W:N:")) != EOF) {
+	while (( c = getopt(ac, av, "sS:m:M:n:b:TP:W:N:")) != EOF) {
 		switch(c) {
 		case 's': /* Server */
 			if (fork() == 0) {
@@ -69,6 +99,22 @@ main(int ac, char **av)
 		case 'M':
 			state.move = bytes(optarg);
 			break;
+		case 'n':
+			state.nstreams = atoi(optarg);
+			if (state.nstreams <= 0) lmbench_usage(ac, av, usage);
+			break;
+		case 'b':
+			for (p = strtok(optarg, ","); p; p = strtok(NULL, ",")) {
+				if (nsockbufs == MAX_SOCKBUFS)
+					lmbench_usage(ac, av, usage);
+				sockbufs[nsockbufs] = bytes(p);
+				if (sockbufs[nsockbufs++] <= 0)
+					lmbench_usage(ac, av, usage);
+			}
+			break;
+		case 'T':
+			do_timeline = 1;
+			break;
 		case 'P':
 			parallel = atoi(optarg);
 			if (parallel <= 0) lmbench_usage(ac, av, usage);
@@ -91,10 +137,14 @@ main(int ac, char **av)
 
 	state.server = av[optind++];
 
+	if (do_timeline && state.move == 0) {
+		state.move = TIMELINE_MOVE;
+	}
 	if (state.msize == 0 && state.move == 0) {
 		state.msize = state.move = XFERSIZE;
 	} else if (state.msize == 0) {
 		state.msize = state.move;
+		if (do_timeline) state.msize = XFERSIZE;
 	} else if (state.move == 0) {
 		state.move = state.msize;
 	}
@@ -104,58 +154,100 @@ main(int ac, char **av)
 		state.move += state.msize - state.move % state.msize;
 	}
 
-	/*
-	 * Default is to warmup the connection for seven seconds, 
-	 * then measure performance over each timing interval.
-	 * This minimizes the effect of opening and initializing TCP 
-	 * connections.
-	 */
-	benchmp(initialize, loop_transfer, cleanup, 
-		0, parallel, warmup, repetitions, &state);
-	if (gettime() > 0) {
-		fprintf(stderr, "%.6f ", state.msize / (1000. * 1000.));
-		mb(state.move * get_n() * parallel);
+	if (do_timeline) {
+		if (nsockbufs > 0) state.sockbuf = sockbufs[0];
+		timeline(&state);
+		return (0);
+	}
+
+	if (nsockbufs > 0) {
+		fprintf(stderr, "\"bw_tcp msize=%lu streams=%d\n",
+			(unsigned long)state.msize, state.nstreams);
+	}
+	for (i = 0; i == 0 || i < nsockbufs; ++i) {
+		if (nsockbufs > 0) state.sockbuf = sockbufs[i];
+
+		/*
+		 * Default is to warmup the connection for seven seconds,
+		 * then measure performance over each timing interval.
+		 * This minimizes the effect of opening and initializing TCP
+		 * connections.
+		 */
+		benchmp(initialize, loop_transfer, cleanup,
+			0, parallel, warmup, repetitions, &state);
+		if (gettime() > 0) {
+			if (nsockbufs > 0) {
+				fprintf(stderr, "%.6f %.2f\n",
+					state.sockbuf / (1000. * 1000.),
+					(double)state.move * state.nstreams
+					* get_n() * parallel / (double)gettime());
+				continue;
+			}
+			fprintf(stderr, "%.6f ", state.msize / (1000. * 1000.));
+			mb(state.move * state.nstreams * get_n() * parallel);
+		}
 	}
+	if (nsockbufs > 0) fprintf(stderr, "\n");
 	return(0);
 }
 
 void
 initialize(iter_t iterations, void *cookie)
 {
+	int	i;
 	char	buf[100];
 	state_t *state = (state_t *) cookie;
 
 	if (iterations) return;
 
 	state->buf = valloc(state->msize);
-	if (!state->buf) {
-		perror("valloc");
+	state->socks = (int*)malloc(state->nstreams * sizeof(int));
+	state->done = (uint64*)malloc(state->nstreams * sizeof(uint64));
+	if (!state->buf || !state->socks || !state->done) {
+		perror("malloc");
 		exit(1);
 	}
 	touch(state->buf, state->msize);
+	state->epfd = -1;
 
-	state->sock = tcp_connect(state->server, TCP_DATA, SOCKOPT_READ|SOCKOPT_WRITE|SOCKOPT_REUSE);
-	if (state->sock < 0) {
-		perror("socket connection");
-		exit(1);
+	sock_setbuf(state->sockbuf);
+	sprintf(buf, "%lu %d", (unsigned long)state->msize, state->sockbuf);
+	for (i = 0; i < state->nstreams; ++i) {
+		state->socks[i] = tcp_connect(state->server, TCP_DATA,
+				SOCKOPT_READ|SOCKOPT_WRITE|SOCKOPT_REUSE);
+		if (state->socks[i] < 0) {
+			perror("socket connection");
+			exit(1);
+		}
+		if (write(state->socks[i], buf, strlen(buf) + 1) != strlen(buf) + 1) {
+			perror("control write");
+			exit(1);
+		}
 	}
-	sprintf(buf, "%lu", (unsigned long)state->msize);
-	if (write(state->sock, buf, strlen(buf) + 1) != strlen(buf) + 1) {
-		perror("control write");
+#ifdef EPOLLIN
+	if ((state->epfd = epoll_create(state->nstreams)) < 0) {
+		perror("epoll_create");
 		exit(1);
 	}
+#endif
 }
 
-void 
+void
 loop_transfer(iter_t iterations, void *cookie)
 {
 	int	c;
 	uint64	todo;
 	state_t *state = (state_t *) cookie;
 
+	if (state->nstreams > 1) {
+		while (iterations-- > 0) {
+			transfer(state);
+		}
+		return;
+	}
 	while (iterations-- > 0) {
 		for (todo = state->move; todo > 0; todo -= c) {
-			if ((c = read(state->sock, state->buf, state->msize)) <= 0) {
+			if ((c = read(state->socks[0], state->buf, state->msize)) <= 0) {
 				exit(1);
 			}
 			if (c > todo) c = todo;
@@ -163,15 +255,152 @@ loop_transfer(iter_t iterations, void *cookie)
 	}
 }
 
+/*
+ * Read state->move bytes from every stream, from whichever streams
+ * have data ready.  A stream which has delivered its share is taken
+ * out of the set we wait on until the next call.
+ */
+void
+transfer(state_t *state)
+{
+	int	i, n, c;
+	int	left = state->nstreams;
+	uint64	before;
+#ifdef EPOLLIN
+	int	j;
+	struct epoll_event ev;
+	struct epoll_event events[64];
+#else
+	int	maxfd;
+	fd_set	fds;
+#endif
+
+	for (i = 0; i < state->nstreams; ++i) {
+		state->done[i] = 0;
+#ifdef EPOLLIN
+		ev.events = EPOLLIN;
+		ev.data.u32 = i;
+		if (epoll_ctl(state->epfd, EPOLL_CTL_ADD, state->socks[i], &ev) < 0) {
+			perror("epoll_ctl");
+			exit(1);
+		}
+#endif
+	}
+	while (left > 0) {
+#ifdef EPOLLIN
+		n = epoll_wait(state->epfd, events, 64, -1);
+#else
+		FD_ZERO(&fds);
+		for (i = 0, maxfd = 0; i < state->nstreams; ++i) {
+			if (state->done[i] >= state->move) continue;
+			FD_SET(state->socks[i], &fds);
+			if (state->socks[i] > maxfd) maxfd = state->socks[i];
+		}
+		n = select(maxfd + 1, &fds, NULL, NULL, NULL);
+#endif
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			perror("bw_tcp: wait");
+			exit(1);
+		}
+#ifdef EPOLLIN
+		for (j = 0; j < n; ++j) {
+			i = events[j].data.u32;
+#else
+		for (i = 0; i < state->nstreams; ++i) {
+			if (!FD_ISSET(state->socks[i], &fds)) continue;
+#endif
+			if ((c = read(state->socks[i], state->buf, state->msize)) <= 0) {
+				exit(1);
+			}
+			before = state->done[i];
+			state->done[i] += c;
+			if (state->timeline) {
+				/* timestamp each message completed by this read */
+				uint64	t = now_nsecs();
+				uint64	k;
+
+				for (k = before / state->msize + 1;
+				     k * state->msize <= state->done[i]
+				     && k * state->msize <= state->move; ++k) {
+					state->timeline[i][k - 1] = t;
+				}
+			}
+			if (before < state->move && state->done[i] >= state->move) {
+				left--;
+#ifdef EPOLLIN
+				epoll_ctl(state->epfd, EPOLL_CTL_DEL, state->socks[i], &ev);
+#endif
+			}
+		}
+	}
+}
+
 void
 cleanup(iter_t iterations, void* cookie)
 {
+	int	i;
 	state_t *state = (state_t *) cookie;
 
 	if (iterations) return;
 
-	/* close connection */
-	(void)close(state->sock);
+	/* close connections */
+	for (i = 0; i < state->nstreams; ++i) {
+		(void)close(state->socks[i]);
+	}
+	if (state->epfd >= 0) close(state->epfd);
+	free(state->socks);
+	free(state->done);
+	free(state->buf);
+}
+
+/*
+ * Move state->move bytes over each stream once, from the moment the
+ * connections are opened, and print the bandwidth of every message
+ * against its offset in the stream.
+ */
+void
+timeline(state_t *state)
+{
+	int	i;
+	uint64	k, nblocks = state->move / state->msize;
+	uint64	start, prev;
+
+	state->timeline = (uint64**)malloc(state->nstreams * sizeof(uint64*));
+	if (!state->timeline) {
+		perror("malloc");
+		exit(1);
+	}
+	for (i = 0; i < state->nstreams; ++i) {
+		state->timeline[i] = (uint64*)calloc(nblocks, sizeof(uint64));
+		if (!state->timeline[i]) {
+			perror("malloc");
+			exit(1);
+		}
+	}
+	start = now_nsecs();
+	initialize(0, state);
+	transfer(state);
+
+	for (i = 0; i < state->nstreams; ++i) {
+		fprintf(stderr, "\"stream %d msize=%lu sockbuf=%d\n", i,
+			(unsigned long)state->msize, state->sockbuf);
+		for (k = 0, prev = start; k < nblocks; ++k) {
+			uint64	t = state->timeline[i][k];
+
+			if (t > prev) {
+				fprintf(stderr, "%.6f %.2f\n",
+					(k + 1) * state->msize / (1000. * 1000.),
+					state->msize * 1000. / (double)(t - prev));
+			}
+			prev = t;
+		}
+		fprintf(stderr, "\n");
+		free(state->timeline[i]);
+	}
+	free(state->timeline);
+	state->timeline = NULL;
+	cleanup(0, state);
 }
 
 void
@@ -205,8 +434,8 @@ server_main()
 }
 
 /*
- * Read the message size.  Keep transferring 
- * data in message-size sized packets until
+ * Read the message size and socket buffer size.  Keep
+ * transferring data in message-size sized packets until
  * the socket goes away.
  */
 void
@@ -214,6 +443,7 @@ source(int data)
 {
 	size_t	m;
 	unsigned long	nbytes;
+	int	sockbuf = 0;
 	char	*buf, scratch[100];
 
 	/*
@@ -224,7 +454,7 @@ source(int data)
 		perror("control nbytes");
 		exit(7);
 	}
-	sscanf(scratch, "%lu", &nbytes);
+	sscanf(scratch, "%lu %d", &nbytes, &sockbuf);
 	m = nbytes;
 
 	/*
@@ -236,6 +466,11 @@ source(int data)
 		exit(0);
 	}
 
+	if (sockbuf > 0) {
+		sock_setbuf(sockbuf);
+		sock_optimize(data, SOCKOPT_WRITE);
+	}
+
 	buf = valloc(m);
 	if (!buf) {
 		perror("valloc");
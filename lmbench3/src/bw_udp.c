@@ -2,9 +2,22 @@
  * bw_udp.c - simple UDP bandwidth test
  *
  * Three programs in one -
- *	server usage:	bw_tcp -s
- *	client usage:	bw_tcp [-m <message size>] [-P <parallelism>] [-W <warmup>] [-N <repetitions>] hostname [bytes]
- *	shutdown:	bw_tcp -S hostname
+ *	server usage:	bw_udp -s
+ *	client usage:	bw_udp [-m <message size>] [-b <batch>] [-w <window>] [-g] [-p] [-P <parallelism>] [-W <warmup>] [-N <repetitions>] hostname [bytes]
+ *	shutdown:	bw_udp -S hostname
+ *
+ * The client asks the server for a window of datagrams at a time,
+ * small enough to fit in its socket buffer, so that the server does
+ * not simply overrun the client.  Datagrams which are lost anyway are
+ * reported when the client exits.
+ *
+ * With -b, both sides move <batch> datagrams per system call with
+ * sendmmsg() and recvmmsg().  With -g, the server hands the kernel up
+ * to <batch> datagrams at a time as a single UDP_SEGMENT (GSO) send,
+ * and the client asks for UDP_GRO so they can arrive coalesced.  -p
+ * reports datagrams per second rather than bandwidth; together with a
+ * small message size this measures the packet rate of the UDP stack
+ * rather than the system call overhead.
  *
  * Copyright (c) 2000 Carl Staelin.
  * Copyright (c) 1994 Larry McVoy.  Distributed under the FSF GPL with
@@ -14,24 +27,42 @@
  * Support for this development by Sun Microsystems is gratefully acknowledged.
  */
 char	*id = "$Id$\n";
+#if defined(linux) || defined(__linux__)
+#define	_GNU_SOURCE	/* sendmmsg, recvmmsg */
+#endif
 #include "bench.h"
+#include <netinet/udp.h>
+
+#define	MAX_MSIZE	65507		/* largest IPv4 UDP payload */
+#define	MAX_BATCH	1024
+#define	MAX_SEGMENTS	64		/* per UDP_SEGMENT send */
+#define	RCV_TIMEOUT	250000		/* usecs before a datagram is lost */
 
-#define MAX_MSIZE (10 * 1024 * 1024)
+#define	FLAG_GSO	0x01
+
+#ifndef SOL_UDP
+#define	SOL_UDP		IPPROTO_UDP
+#endif
 
 typedef struct _state {
 	int	sock;
-	int	seq;
 	long	move;
 	long	msize;
+	int	batch;
+	int	window;
+	int	flags;
+	int	bufsize;	/* per receive buffer */
+	uint64	lost;
 	char	*server;
-	int	fd;
 	char	*buf;
 } state_t;
 
 void	server_main();
-void	client_main(int parallel, state_t *state);
+void	send_packets(int sock, struct sockaddr_in *to, char *buf,
+		     int npackets, int msize, int batch, int flags);
 void	init(iter_t iterations, void *cookie);
 void	cleanup(iter_t iterations, void *cookie);
+int	receive(state_t *state, int npackets);
 
 void	loop_transfer(iter_t iterations, void *cookie);
 
@@ -41,17 +72,19 @@ main(int ac, char **av)
 	int	parallel = 1;
 	int	warmup = 0;
 	int	repetitions = -1;
-	int	server = 0;
+	int	rate = 0;
 	state_t state;
-	char	*usage = "-s\n OR [-m <message size>] [-W <warmup>] [-N <repetitions>] server [size]\n OR -S serverhost\n";
+	char	*usage = "-s\n OR [-m <message size>] [-b <batch>] [-w <window>] [-g] [-p] [-P <parallelism>] [-W <warmup>] [-N <repetitions>] server [size]\n OR -S serverhost\n";
 	int	c;
-	uint64	usecs;
-	
+
 	state.msize = 0;
 	state.move = 10*1024*1024;
+	state.batch = 1;
+	state.window = 0;
+	state.flags = 0;
 
 	/* Rest is client argument processing */
-	while (( c = getopt(ac, av, "sS:m:W:N:")) != EOF) {
+	while (( c = getopt(ac, av, "sS:m:b:w:gpP:W:N:")) != EOF) {
 		switch(c) {
 		case 's': /* Server */
 			if (fork() == 0) {
@@ -72,7 +105,33 @@ main(int ac, char **av)
 			exit (0);
 		}
 		case 'm':
-			state.msize = atoi(optarg);
+			state.msize = bytes(optarg);
+			if (state.msize <= 0 || state.msize > MAX_MSIZE)
+				lmbench_usage(ac, av, usage);
+			break;
+		case 'b':
+			state.batch = atoi(optarg);
+			if (state.batch <= 0 || state.batch > MAX_BATCH)
+				lmbench_usage(ac, av, usage);
+			break;
+		case 'w':
+			state.window = atoi(optarg);
+			if (state.window <= 0) lmbench_usage(ac, av, usage);
+			break;
+		case 'g':
+#if defined(UDP_SEGMENT) && defined(UDP_GRO)
+			state.flags |= FLAG_GSO;
+#else
+			fprintf(stderr, "bw_udp: UDP_SEGMENT is not supported\n");
+			exit(1);
+#endif
+			break;
+		case 'p':
+			rate = 1;
+			break;
+		case 'P':
+			parallel = atoi(optarg);
+			if (parallel <= 0) lmbench_usage(ac, av, usage);
 			break;
 		case 'W':
 			warmup = atoi(optarg);
@@ -95,67 +154,189 @@ main(int ac, char **av)
 		state.move = bytes(av[optind]);
 	}
 	if (state.msize == 0) {
-		state.msize = state.move;
+		state.msize = rate ? 64 : 16 * 1024;
 	}
 	/* make the number of bytes to move a multiple of the message size */
 	if (state.move % state.msize) {
-		state.move += state.move - state.move % state.msize;
-	}
-
-	state.buf = valloc(state.msize);
-	if (!state.buf) {
-		perror("valloc");
-		exit(1);
+		state.move += state.msize - state.move % state.msize;
 	}
-	touch(state.buf, state.msize);
 
 	/*
 	 * Make one run take at least 5 seconds.
 	 * This minimizes the effect of connect & reopening TCP windows.
 	 */
 	benchmp(init, loop_transfer, cleanup, LONGER, parallel, warmup, repetitions, &state );
+	if (gettime() == 0) return (1);
 
-out:	(void)fprintf(stderr, "socket UDP bandwidth using %s: ", state.server);
+	if (rate) {
+		fprintf(stderr, "%ld byte UDP packets using %s: %.0f packets/sec\n",
+			state.msize, state.server,
+			(double)(state.move / state.msize) * get_n() * parallel
+			* 1000000. / (double)gettime());
+		return (0);
+	}
+	(void)fprintf(stderr, "socket UDP bandwidth using %s: ", state.server);
 	mb(state.move * get_n() * parallel);
+	return (0);
 }
 
 void
 init(iter_t iterations, void* cookie)
 {
+	int	rcvbuf;
+	socklen_t len = sizeof(rcvbuf);
+	struct timeval tv;
 	state_t *state = (state_t *) cookie;
 
 	if (iterations) return;
 
-	state->sock = udp_connect(state->server, UDP_XACT, SOCKOPT_NONE);
-	state->seq = 0;
-	state->buf = (char*)malloc(state->msize);
+	state->sock = udp_connect(state->server, UDP_XACT, SOCKOPT_READ);
+	state->lost = 0;
+	state->bufsize = state->msize;
+#ifdef UDP_GRO
+	if (state->flags & FLAG_GSO) {
+		int	one = 1;
+
+		if (setsockopt(state->sock, SOL_UDP, UDP_GRO, &one, sizeof(one)) < 0) {
+			perror("UDP_GRO");
+			exit(1);
+		}
+		state->bufsize = 64 * 1024;
+	}
+#endif
+	state->buf = (char*)valloc(state->bufsize * state->batch);
+	if (!state->buf) {
+		perror("valloc");
+		exit(1);
+	}
+	touch(state->buf, state->bufsize * state->batch);
+
+	/* a lost datagram must not hang the benchmark */
+	tv.tv_sec = RCV_TIMEOUT / 1000000;
+	tv.tv_usec = RCV_TIMEOUT % 1000000;
+	setsockopt(state->sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	/* ask for no more than the socket buffer can hold */
+	if (state->window == 0) {
+		if (getsockopt(state->sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &len) < 0)
+			rcvbuf = 64 * 1024;
+		state->window = rcvbuf / (state->msize + 1024);
+		if (state->window < 1) state->window = 1;
+	}
 }
 
 void
 loop_transfer(iter_t iterations, void *cookie)
 {
 	state_t *state = (state_t *) cookie;
-	char	*server = state->server;
 	int	sock = state->sock;
-	long	control[2], nbytes;
+	int	w, got, left;
+	int	control[4];
 
-	nbytes = state->move;
-	control[0] = state->move;
-	control[1] = state->msize;
+	control[1] = htonl(state->msize);
+	control[2] = htonl(state->batch);
+	control[3] = htonl(state->flags);
 
 	while (iterations-- > 0) {
-		if (send(sock, control, 2 * sizeof(long), 0) != 2 * sizeof(long)) {
-			perror("bw_udp client: send failed");
+		for (left = state->move / state->msize; left > 0; left -= w) {
+			w = left < state->window ? left : state->window;
+			control[0] = htonl(w);
+			if (send(sock, control, sizeof(control), 0) != sizeof(control)) {
+				perror("bw_udp client: send failed");
+				exit(5);
+			}
+			got = receive(state, w);
+			if (got < w) state->lost += w - got;
+		}
+	}
+}
+
+/*
+ * Receive up to npackets datagrams, returning the number received
+ * before the server stopped sending.
+ */
+int
+receive(state_t *state, int npackets)
+{
+	int	i, n;
+	int	count = 0;
+#ifdef MSG_WAITFORONE
+	struct mmsghdr	msgs[MAX_BATCH];
+#endif
+	struct iovec	iov[MAX_BATCH];
+#ifdef UDP_GRO
+	char	ctrl[MAX_BATCH][CMSG_SPACE(sizeof(int))];
+#endif
+	struct msghdr	*m, msg;
+
+	for (i = 0; i < state->batch; ++i) {
+		iov[i].iov_base = state->buf + i * state->bufsize;
+		iov[i].iov_len = state->bufsize;
+	}
+	while (count < npackets) {
+		int	vlen = npackets - count;
+
+		if (vlen > state->batch) vlen = state->batch;
+		for (i = 0; i < vlen; ++i) {
+#ifdef MSG_WAITFORONE
+			m = &msgs[i].msg_hdr;
+#else
+			m = &msg;
+#endif
+			bzero(m, sizeof(*m));
+			m->msg_iov = &iov[i];
+			m->msg_iovlen = 1;
+#ifdef UDP_GRO
+			if (state->flags & FLAG_GSO) {
+				m->msg_control = ctrl[i];
+				m->msg_controllen = sizeof(ctrl[i]);
+			}
+#endif
+		}
+#ifdef MSG_WAITFORONE
+		if (state->batch > 1) {
+			n = recvmmsg(state->sock, msgs, vlen, MSG_WAITFORONE, NULL);
+		} else
+#endif
+		{
+#ifdef MSG_WAITFORONE
+			msg = msgs[0].msg_hdr;
+#endif
+			n = recvmsg(state->sock, &msg, 0);
+#ifdef MSG_WAITFORONE
+			msgs[0].msg_hdr = msg;
+			msgs[0].msg_len = n;
+#endif
+			if (n >= 0) n = 1;
+		}
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return (count);
+			perror("bw_udp client: recv failed");
 			exit(5);
 		}
-		while (nbytes > 0) {
-			if (recv(sock, state->buf, state->msize, 0) != state->msize) {
-				perror("bw_udp client: recv failed");
-				exit(5);
+		for (i = 0; i < n; ++i) {
+#if defined(UDP_GRO) && defined(MSG_WAITFORONE)
+			struct cmsghdr	*cm;
+			int	segs = 1;
+
+			m = &msgs[i].msg_hdr;
+			for (cm = CMSG_FIRSTHDR(m); cm; cm = CMSG_NXTHDR(m, cm)) {
+				if (cm->cmsg_level == SOL_UDP
+				    && cm->cmsg_type == UDP_GRO) {
+					int	gso = *(int*)CMSG_DATA(cm);
+
+					segs = (msgs[i].msg_len + gso - 1) / gso;
+				}
 			}
-			nbytes -= state->msize;
+			count += segs;
+#else
+			count++;
+#endif
 		}
 	}
+	return (count);
 }
 
 void
@@ -165,6 +346,10 @@ cleanup(iter_t iterations, void* cookie)
 
 	if (iterations) return;
 
+	if (state->lost) {
+		fprintf(stderr, "bw_udp: %llu datagrams lost\n",
+			(unsigned long long)state->lost);
+	}
 	close(state->sock);
 	free(state->buf);
 }
@@ -172,32 +357,111 @@ cleanup(iter_t iterations, void* cookie)
 void
 server_main()
 {
-	char	*buf = (char*)valloc(MAX_MSIZE);
-	int     sock, namelen, seq = 0;
-	long	nbytes, msize;
+	char	*buf = (char*)valloc(MAX_MSIZE + 1);
+	int     sock, n;
+	int	npackets, msize, batch, flags;
+	int	control[4];
+	socklen_t namelen;
 	struct sockaddr_in it;
 
 	GO_AWAY;
 
-	sock = udp_server(UDP_XACT, SOCKOPT_NONE);
+	if (!buf) {
+		perror("valloc");
+		exit(1);
+	}
+	bzero(buf, MAX_MSIZE + 1);
+	sock = udp_server(UDP_XACT, SOCKOPT_WRITE);
 
 	while (1) {
 		namelen = sizeof(it);
-		if (recvfrom(sock, (void*)buf, 2 * sizeof(long), 0, 
-		    (struct sockaddr*)&it, &namelen) < 0) {
-			fprintf(stderr, "bw_udp server: recvfrom: got wrong size\n");
+		n = recvfrom(sock, (void*)control, sizeof(control), 0,
+			     (struct sockaddr*)&it, &namelen);
+		if (n < (int)sizeof(int)) {
+			continue;
+		}
+		npackets = ntohl(control[0]);
+		if (npackets < 0) {
+			/* shutdown */
+			udp_done(UDP_XACT);
+			exit(0);
+		}
+		if (n != sizeof(control)) {
+			continue;
+		}
+		msize = ntohl(control[1]);
+		batch = ntohl(control[2]);
+		flags = ntohl(control[3]);
+		if (msize <= 0 || msize > MAX_MSIZE) continue;
+		if (batch <= 0 || batch > MAX_BATCH) batch = 1;
+		send_packets(sock, &it, buf, npackets, msize, batch, flags);
+	}
+}
+
+/*
+ * Send npackets datagrams of msize bytes, batch at a time.
+ */
+void
+send_packets(int sock, struct sockaddr_in *to, char *buf,
+	     int npackets, int msize, int batch, int flags)
+{
+	int	i, n, k;
+#ifdef MSG_WAITFORONE
+	struct mmsghdr	msgs[MAX_BATCH];
+	struct iovec	iov;
+#endif
+
+#ifdef UDP_SEGMENT
+	if (flags & FLAG_GSO) {
+		int	segs = batch;
+
+		/* the kernel limits both the segments and the total size */
+		if (segs > MAX_SEGMENTS) segs = MAX_SEGMENTS;
+		if (segs > MAX_MSIZE / msize) segs = MAX_MSIZE / msize;
+		if (segs < 1) segs = 1;
+		if (setsockopt(sock, SOL_UDP, UDP_SEGMENT, &msize, sizeof(msize)) < 0) {
+			perror("bw_udp: UDP_SEGMENT");
 			exit(9);
 		}
-		nbytes = ntohl(*(long*)buf);
-		msize = ntohl(*((long*)buf + 1));
-		while (nbytes > 0) {
-			if (sendto(sock, (void*)buf, msize, 0, 
-				   (struct sockaddr*)&it, sizeof(it)) < 0) {
+		for (; npackets > 0; npackets -= k) {
+			k = npackets < segs ? npackets : segs;
+			if (sendto(sock, (void*)buf, k * msize, 0,
+				   (struct sockaddr*)to, sizeof(*to)) < 0) {
 				perror("bw_udp sendto");
 				exit(9);
 			}
-			nbytes -= msize;
+		}
+		n = 0;
+		setsockopt(sock, SOL_UDP, UDP_SEGMENT, &n, sizeof(n));
+		return;
+	}
+#endif
+#ifdef MSG_WAITFORONE
+	if (batch > 1) {
+		iov.iov_base = buf;
+		iov.iov_len = msize;
+		bzero(msgs, batch * sizeof(struct mmsghdr));
+		for (i = 0; i < batch; ++i) {
+			msgs[i].msg_hdr.msg_name = to;
+			msgs[i].msg_hdr.msg_namelen = sizeof(*to);
+			msgs[i].msg_hdr.msg_iov = &iov;
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		for (; npackets > 0; npackets -= n) {
+			k = npackets < batch ? npackets : batch;
+			if ((n = sendmmsg(sock, msgs, k, 0)) < 0) {
+				perror("bw_udp sendmmsg");
+				exit(9);
+			}
+		}
+		return;
+	}
+#endif
+	for (; npackets > 0; --npackets) {
+		if (sendto(sock, (void*)buf, msize, 0,
+			   (struct sockaddr*)to, sizeof(*to)) < 0) {
+			perror("bw_udp sendto");
+			exit(9);
 		}
 	}
 }
-
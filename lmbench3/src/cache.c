@@ -1,7 +1,7 @@
 /*
  * cache.c - guess the cache size(s)
  *
- * usage: cache [-c] [-L <line size>] [-M len[K|M]] [-W <warmup>] [-N <repetitions>]
+ * usage: cache [-a] [-L <line size>] [-M len[K|M]] [-W <warmup>] [-N <repetitions>]
  *
  * Copyright (c) 2000 Carl Staelin.
  * Copyright (c) 1994 Larry McVoy.  Distributed under the FSF GPL with
@@ -44,6 +44,15 @@ int	fixup_chunk(size_t i, size_t chunk, size_t npages, size_t* pages,
 		    int repetitions, struct mem_state* state);
 void	check_memory(size_t size, struct mem_state* state);
 void	pagesort(size_t n, size_t* pages, double* latencies);
+void	associativity(int nlevels, size_t* sizes, double* latencies,
+		      size_t maxlen, int repetitions, struct mem_state* state);
+int	find_ways(size_t stride, int max, double lower, double upper,
+		  double* f1, double* f2, int repetitions,
+		  struct mem_state* state);
+double	inclusion(int ways, size_t stride, double lower, double upper,
+		  size_t maxlen, int repetitions, struct mem_state* state);
+double	chain_latency(char* p, size_t n, int repetitions, 
+		      struct mem_state* state);
 
 #ifdef ABS
 #undef ABS
@@ -54,6 +63,9 @@ void	pagesort(size_t n, size_t* pages, double* latencies);
 
 #define THRESHOLD 1.5
 
+/* the most lines put into one cache set by associativity() */
+#define MAX_WAYS 64
+
 #define	FIVE(m)		m m m m m
 #define	TEN(m)		FIVE(m) FIVE(m)
 #define	FIFTY(m)	TEN(m) TEN(m) TEN(m) TEN(m) TEN(m)
@@ -89,17 +101,24 @@ main(int ac, char **av)
 	int	c;
 	int	i, j, n, start, level, prev, min;
 	int	warmup = 0;
+	int	assoc = 0;
 	int	repetitions = (1000000 <= get_enough(0) ? 1 : TRIES);
 	ssize_t	line = 0;
 	size_t	maxlen = 32 * 1024 * 1024;
 	int	*levels;
-	double	par, maxpar, prev_lat;
-	char   *usage = "[-c] [-L <line size>] [-M len[K|M]] [-W <warmup>] [-N <repetitions>]\n";
+	size_t	*sizes;
+	double	par, maxpar, prev_lat, *latencies;
+	char   *usage = "[-a] [-L <line size>] [-M len[K|M]] [-W <warmup>] [-N <repetitions>]\n"
+		"-a can only find up to 4 * len / size ways in a cache of size bytes,\n"
+		"so it needs -M at least ways / 2 times the size of the largest cache\n";
 	struct cache_results* r;
 	struct mem_state state;
 
-	while (( c = getopt(ac, av, "L:M:W:N:")) != EOF) {
+	while (( c = getopt(ac, av, "aL:M:W:N:")) != EOF) {
 		switch(c) {
+		case 'a':
+			assoc = 1;
+			break;
 		case 'L':
 			line = atoi(optarg);
 			if (line < sizeof(char*))
@@ -137,7 +156,9 @@ main(int ac, char **av)
 	n = collect_data((size_t)512, line, maxlen, repetitions, &r);
 	r[n-1].line = line;
 	levels = (int*)malloc(n * sizeof(int));
-	if (!levels) {
+	sizes = (size_t*)malloc((n + 1) * sizeof(size_t));
+	latencies = (double*)malloc((n + 1) * sizeof(double));
+	if (!levels || !sizes || !latencies) {
 		perror("malloc");
 		exit(1);
 	}
@@ -200,6 +221,8 @@ main(int ac, char **av)
 		    "L%d cache: %lu bytes %.2f nanoseconds %ld linesize %.2f parallelism\n",
 		    (int)(i+1), (unsigned long)r[levels[i]].len, 
 		    r[min].latency, (long)line, maxpar);
+		sizes[i] = r[levels[i]].len;
+		latencies[i] = r[min].latency;
 	}
 
 	/* Compute memory parallelism for main memory */
@@ -214,6 +237,13 @@ main(int ac, char **av)
 	fprintf(stderr, "Memory latency: %.2f nanoseconds %.2f parallelism\n",
 		r[n-1].latency, par);
 
+	if (assoc) {
+		latencies[level] = r[n-1].latency;
+		state.line = r[n-1].line;
+		associativity(level, sizes, latencies, maxlen, 
+			      repetitions, &state);
+	}
+
 	exit(0);
 }
 
@@ -772,3 +802,221 @@ pagesort(size_t n, size_t* pages, double* latencies)
 		}
 	}
 }
+
+/*
+ * associativity
+ *
+ * Estimate the associativity, replacement policy and inclusion of
+ * each cache level, using sets of lines which all map to the same
+ * cache set.  A stride of half the cache size or more is a multiple
+ * of the distance between lines in the same set for any cache with
+ * two or more ways.  Caches past the first are physically indexed,
+ * so the lines are laid out on huge pages, which are physically 
+ * contiguous; without them only the L1 cache is examined.
+ */
+void
+associativity(int nlevels, size_t* sizes, double* latencies,
+	      size_t maxlen, int repetitions, struct mem_state* state)
+{
+	int	i, max, ways, ways1 = 0;
+	size_t	stride, hugepage = mem_hugepage();
+	double	f1, f2, rate;
+
+	for (i = 0; i < nlevels; ++i) {
+		for (stride = state->line; 2 * stride <= sizes[i] / 2; stride <<= 1)
+			;
+		if (hugepage && stride > hugepage)
+			stride = hugepage;
+		if (i > 0 && !hugepage) {
+			fprintf(stderr, "L%d cache: no huge pages\n", i + 1);
+			continue;
+		}
+		state->pagesize = (i > 0 ? hugepage : getpagesize());
+
+		max = maxlen / stride;
+		if (max > MAX_WAYS) max = MAX_WAYS;
+		ways = find_ways(stride, max, latencies[i], latencies[i+1], 
+				 &f1, &f2, repetitions, state);
+		if (i == 0) ways1 = ways;
+
+		if (ways > 0) {
+			fprintf(stderr, "L%d cache: %d ways, %s replacement (%.2f %.2f)",
+				i + 1, ways, 
+				(f1 >= 0.75 ? "lru" : 
+				 (f2 >= 0.75 ? "pseudo-lru" : "adaptive")),
+				f1, f2);
+		} else {
+			fprintf(stderr, "L%d cache: more than %d ways%s", 
+				i + 1, max, 
+				(max < MAX_WAYS ? " (try a larger -M)" : ""));
+		}
+		if (i > 0 && ways1 > 0) {
+			rate = inclusion(ways1, stride, latencies[0], 
+					 latencies[i+1], maxlen, 
+					 repetitions, state);
+			if (rate < 0.) {
+				fprintf(stderr, ", inclusion unknown");
+			} else {
+				fprintf(stderr, ", %s (%.2f)", 
+					(rate > 0.1 ? "inclusive" : "not inclusive"),
+					rate);
+			}
+		}
+		fprintf(stderr, "\n");
+	}
+	state->pagesize = getpagesize();
+}
+
+/*
+ * find_ways
+ *
+ * Walk round sets of 1, 2, 3, ... lines which map to the same set 
+ * and find the largest set which still hits in this cache, i.e. for
+ * which less than a quarter of the way from this cache's latency 
+ * (lower) to the next level's (upper) is lost to misses.  The
+ * fraction of loads which miss with one line more than that, and
+ * with twice as many lines, hints at the replacement policy:
+ * with LRU every load misses as soon as the set overflows, while 
+ * pseudo-LRU and random replacement keep some of the lines, and
+ * adaptive policies keep part of the set even when it is twice the
+ * size of the cache set.
+ */
+int
+find_ways(size_t stride, int max, double lower, double upper,
+	  double* f1, double* f2, int repetitions, struct mem_state* state)
+{
+	int	i, n, ways = 0;
+	size_t	maplen;
+	char	*addr, *base;
+	double	latency;
+
+	*f1 = *f2 = 0.;
+	addr = mem_map(max * stride + state->pagesize, state->pagesize, &maplen);
+	if (!addr) return (0);
+	base = addr;
+	if ((unsigned long)base % state->pagesize)
+		base += state->pagesize - (unsigned long)base % state->pagesize;
+
+	for (n = 1; n <= max; ++n) {
+		for (i = 0; i < n; ++i) {
+			*(char**)(base + i * stride) = 
+				base + ((i + 1) % n) * stride;
+		}
+		latency = chain_latency(base, n, repetitions, state);
+		latency = (latency - lower) / (upper - lower);
+		if (latency < 0.) latency = 0.;
+		if (latency > 1.) latency = 1.;
+
+		if (ways == 0 && latency > 0.25) {
+			ways = n - 1;
+			*f1 = latency;
+		}
+		*f2 = latency;
+		if (ways > 0 && n >= 2 * ways) break;
+	}
+	munmap(addr, maplen);
+	return (ways);
+}
+
+/*
+ * inclusion
+ *
+ * Does missing in this cache take lines out of the L1 cache?  A few
+ * hot lines are read every round, together with a few more lines from
+ * the same set, which are read in turn.  Together they fit in the L1
+ * cache's set, so the hot lines stay in the L1 cache, and only the
+ * other lines go on to this cache.  There, the hot lines are never
+ * touched again, so once enough other lines have gone through the set
+ * they are evicted; in an inclusive cache they are then also taken
+ * out of the L1 cache.  The same walk with the hot lines in another
+ * set is the control.  Returns the fraction of hot line loads which
+ * missed, or -1 if there was not enough memory.
+ */
+double
+inclusion(int ways, size_t stride, double lower, double upper,
+	  size_t maxlen, int repetitions, struct mem_state* state)
+{
+	int	i, j, k, hot, other, rounds, n;
+	size_t	maplen;
+	char	*addr, *base, **p, *next;
+	double	rate, latency[2];
+
+	hot = ways / 4 > 0 ? ways / 4 : 1;
+	other = ways / 2 > 0 ? ways / 2 : 1;
+	rounds = state->line / sizeof(char*);
+	if (rounds > 8) rounds = 8;
+	n = hot + rounds * other;
+	if (n * stride > maxlen) return (-1.);
+
+	addr = mem_map(n * stride + state->pagesize, state->pagesize, &maplen);
+	if (!addr) return (-1.);
+	base = addr;
+	if ((unsigned long)base % state->pagesize)
+		base += state->pagesize - (unsigned long)base % state->pagesize;
+
+	/*
+	 * Each round reads the hot lines, using a different word of the 
+	 * line each round, and then the next few of the other lines.
+	 */
+	for (k = 0; k < 2; ++k) {
+		p = NULL;
+		for (j = 0; j < rounds; ++j) {
+			for (i = 0; i < hot + other; ++i) {
+				if (i < hot) {
+					next = base + i * stride
+						+ k * state->line 
+						+ j * sizeof(char*);
+				} else {
+					next = base 
+						+ (hot + j * other + i - hot) * stride;
+				}
+				if (p) *p = next;
+				p = (char**)next;
+			}
+		}
+		*p = base + k * state->line;
+		latency[k] = chain_latency(base + k * state->line,
+					   rounds * (hot + other), 
+					   repetitions, state);
+	}
+	munmap(addr, maplen);
+
+	rate = (latency[0] - latency[1]) * (hot + other) 
+		/ (hot * (upper - lower));
+	return (rate > 0. ? rate : 0.);
+}
+
+/*
+ * The median latency of a pointer chain of n loads starting at p
+ */
+double
+chain_latency(char* p, size_t n, int repetitions, struct mem_state* state)
+{
+	int	i;
+	double	latency;
+	result_t *r, *r_save;
+
+	r_save = get_results();
+	r = (result_t*)malloc(sizeof_result(repetitions));
+	if (!r) {
+		perror("malloc");
+		exit(3);
+	}
+	insertinit(r);
+
+	addr_save = NULL;
+	state->p[0] = p;
+	/* run through the chain once to load the caches */
+	mem_benchmark((n + 100) / 100, state);
+
+	for (i = 0; i < repetitions; ++i) {
+		BENCH1(mem_benchmark(__n, state); __n = 1;, 0)
+		insertsort(gettime(), get_n(), r);
+	}
+	set_results(r);
+	latency = (1000. * (double)gettime()) / (100. * (double)get_n());
+	set_results(r_save);
+	free(r);
+
+	return (latency);
+}
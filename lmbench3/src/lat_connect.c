@@ -2,8 +2,9 @@
  * lat_connect.c - simple TCP connection latency test
  *
  * Three programs in one -
- *	server usage:	lat_connect -s
+ *	server usage:	lat_connect -s [-a <acceptors>] [-R] [-e]
  *	client usage:	lat_connect [-N <repetitions>] hostname
+ *			lat_connect -r [-P <clients>] [-t <seconds>] hostname
  *	shutdown:	lat_connect -hostname
  *
  * lat_connect may not be parallelized because of idiosyncracies
@@ -12,9 +13,21 @@
  * up the set of available connections with TIME_WAIT connections.
  * We can only measure the TCP connection cost accurately if we
  * do just a few connections.  Since the parallel harness needs
- * each child to run for a second, this guarantees that the 
+ * each child to run for a second, this guarantees that the
  * parallel version will generate inaccurate results.
  *
+ * The connection rate mode (-r) does not use the parallel harness.
+ * Instead <clients> processes connect and close as fast as they can
+ * for a fixed time, resetting each connection on close so that it
+ * does not linger in TIME_WAIT, and time every connect.  The result
+ * is the aggregate connection rate and the median and 99th percentile
+ * connect latency.  The server side can be scaled to match: -a forks
+ * several acceptors sharing the listen socket, -R gives each acceptor
+ * its own listen socket on the same port with SO_REUSEPORT so the
+ * kernel shards the connections between them, and -e has each
+ * acceptor accept4() and close connections from an epoll loop rather
+ * than serving one connection at a time.
+ *
  * Copyright (c) 1994 Larry McVoy.  Distributed under the FSF GPL with
  * additional restriction that results may published only if
  * (1) the benchmark is unmodified, and
@@ -22,31 +35,51 @@
  * Support for this development by Sun Microsystems is gratefully acknowledged.
  */
 char	*id = "$Id$\n";
+#if defined(linux) || defined(__linux__)
+#define	_GNU_SOURCE	/* accept4 */
+#endif
 #include "bench.h"
 
+#if defined(linux) || defined(__linux__)
+#include <sys/epoll.h>
+#endif
+
+#define	MAX_EVENTS	64
+
 typedef struct _state {
 	char	*server;
+	int	acceptors;
+	int	reuseport;
+	int	epoll;
 } state_t;
 
 void	doclient(iter_t iterations, void * cookie);
-void	server_main();
+void	rate(state_t *state, int clients, uint64 nsecs);
+void	rate_client(state_t *state, int go, int out, uint64 nsecs);
+void	server_main(state_t *state);
+void	acceptor(int sock, int epoll);
 
 int
 main(int ac, char **av)
 {
 	state_t state;
+	int	server = 0;
+	int	clients = 0;
+	int	seconds = 1;
 	int	repetitions = -1;
 	int 	c;
 	char	buf[256];
-	char	*usage = "-s\n OR [-S] [-N <repetitions>] server\n";
+	char	*usage = "-s [-a <acceptors>] [-R] [-e]\n OR [-S] [-N <repetitions>] server\n OR -r [-P <clients>] [-t <seconds>] server\n";
 
-	while (( c = getopt(ac, av, "sSP:W:N:")) != EOF) {
+	state.acceptors = 1;
+	state.reuseport = 0;
+	state.epoll = 0;
+
+	while (( c = getopt(ac, av, "sSa:ReP:rt:W:N:")) != EOF) {
 		switch(c) {
 		case 's': /* Server */
-			if (fork() == 0) {
-				server_main();
-			}
-			exit(0);
+			server = 1;
+			break;
 		case 'S': /* shutdown serverhost */
 		{
 			int sock = tcp_connect(av[optind],
@@ -56,6 +89,32 @@ main(int ac, char **av)
 			close(sock);
 			exit(0);
 		}
+		case 'a':
+			state.acceptors = atoi(optarg);
+			if (state.acceptors <= 0) lmbench_usage(ac, av, usage);
+			break;
+		case 'R':
+			state.reuseport = 1;
+			break;
+		case 'e':
+#ifdef EPOLLIN
+			state.epoll = 1;
+#else
+			fprintf(stderr, "lat_connect: epoll is not supported\n");
+			exit(1);
+#endif
+			break;
+		case 'r':
+			if (clients == 0) clients = 1;
+			break;
+		case 'P':
+			clients = atoi(optarg);
+			if (clients <= 0) lmbench_usage(ac, av, usage);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			if (seconds <= 0) lmbench_usage(ac, av, usage);
+			break;
 		case 'N':
 			repetitions = atoi(optarg);
 			break;
@@ -65,11 +124,22 @@ main(int ac, char **av)
 		}
 	}
 
+	if (server) {
+		if (fork() == 0) {
+			server_main(&state);
+		}
+		exit(0);
+	}
+
 	if (optind + 1 != ac) {
 		lmbench_usage(ac, av, usage);
 	}
 
 	state.server = av[optind];
+	if (clients) {
+		rate(&state, clients, (uint64)seconds * 1000000000);
+		exit(0);
+	}
 	benchmp(NULL, doclient, NULL, 0, 1, 0, repetitions, &state);
 
 	sprintf(buf, "TCP/IP connection cost to %s", state.server);
@@ -83,28 +153,293 @@ doclient(iter_t iterations, void *cookie)
 	state_t *state = (state_t *) cookie;
 	register char	*server = state->server;
 	register int 	sock;
-	
+
 	while (iterations-- > 0) {
 		sock = tcp_connect(server, TCP_CONNECT, SOCKOPT_REUSE);
 		close(sock);
 	}
 }
 
+/*
+ * Run <clients> connecting processes for nsecs and report the
+ * connection rate and latency distribution over all of them.
+ */
+void
+rate(state_t *state, int clients, uint64 nsecs)
+{
+	int	i, n;
+	int	go[2];
+	int	*fds;
+	pid_t	*pids;
+	uint64	hdr[3];
+	uint64	count = 0;
+	uint64	failed = 0;
+	uint64	size = 0;
+	uint64	*samples = NULL;
+	double	cps = 0.;
+	char	*p;
+
+	fds = (int*)malloc(clients * sizeof(int));
+	pids = (pid_t*)malloc(clients * sizeof(pid_t));
+	if (!fds || !pids || pipe(go) < 0) {
+		perror("lat_connect");
+		exit(1);
+	}
+	for (i = 0; i < clients; ++i) {
+		int	r[2];
+
+		if (pipe(r) < 0) {
+			perror("pipe");
+			exit(1);
+		}
+		switch (pids[i] = fork()) {
+		case -1:
+			perror("fork");
+			exit(1);
+		case 0:
+			close(go[1]);
+			close(r[0]);
+			rate_client(state, go[0], r[1], nsecs);
+			exit(0);
+		default:
+			close(r[1]);
+			fds[i] = r[0];
+			break;
+		}
+	}
+	/* closing the pipe starts all the clients at once */
+	close(go[0]);
+	close(go[1]);
+
+	for (i = 0; i < clients; ++i) {
+		/* { connections, failures, elapsed nsecs } then samples */
+		if (read(fds[i], hdr, sizeof(hdr)) != sizeof(hdr)) {
+			fprintf(stderr, "lat_connect: client %d failed\n", i);
+			exit(1);
+		}
+		samples = (uint64*)realloc(samples,
+				(count + hdr[0] + 1) * sizeof(uint64));
+		if (!samples) {
+			perror("realloc");
+			exit(1);
+		}
+		p = (char*)(samples + count);
+		for (size = hdr[0] * sizeof(uint64); size > 0; size -= n) {
+			if ((n = read(fds[i], p, size)) <= 0) {
+				fprintf(stderr, "lat_connect: client %d failed\n", i);
+				exit(1);
+			}
+			p += n;
+		}
+		close(fds[i]);
+		waitpid(pids[i], NULL, 0);
+		if (hdr[2] > 0) cps += (double)hdr[0] * 1.0e9 / (double)hdr[2];
+		count += hdr[0];
+		failed += hdr[1];
+	}
+
+	fprintf(stderr, "TCP/IP connection rate to %s: %d clients: %.0f connections/sec, p50 %.2f p99 %.2f microseconds\n",
+		state->server, clients, cps,
+		(double)uint64_percentile(50., samples, count) / 1000.,
+		(double)uint64_percentile(99., samples, count) / 1000.);
+	if (failed) {
+		fprintf(stderr, "lat_connect: %llu connections failed\n",
+			(unsigned long long)failed);
+	}
+	free(samples);
+	free(pids);
+	free(fds);
+}
+
+void
+rate_client(state_t *state, int go, int out, uint64 nsecs)
+{
+	int	sock;
+	char	c;
+	char	*p;
+	int	n;
+	size_t	size = 1024;
+	uint64	hdr[3];
+	uint64	start, t, deadline;
+	uint64	*samples = (uint64*)malloc(size * sizeof(uint64));
+	struct linger l;
+
+	if (!samples) {
+		perror("malloc");
+		exit(1);
+	}
+	hdr[0] = hdr[1] = 0;
+	l.l_onoff = 1;
+	l.l_linger = 0;
+
+	/* look up the server before the clock starts */
+	sock = tcp_connect(state->server, TCP_CONNECT, SOCKOPT_NONE);
+	if (sock >= 0) {
+		setsockopt(sock, SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+		close(sock);
+	}
+	(void)read(go, &c, 1);
+
+	start = now_nsecs();
+	deadline = start + nsecs;
+	while ((t = now_nsecs()) < deadline) {
+		if ((sock = tcp_connect(state->server,
+					TCP_CONNECT, SOCKOPT_NONE)) < 0) {
+			hdr[1]++;
+			continue;
+		}
+		if (hdr[0] == size) {
+			size *= 2;
+			samples = (uint64*)realloc(samples, size * sizeof(uint64));
+			if (!samples) {
+				perror("realloc");
+				exit(1);
+			}
+		}
+		samples[hdr[0]++] = now_nsecs() - t;
+		/* reset the connection rather than leave it in TIME_WAIT */
+		setsockopt(sock, SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+		close(sock);
+	}
+	hdr[2] = now_nsecs() - start;
+
+	if (write(out, hdr, sizeof(hdr)) != sizeof(hdr)) exit(1);
+	p = (char*)samples;
+	for (size = hdr[0] * sizeof(uint64); size > 0; size -= n) {
+		if ((n = write(out, p, size)) <= 0) exit(1);
+		p += n;
+	}
+	close(out);
+}
+
 void
-server_main()
+server_main(state_t *state)
 {
-	int     newsock, sock;
+	int	i, sock, port;
+	int	rdwr = SOCKOPT_NONE|SOCKOPT_REUSE;
+	pid_t	pid, *pids;
 	char	c ='1';
 
 	GO_AWAY;
-	sock = tcp_server(TCP_CONNECT, SOCKOPT_NONE|SOCKOPT_REUSE);
-	for (;;) {
-		newsock = tcp_accept(sock, SOCKOPT_NONE);
-		if (read(newsock, &c, 1) > 0) {
-			tcp_done(TCP_CONNECT);
+	if (state->reuseport) rdwr |= SOCKOPT_REUSEPORT;
+	sock = tcp_server(TCP_CONNECT, rdwr);
+	/*
+	 * The clients can open connections much faster than an acceptor
+	 * takes them; give them a deep accept queue rather than measure
+	 * SYN retransmits.
+	 */
+	listen(sock, SOMAXCONN);
+	if (state->acceptors == 1 && !state->reuseport && !state->epoll) {
+		for (;;) {
+			int newsock = tcp_accept(sock, SOCKOPT_NONE);
+			if (read(newsock, &c, 1) > 0) {
+				tcp_done(TCP_CONNECT);
+				exit(0);
+			}
+			close(newsock);
+		}
+	}
+
+	/*
+	 * An acceptor exits when it gets the shutdown message; we then
+	 * take down the rest of them.
+	 */
+	port = sockport(sock);
+	pids = (pid_t*)malloc(state->acceptors * sizeof(pid_t));
+	if (!pids) {
+		perror("malloc");
+		exit(1);
+	}
+	for (i = 0; i < state->acceptors; ++i) {
+		switch (pids[i] = fork()) {
+		case -1:
+			perror("fork");
+			exit(1);
+		case 0:
+			GO_AWAY;
+			if (state->reuseport && i > 0) {
+				close(sock);
+				sock = tcp_server(-port, rdwr);
+				listen(sock, SOMAXCONN);
+			}
+			acceptor(sock, state->epoll);
 			exit(0);
+		default:
+			break;
+		}
+	}
+	while ((pid = wait(NULL)) < 0 && errno == EINTR)
+		;
+	for (i = 0; i < state->acceptors; ++i) {
+		if (pids[i] != pid) kill(pids[i], SIGTERM);
+	}
+	tcp_done(TCP_CONNECT);
+	exit(0);
+}
+
+/*
+ * Accept connections and close them when the client does, until a
+ * client sends the shutdown message.
+ */
+void
+acceptor(int sock, int epoll)
+{
+	int	newsock;
+	char	c;
+#ifdef EPOLLIN
+	int	i, n, r, epfd;
+	struct epoll_event ev, events[MAX_EVENTS];
+#endif
+
+	if (!epoll) {
+		for (;;) {
+			newsock = tcp_accept(sock, SOCKOPT_NONE);
+			if (read(newsock, &c, 1) > 0) exit(0);
+			close(newsock);
+		}
+	}
+#ifdef EPOLLIN
+	if ((epfd = epoll_create(MAX_EVENTS)) < 0) {
+		perror("epoll_create");
+		exit(1);
+	}
+	fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+	ev.events = EPOLLIN;
+	ev.data.fd = sock;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &ev) < 0) {
+		perror("epoll_ctl");
+		exit(1);
+	}
+	for (;;) {
+		if ((n = epoll_wait(epfd, events, MAX_EVENTS, -1)) < 0) {
+			if (errno == EINTR) continue;
+			perror("epoll_wait");
+			exit(1);
+		}
+		for (i = 0; i < n; ++i) {
+			int	fd = events[i].data.fd;
+
+			if (fd != sock) {
+				r = read(fd, &c, 1);
+				if (r > 0) exit(0);
+				if (r == 0 || errno != EAGAIN) close(fd);
+				continue;
+			}
+			while ((newsock = accept4(sock, NULL, NULL,
+					SOCK_NONBLOCK|SOCK_CLOEXEC)) >= 0) {
+				ev.events = EPOLLIN;
+				ev.data.fd = newsock;
+				if (epoll_ctl(epfd, EPOLL_CTL_ADD, newsock, &ev) < 0) {
+					perror("epoll_ctl");
+					exit(1);
+				}
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK
+			    && errno != ECONNABORTED && errno != EINTR) {
+				perror("accept4");
+				exit(6);
+			}
 		}
-		close(newsock);
 	}
-	/* NOTREACHED */
+#endif
 }
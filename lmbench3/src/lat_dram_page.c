@@ -1,7 +1,8 @@
 /*
  * lat_dram_page.c - guess the DRAM page latency
  *
- * usage: lat_dram_page
+ * usage: lat_dram_page [-L <line size>] [-T <group>] [-M len[K|M]] [-W <warmup>] [-N <repetitions>]
+ *	  lat_dram_page -m [-s <samples>] [-M len[K|M]]
  *
  * Copyright (c) 2002 Carl Staelin.
  * Copyright (c) 1994 Larry McVoy.  Distributed under the FSF GPL with
@@ -17,6 +18,7 @@ char	*id = "$Id$\n";
 void	dram_page_initialize(iter_t iterations, void* cookie);
 void	benchmark_loads(iter_t iterations, void *cookie);
 double	loads(benchmp_f initialize, int len, int warmup, int repetitions, void* cookie);
+int	dram_map(size_t len, int samples);
 
 struct dram_page_state
 {
@@ -31,17 +33,26 @@ main(int ac, char **av)
 	int	warmup = 0;
 	int	repetitions = -1;
 	int	c;
+	int	map = 0;
+	int	samples = 2000;
 	struct dram_page_state state;
 	double	dram_hit, dram_miss;
-	char   *usage = "[-v] [-W <warmup>] [-N <repetitions>][-M len[K|M]]\n";
+	char   *usage = "[-v] [-W <warmup>] [-N <repetitions>][-M len[K|M]]\n\t-m [-s <samples>] [-M len[K|M]]\n";
 
 	state.mstate.width = 1;
 	state.mstate.line = sizeof(char*);
 	state.mstate.pagesize = getpagesize();
 	state.group = 16;
 
-	while (( c = getopt(ac, av, "aL:T:M:W:N:")) != EOF) {
+	while (( c = getopt(ac, av, "amL:T:M:W:N:s:")) != EOF) {
 		switch(c) {
+		case 'm':
+			map = 1;
+			break;
+		case 's':
+			samples = atoi(optarg);
+			if (samples < 100) lmbench_usage(ac, av, usage);
+			break;
 		case 'L':
 			state.mstate.line = bytes(optarg);
 			break;
@@ -63,6 +74,10 @@ main(int ac, char **av)
 		}
 	}
 
+	if (map) {
+		return (dram_map(maxlen, samples));
+	}
+
 	dram_hit = loads(mem_initialize, maxlen, warmup, repetitions, &state);
 	dram_miss = loads(dram_page_initialize, maxlen, warmup, repetitions, &state);
 
@@ -194,3 +209,435 @@ loads(benchmp_f initialize, int len, int warmup, int repetitions, void* cookie)
 
 	return result;
 }
+
+/*
+ * DRAM address mapping
+ *
+ * Two loads from different rows of the same bank are slower than two
+ * loads from different banks, or from the same row, because the open
+ * row has to be closed first.  Timing pairs of loads, with the lines
+ * flushed from the cache in between, sorts a sample of addresses into
+ * those which share a bank with a base address and those which don't.
+ * Every bank (and channel and rank) select function of the form
+ * parity(address & mask) is the same for the base and for all the
+ * addresses which conflict with it, which is enough to find the masks.
+ *
+ * Physical addresses come from /proc/self/pagemap where it shows page
+ * frame numbers (usually only to root); otherwise the samples are all
+ * taken from one huge page, whose page offset is the low bits of the
+ * physical address, and only those bits are examined.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define	DRAM_FLUSH(p)	__builtin_ia32_clflush(p)
+#define	DRAM_FENCE()	__builtin_ia32_mfence()
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define	DRAM_FLUSH(p)	__asm__ __volatile__("dc civac, %0" : : "r" (p) : "memory")
+#define	DRAM_FENCE()	__asm__ __volatile__("dsb ish" : : : "memory")
+#endif
+
+#define	DRAM_MINBIT	6	/* lines are at least 64 bytes */
+#define	DRAM_MAXFUNCS	16
+#define	DRAM_MAXWEIGHT	6	/* most bits in one function */
+#define	DRAM_PAIRS	500	/* pairs of loads per measurement */
+
+struct dram_page {
+	uint64	phys;
+	char*	virt;
+};
+
+struct dram_map_state {
+	char*	base;
+	size_t	len;
+	size_t	pagesize;
+	int	pagemap;			/* pagemap file descriptor */
+	struct dram_page* pages;	/* sorted by physical address */
+	uint64	varying;		/* bits which differ in the sample */
+	uint64	funcs[DRAM_MAXFUNCS];
+	int	nfuncs;
+};
+
+/*
+ * The physical address of p, or 0 if the pagemap does not say
+ */
+uint64
+dram_phys(int fd, char* p)
+{
+	uint64	entry, pfn;
+	size_t	pagesize = getpagesize();
+
+	if (pread(fd, &entry, sizeof(entry), 
+		  ((unsigned long)p / pagesize) * sizeof(entry)) != sizeof(entry))
+		return (0);
+	pfn = entry & (((uint64)1 << 55) - 1);
+	if (!(entry & ((uint64)1 << 63)) || pfn == 0)
+		return (0);
+	return (pfn * pagesize + (unsigned long)p % pagesize);
+}
+
+/*
+ * Whether the mapping holding p is backed by pages of at least
+ * pagesize, from its KernelPageSize (hugetlbfs) or AnonHugePages
+ * (transparent huge pages) in /proc/self/smaps: 1 if it is, 0 if it
+ * is not, and -1 if smaps does not say.
+ */
+int
+dram_huge(char* p, size_t pagesize)
+{
+	FILE*	f;
+	char	buf[256];
+	int	inside = 0, huge = -1;
+	unsigned long	start, end, kb;
+
+	if ((f = fopen("/proc/self/smaps", "r")) == NULL)
+		return (-1);
+	while (fgets(buf, sizeof(buf), f)) {
+		if (sscanf(buf, "%lx-%lx ", &start, &end) == 2) {
+			if (inside) break;
+			inside = (start <= (unsigned long)p 
+				  && (unsigned long)p < end);
+			continue;
+		}
+		if (!inside) continue;
+		if (sscanf(buf, "KernelPageSize: %lu kB", &kb) == 1
+		    && kb * 1024 >= pagesize) {
+			huge = 1;
+			break;
+		}
+		if (sscanf(buf, "AnonHugePages: %lu kB", &kb) == 1)
+			huge = (kb * 1024 >= pagesize);
+	}
+	fclose(f);
+	return (huge);
+}
+
+int
+dram_page_cmp(const void* a, const void* b)
+{
+	uint64	x = ((struct dram_page*)a)->phys;
+	uint64	y = ((struct dram_page*)b)->phys;
+
+	return (x < y ? -1 : (x > y ? 1 : 0));
+}
+
+int
+dram_double_cmp(const void* a, const void* b)
+{
+	double	x = *(double*)a;
+	double	y = *(double*)b;
+
+	return (x < y ? -1 : (x > y ? 1 : 0));
+}
+
+/*
+ * The physical address of p, and the virtual address of physical
+ * address phys, if it falls in the buffer
+ */
+uint64
+dram_addr(struct dram_map_state* m, char* p)
+{
+	if (m->pagemap < 0)
+		return ((unsigned long)p % m->pagesize);
+	return (dram_phys(m->pagemap, p));
+}
+
+char*
+dram_virt(struct dram_map_state* m, char* base, uint64 phys)
+{
+	struct dram_page key, *page;
+
+	if (m->pagemap < 0)
+		return (base - (unsigned long)base % m->pagesize + phys);
+
+	key.phys = phys - phys % m->pagesize;
+	page = (struct dram_page*)bsearch(&key, m->pages, m->len / m->pagesize,
+					  sizeof(key), dram_page_cmp);
+	return (page ? page->virt + phys % m->pagesize : NULL);
+}
+
+#ifdef DRAM_FLUSH
+/*
+ * Nanoseconds per pair of uncached loads from a and b, the median
+ * of a few tries
+ */
+double
+dram_pair(char* a, char* b)
+{
+	int	i, j;
+	uint64	start;
+	double	t[5], tmp;
+
+	for (i = 0; i < 5; ++i) {
+		start = now_nsecs();
+		for (j = 0; j < DRAM_PAIRS; ++j) {
+			use_int(*(volatile char*)a);
+			use_int(*(volatile char*)b);
+			DRAM_FLUSH(a);
+			DRAM_FLUSH(b);
+			DRAM_FENCE();
+		}
+		t[i] = (double)(now_nsecs() - start) / DRAM_PAIRS;
+		for (j = i; j > 0 && t[j-1] > t[j]; --j) {
+			tmp = t[j]; t[j] = t[j-1]; t[j-1] = tmp;
+		}
+	}
+	return (t[2]);
+}
+#endif
+
+double
+dram_median(double* times, int n)
+{
+	double	median, *t = (double*)malloc(n * sizeof(double));
+
+	if (!t) {
+		perror("malloc");
+		exit(1);
+	}
+	bcopy(times, t, n * sizeof(double));
+	qsort(t, n, sizeof(double), dram_double_cmp);
+	median = t[n / 2];
+	free(t);
+	return (median);
+}
+
+int
+dram_parity(uint64 x)
+{
+	x ^= x >> 32; x ^= x >> 16; x ^= x >> 8;
+	x ^= x >> 4; x ^= x >> 2; x ^= x >> 1;
+	return ((int)(x & 1));
+}
+
+/*
+ * Add mask to the functions found unless it is a combination of
+ * the ones already there; the functions are kept in a reduced form
+ * alongside, indexed by their highest bit.
+ */
+void
+dram_add(struct dram_map_state* m, uint64* reduced, uint64 mask)
+{
+	int	bit;
+	uint64	x = mask;
+
+	for (bit = 63; bit >= 0 && x; --bit) {
+		if (!(x & ((uint64)1 << bit))) continue;
+		if (!reduced[bit]) {
+			reduced[bit] = x;
+			m->funcs[m->nfuncs++] = mask;
+			return;
+		}
+		x ^= reduced[bit];
+	}
+}
+
+/*
+ * Try every mask of weight bits among the varying bits from bit up
+ * which agrees between the base and the conflicting addresses,
+ * allowing for a few samples which were put on the wrong side
+ */
+void
+dram_search(struct dram_map_state* m, uint64* reduced, uint64* diffs, 
+	    int ndiffs, uint64 mask, int bit, int weight)
+{
+	int	i, wrong;
+
+	if (m->nfuncs >= DRAM_MAXFUNCS) return;
+	if (weight == 0) {
+		for (i = wrong = 0; i < ndiffs; ++i) {
+			wrong += dram_parity(diffs[i] & mask);
+			if (wrong > ndiffs / 16) return;
+		}
+		dram_add(m, reduced, mask);
+		return;
+	}
+	for (; bit < 64; ++bit) {
+		if (!(m->varying & ((uint64)1 << bit))) continue;
+		dram_search(m, reduced, diffs, ndiffs, 
+			    mask | ((uint64)1 << bit), bit + 1, weight - 1);
+	}
+}
+
+void
+dram_print_mask(uint64 mask)
+{
+	int	bit, first = 1;
+
+	for (bit = 0; bit < 64; ++bit) {
+		if (!(mask & ((uint64)1 << bit))) continue;
+		fprintf(stderr, "%s%d", first ? " " : "^", bit);
+		first = 0;
+	}
+}
+
+int
+dram_map(size_t len, int samples)
+{
+#ifndef DRAM_FLUSH
+	fprintf(stderr, "lat_dram_page: -m needs a cache flush instruction\n");
+	return (1);
+#else
+	int	i, j, fd, nconflicts, maxbit;
+	size_t	npages, maplen;
+	uint64	base_phys, phys, seed, reduced[64];
+	uint64	*diffs;
+	char	*addr, *base, *p, **sample;
+	double	*times, lo, hi, median, threshold, sum[2];
+	int	count[2];
+	struct dram_map_state m;
+
+	bzero(&m, sizeof(m));
+	bzero(reduced, sizeof(reduced));
+	seed = mem_random(getpid() ^ now_nsecs(), 0);
+
+	/* use physical addresses if the pagemap shows them */
+	m.pagesize = getpagesize();
+	m.len = len - len % m.pagesize;
+	fd = open("/proc/self/pagemap", O_RDONLY);
+	addr = mem_map(m.len, m.pagesize, &maplen);
+	if (!addr) {
+		perror("lat_dram_page: mmap");
+		return (1);
+	}
+	addr[0] = 1;
+	m.pagemap = -1;
+	if (fd >= 0 && dram_phys(fd, addr)) {
+		m.pagemap = fd;
+		base = addr;
+	} else {
+		if (fd >= 0) close(fd);
+		munmap(addr, maplen);
+		m.pagesize = mem_hugepage();
+		if (m.pagesize == 0 || len < m.pagesize) {
+			fprintf(stderr, "lat_dram_page: no physical addresses and no huge pages\n");
+			return (1);
+		}
+		m.len = m.pagesize;
+		addr = mem_map(m.len, m.pagesize, &maplen);
+		if (!addr) {
+			perror("lat_dram_page: mmap");
+			return (1);
+		}
+		base = addr;
+		if ((unsigned long)base % m.pagesize)
+			base += m.pagesize - (unsigned long)base % m.pagesize;
+	}
+	m.base = base;
+	for (i = 0; i < m.len; i += getpagesize())
+		base[i] = 1;
+
+	/* page offsets are only physical if the huge page really is one */
+	if (m.pagemap < 0) {
+		switch (dram_huge(base, m.pagesize)) {
+		case 0:
+			fprintf(stderr, "lat_dram_page: no huge page was had for the samples\n");
+			return (1);
+		case -1:
+			fprintf(stderr, "lat_dram_page: cannot tell if the samples are in a huge page\n");
+			break;
+		}
+	}
+
+	npages = m.len / m.pagesize;
+	maxbit = 0;
+	if (m.pagemap >= 0) {
+		m.pages = (struct dram_page*)malloc(npages * sizeof(struct dram_page));
+		if (!m.pages) {
+			perror("malloc");
+			return (1);
+		}
+		for (i = 0; i < npages; ++i) {
+			m.pages[i].virt = base + i * m.pagesize;
+			m.pages[i].phys = dram_phys(m.pagemap, m.pages[i].virt);
+		}
+		qsort(m.pages, npages, sizeof(struct dram_page), dram_page_cmp);
+		for (phys = m.pages[npages-1].phys; phys; phys >>= 1)
+			++maxbit;
+	} else {
+		for (phys = m.pagesize - 1; phys; phys >>= 1)
+			++maxbit;
+	}
+
+	/* time the base line against a sample of other lines */
+	sample = (char**)malloc(samples * sizeof(char*));
+	times = (double*)malloc(samples * sizeof(double));
+	diffs = (uint64*)malloc(samples * sizeof(uint64));
+	if (!sample || !times || !diffs) {
+		perror("malloc");
+		return (1);
+	}
+	p = base + (mem_random(seed, 0) % (m.len >> DRAM_MINBIT) << DRAM_MINBIT);
+	base_phys = dram_addr(&m, p);
+	for (i = 0; i < samples; ++i) {
+		sample[i] = base + (mem_random(seed, i + 1) % (m.len >> DRAM_MINBIT) 
+				    << DRAM_MINBIT);
+		times[i] = dram_pair(p, sample[i]);
+		diffs[i] = base_phys ^ dram_addr(&m, sample[i]);
+		m.varying |= diffs[i];
+	}
+	m.varying &= ~(((uint64)1 << DRAM_MINBIT) - 1);
+
+	/* ignore samples which were interrupted */
+	median = dram_median(times, samples);
+	lo = hi = median;
+	for (i = 0; i < samples; ++i) {
+		if (times[i] > 3. * median) {
+			times[i] = -1.;
+			continue;
+		}
+		if (times[i] < lo) lo = times[i];
+		if (times[i] > hi) hi = times[i];
+	}
+
+	/* split the times into row hits and row conflicts (2-means) */
+	for (j = 0; j < 20; ++j) {
+		threshold = (lo + hi) / 2.;
+		sum[0] = sum[1] = 0.;
+		count[0] = count[1] = 0;
+		for (i = 0; i < samples; ++i) {
+			if (times[i] < 0.) continue;
+			sum[times[i] > threshold] += times[i];
+			count[times[i] > threshold]++;
+		}
+		if (count[0] == 0 || count[1] == 0) break;
+		lo = sum[0] / count[0];
+		hi = sum[1] / count[1];
+	}
+	threshold = (lo + hi) / 2.;
+	for (i = nconflicts = 0; i < samples; ++i) {
+		if (times[i] > threshold) diffs[nconflicts++] = diffs[i];
+	}
+
+	fprintf(stderr, "DRAM mapping: %s addresses, bits %d-%d, %d samples, %d conflicts\n",
+		m.pagemap >= 0 ? "physical" : "huge page", DRAM_MINBIT, maxbit - 1,
+		samples, nconflicts);
+	fprintf(stderr, "row hit or other bank: %.2f nanoseconds, row conflict: %.2f nanoseconds\n", 
+		lo, hi);
+	/* there are at least four banks, so most samples must not conflict */
+	if (hi < 1.1 * lo || nconflicts < 16 || nconflicts > samples / 4) {
+		fprintf(stderr, "no clear row conflicts\n");
+		return (0);
+	}
+
+	/* the lightest masks which hold across all the conflicts */
+	for (i = 1; i <= DRAM_MAXWEIGHT; ++i) {
+		dram_search(&m, reduced, diffs, nconflicts, 0, DRAM_MINBIT, i);
+	}
+	fprintf(stderr, "bank functions:");
+	for (i = 0; i < m.nfuncs; ++i) {
+		dram_print_mask(m.funcs[i]);
+	}
+	fprintf(stderr, "\nbanks: %d\n", 1 << m.nfuncs);
+
+	/* row bits: flipping one changes the row but not the bank */
+	fprintf(stderr, "row bits:");
+	for (i = DRAM_MINBIT; i < maxbit; ++i) {
+		char*	q = dram_virt(&m, p, base_phys ^ ((uint64)1 << i));
+		if (q && dram_pair(p, q) > threshold)
+			fprintf(stderr, " %d", i);
+	}
+	fprintf(stderr, "\n");
+
+	munmap(addr, maplen);
+	return (0);
+#endif
+}
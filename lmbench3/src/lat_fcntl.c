@@ -1,5 +1,3 @@
-#include "bench.h"
-
 /*
  * lat_fcntl.c - file locking test
  *
@@ -11,10 +9,19 @@
  */
 char	*id = "$Id: lat_pipe.c,v 1.8 1997/06/16 05:38:58 lm Exp $\n";
 
+#if defined(linux) || defined(__linux__)
+#define _GNU_SOURCE	/* F_OFD_SETLKW */
+#endif
+
 #include "bench.h"
+#include <sys/file.h>
+
+#define	LOCK_POSIX	0	/* fcntl(F_SETLKW), owned by the process */
+#define	LOCK_OFD	1	/* fcntl(F_OFD_SETLKW), owned by the open file */
+#define	LOCK_FLOCK	2	/* flock(), whole file, owned by the open file */
 
-struct	flock lock, unlock;
-struct	flock s1, s2;
+char	*lock_names[] = { "posix", "ofd", "flock", NULL };
+char	*lock_labels[] = { "Fcntl", "OFD", "Flock" };
 
 /*
  * Create two files, use them as a ping pong test.
@@ -27,23 +34,57 @@ struct	flock s1, s2;
  * Initial state:
  *	lock is locked
  *	lock2 is locked
+ *
+ * OFD and flock locks belong to the open file, not the process, so
+ * process B gets descriptors of its own (cfd1 and cfd2).
  */
 
-#define	waiton(fd)	fcntl(fd, F_SETLKW, &lock)
-#define	release(fd)	fcntl(fd, F_SETLK, &unlock)
+#define	waiton(fd)	lockop(state, fd, F_WRLCK, 0)
+#define	release(fd)	lockop(state, fd, F_UNLCK, 0)
 
 struct _state {
 	char filename1[2048];
 	char filename2[2048];
+	char* shared;		/* file locked by every process with -r */
+	int	type;
+	int	disjoint;
 	int	pid;
 	int	fd1;
 	int	fd2;
+	int	cfd1;
+	int	cfd2;
 };
 
 void initialize(iter_t iterations, void* cookie);
 void benchmark(iter_t iterations, void* cookie);
 void cleanup(iter_t iterations, void* cookie);
 
+/*
+ * Take (F_WRLCK) or drop (F_UNLCK) the lock on the byte at start
+ */
+int
+lockop(struct _state* state, int fd, int type, off_t start)
+{
+	struct	flock fl;
+
+	if (state->type == LOCK_FLOCK) {
+		return flock(fd, type == F_UNLCK ? LOCK_UN : LOCK_EX);
+	}
+
+	fl.l_type = type;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = start;
+	fl.l_len = 1;
+	fl.l_pid = 0;
+#ifdef F_OFD_SETLKW
+	if (state->type == LOCK_OFD) {
+		return fcntl(fd, type == F_UNLCK ? F_OFD_SETLK : F_OFD_SETLKW,
+			     &fl);
+	}
+#endif
+	return fcntl(fd, type == F_UNLCK ? F_SETLK : F_SETLKW, &fl);
+}
+
 void
 procA(struct _state *state)
 {
@@ -72,22 +113,22 @@ procA(struct _state *state)
 void
 procB(struct _state *state)
 {
-	if (release(state->fd1) == -1) {
+	if (release(state->cfd1) == -1) {
 		perror("unlock of fd1 failed\n");
 		cleanup(0, state);
 		exit(1);
 	}
-	if (waiton(state->fd2) == -1) {
+	if (waiton(state->cfd2) == -1) {
 		perror("lock of fd2 failed\n");
 		cleanup(0, state);
 		exit(1);
 	}
-	if (release(state->fd2) == -1) {
+	if (release(state->cfd2) == -1) {
 		perror("unlock of fd2 failed\n");
 		cleanup(0, state);
 		exit(1);
 	}
-	if (waiton(state->fd1) == -1) {
+	if (waiton(state->cfd1) == -1) {
 		perror("lock of fd1 failed\n");
 		cleanup(0, state);
 		exit(1);
@@ -107,6 +148,8 @@ initialize(iter_t iterations, void* cookie)
 	state->pid = 0;
 	state->fd1 = -1;
 	state->fd2 = -1;
+	state->cfd1 = -1;
+	state->cfd2 = -1;
 
 	unlink(state->filename1);
 	unlink(state->filename2);
@@ -118,16 +161,15 @@ initialize(iter_t iterations, void* cookie)
 		perror("create");
 		exit(1);
 	}
+	if ((state->cfd1 = open(state->filename1, O_RDWR)) == -1
+	    || (state->cfd2 = open(state->filename2, O_RDWR)) == -1) {
+		perror("open");
+		exit(1);
+	}
 	unlink(state->filename1);
 	unlink(state->filename2);
 	write(state->fd1, buf, sizeof(buf));
 	write(state->fd2, buf, sizeof(buf));
-	lock.l_type = F_WRLCK;
-	lock.l_whence = 0;
-	lock.l_start = 0;
-	lock.l_len = 1;
-	unlock = lock;
-	unlock.l_type = F_UNLCK;
 	if (waiton(state->fd1) == -1) {
 		perror("lock1");
 		exit(1);
@@ -170,8 +212,12 @@ cleanup(iter_t iterations, void* cookie)
 
 	if (state->fd1 >= 0) close(state->fd1);
 	if (state->fd2 >= 0) close(state->fd2);
+	if (state->cfd1 >= 0) close(state->cfd1);
+	if (state->cfd2 >= 0) close(state->cfd2);
 	state->fd1 = -1;
 	state->fd2 = -1;
+	state->cfd1 = -1;
+	state->cfd2 = -1;
 
 	if (state->pid) {
 		kill(state->pid, SIGKILL);
@@ -180,6 +226,49 @@ cleanup(iter_t iterations, void* cookie)
 	state->pid = 0;
 }
 
+/*
+ * With -r every process locks and unlocks one byte of the shared file
+ * as fast as it can: all the same byte, or each its own.  flock() can
+ * only lock the whole file, so disjoint flock locks use a file per
+ * process.
+ */
+void
+init_rate(iter_t iterations, void* cookie)
+{
+	struct _state* state = (struct _state*)cookie;
+
+	if (iterations) return;
+
+	state->pid = 0;
+	state->fd2 = state->cfd1 = state->cfd2 = -1;
+	if (state->type == LOCK_FLOCK && state->disjoint) {
+		sprintf(state->filename1, "/tmp/lmbench-fcntl%d", getpid());
+		state->fd1 = open(state->filename1, O_CREAT|O_RDWR, 0666);
+		unlink(state->filename1);
+	} else {
+		state->fd1 = open(state->shared, O_RDWR);
+	}
+	if (state->fd1 == -1) {
+		perror("open");
+		exit(1);
+	}
+}
+
+void
+benchmark_rate(iter_t iterations, void* cookie)
+{
+	struct _state* state = (struct _state*)cookie;
+	off_t	start = state->disjoint ? benchmp_childid() : 0;
+
+	while (iterations-- > 0) {
+		if (lockop(state, state->fd1, F_WRLCK, start) == -1
+		    || lockop(state, state->fd1, F_UNLCK, start) == -1) {
+			perror("lock");
+			exit(1);
+		}
+	}
+}
+
 int
 main(int ac, char **av)
 {
@@ -187,14 +276,36 @@ main(int ac, char **av)
 	int	parallel = 1;
 	int	warmup = 0;
 	int	repetitions = -1;
+	int	rate = 0;
+	char	buf[256];
+	char	shared[2048];
 	struct _state state;
-	char *usage = "[-P <parallelism>] [-W <warmup>] [-N <repetitions>]\n";
+	char *usage = "[-t posix|ofd|flock] [-r same|disjoint] [-P <parallelism>] [-W <warmup>] [-N <repetitions>]\n";
+
+	state.type = LOCK_POSIX;
+	state.disjoint = 0;
 
 	/*
 	 * If they specified a parallelism level, get it.
 	 */
-	while (( c = getopt(ac, av, "P:W:N:")) != EOF) {
+	while (( c = getopt(ac, av, "t:r:P:W:N:")) != EOF) {
 		switch(c) {
+		case 't':
+			for (state.type = 0; lock_names[state.type]; ++state.type) {
+				if (!strcmp(optarg, lock_names[state.type]))
+					break;
+			}
+			if (!lock_names[state.type])
+				lmbench_usage(ac, av, usage);
+			break;
+		case 'r':
+			rate = 1;
+			if (!strcmp(optarg, "disjoint")) {
+				state.disjoint = 1;
+			} else if (strcmp(optarg, "same")) {
+				lmbench_usage(ac, av, usage);
+			}
+			break;
 		case 'P':
 			parallel = atoi(optarg);
 			if (parallel <= 0) lmbench_usage(ac, av, usage);
@@ -210,12 +321,46 @@ main(int ac, char **av)
 			break;
 		}
 	}
+	if (optind < ac) {
+		lmbench_usage(ac, av, usage);
+	}
+#ifndef F_OFD_SETLKW
+	if (state.type == LOCK_OFD) {
+		fprintf(stderr, "lat_fcntl: no OFD locks on this system\n");
+		exit(1);
+	}
+#endif
 
 	state.pid = 0;
 
+	if (rate) {
+		int	fd;
+
+		sprintf(shared, "/tmp/lmbench-fcntl%d", getpid());
+		if ((fd = open(shared, O_CREAT|O_RDWR, 0666)) == -1) {
+			perror(shared);
+			exit(1);
+		}
+		close(fd);
+		state.shared = shared;
+		benchmp(init_rate, benchmark_rate, cleanup, 0, parallel, 
+			warmup, repetitions, &state);
+		unlink(shared);
+		if (gettime() == 0) return (0);
+		sprintf(buf, "%s lock/unlock, %d process%s, %s range",
+			lock_labels[state.type], parallel,
+			parallel > 1 ? "es" : "",
+			state.disjoint ? "disjoint" : "same");
+		fprintf(stderr, "%s: %.4f microseconds, %.0f locks/sec\n",
+			buf, (double)gettime() / (double)get_n(),
+			(double)parallel * get_n() * 1000000. / gettime());
+		return (0);
+	}
+
 	benchmp(initialize, benchmark, cleanup, 0, parallel, 
 		warmup, repetitions, &state);
-	micro("Fcntl lock latency", 2 * get_n());
+	sprintf(buf, "%s lock latency", lock_labels[state.type]);
+	micro(buf, 2 * get_n());
 
 	return (0);
 }
@@ -1,7 +1,8 @@
 /*
  * lat_fifo.c - named pipe transaction test
  *
- * usage: lat_fifo [-P <parallelism>] [-W <warmup>] [-N <repetitions>]
+ * usage: lat_fifo [-m <message size>] [-s <pipe size>] \
+ *		[-P <parallelism>] [-W <warmup>] [-N <repetitions>]
  *
  * Copyright (c) 1994 Larry McVoy.  Distributed under the FSF GPL with
  * additional restriction that results may published only if
@@ -18,7 +19,7 @@ char	*id = "$Id$\n";
 void initialize(iter_t iterations, void *cookie);
 void cleanup(iter_t iterations, void *cookie);
 void doit(iter_t iterations, void *cookie);
-void writer(int wr, int rd);
+void writer(int wr, int rd, char* buf, int msize);
 
 typedef struct _state {
 	char	filename1[256];
@@ -26,6 +27,9 @@ typedef struct _state {
 	int	pid;
 	int	wr;
 	int	rd;
+	int	msize;
+	int	size;	/* requested fifo capacity, 0 for the default */
+	char*	buf;
 } state_t;
 
 int 
@@ -36,10 +40,22 @@ main(int ac, char **av)
 	int warmup = 0;
 	int repetitions = -1;
 	int c;
-	char* usage = "[-P <parallelism>] [-W <warmup>] [-N <repetitions>]\n";
+	int p[2], capacity;
+	char	buf[256];
+	char* usage = "[-m <message size>] [-s <pipe size>] [-P <parallelism>] [-W <warmup>] [-N <repetitions>]\n";
 
-	while (( c = getopt(ac, av, "P:W:N:")) != EOF) {
+	state.msize = 1;
+	state.size = 0;
+	while (( c = getopt(ac, av, "m:s:P:W:N:")) != EOF) {
 		switch(c) {
+		case 'm':
+			state.msize = bytes(optarg);
+			if (state.msize <= 0) lmbench_usage(ac, av, usage);
+			break;
+		case 's':
+			state.size = bytes(optarg);
+			if (state.size <= 0) lmbench_usage(ac, av, usage);
+			break;
 		case 'P':
 			parallel = atoi(optarg);
 			if (parallel <= 0) lmbench_usage(ac, av, usage);
@@ -63,14 +79,28 @@ main(int ac, char **av)
 
 	benchmp(initialize, doit, cleanup, SHORT, parallel, 
 		warmup, repetitions, &state);
-	micro("Fifo latency", get_n());
+	if (state.msize == 1 && !state.size) {
+		micro("Fifo latency", get_n());
+		return (0);
+	}
+	sprintf(buf, "Fifo latency, %d bytes", state.msize);
+	if (state.size) {
+		/* fifos get the same capacity as a pipe asking for it */
+		if ((capacity = make_pipe(p, state.size, 0)) == -1) {
+			perror("lat_fifo: pipe");
+			exit(1);
+		}
+		close(p[0]);
+		close(p[1]);
+		sprintf(buf + strlen(buf), ", capacity %d", capacity);
+	}
+	micro(buf, get_n());
 	return (0);
 }
 
 void 
 initialize(iter_t iterations, void *cookie)
 {
-	char	c;
 	state_t * state = (state_t *)cookie;
 
 	if (iterations) return;
@@ -85,13 +115,19 @@ initialize(iter_t iterations, void *cookie)
 		perror("mknod");
 		exit(1);
 	}
+	state->buf = (char*)malloc(state->msize);
+	if (!state->buf) {
+		perror("malloc");
+		exit(1);
+	}
+	bzero(state->buf, state->msize);
 	handle_scheduler(benchmp_childid(), 0, 1);
 	switch (state->pid = fork()) {
 	    case 0:
 		handle_scheduler(benchmp_childid(), 1, 1);
 		state->rd = open(state->filename1, O_RDONLY);
 		state->wr = open(state->filename2, O_WRONLY);
-		writer(state->wr, state->rd);
+		writer(state->wr, state->rd, state->buf, state->msize);
 		return;
 
 	    case -1:
@@ -103,11 +139,16 @@ initialize(iter_t iterations, void *cookie)
 		state->rd = open(state->filename2, O_RDONLY);
 		break;
 	}
+	if (state->size && (pipe_size(state->wr, state->size) == -1
+			    || pipe_size(state->rd, state->size) == -1)) {
+		perror("F_SETPIPE_SZ");
+		exit(1);
+	}
 
 	/*
 	 * One time around to make sure both processes are started.
 	 */
-	if (write(state->wr, &c, 1) != 1 || read(state->rd, &c, 1) != 1) {
+	if (xfer(state->wr, state->rd, state->buf, state->msize) == -1) {
 		perror("(i) read/write on pipe");
 		exit(1);
 	}
@@ -120,16 +161,21 @@ cleanup(iter_t iterations, void * cookie)
 
 	if (iterations) return;
 
-	unlink(state->filename1);
-	unlink(state->filename2);
-	close(state->wr);
-	close(state->rd);
-
+	/*
+	 * Stop the writer first, or it sees EOF and complains.  It has
+	 * inherited benchmp's SIGTERM handler, so SIGTERM would not do.
+	 */
 	if (state->pid > 0) {
-		kill(state->pid, 15);
+		kill(state->pid, SIGKILL);
 		waitpid(state->pid, NULL, 0);
 		state->pid = 0;
 	}
+
+	unlink(state->filename1);
+	unlink(state->filename2);
+	close(state->wr);
+	close(state->rd);
+	free(state->buf);
 }
 
 void 
@@ -141,6 +187,15 @@ doit(register iter_t iterations, void *cookie)
 	register int	r = state->rd;
 	register char	*cptr = &c;
 
+	if (state->msize > 1) {
+		while (iterations-- > 0) {
+			if (xfer(w, r, state->buf, state->msize) == -1) {
+				perror("(r) read/write on pipe");
+				exit(1);
+			}
+		}
+		return;
+	}
 	while (iterations-- > 0) {
 		if (write(w, cptr, 1) != 1 ||
 		    read(r, cptr, 1) != 1) {
@@ -151,11 +206,26 @@ doit(register iter_t iterations, void *cookie)
 }
 
 void 
-writer(register int w, register int r)
+writer(register int w, register int r, char* buf, int msize)
 {
 	char		c;
 	register char	*cptr = &c;
-
+	int		n, done;
+
+	if (msize > 1) {
+		for ( ;; ) {
+			for (done = 0; done < msize; done += n) {
+				if ((n = read(r, buf + done, msize - done)) <= 0) {
+					perror("(w) read/write on pipe");
+					exit(1);
+				}
+			}
+			if (write(w, buf, msize) != msize) {
+				perror("(w) read/write on pipe");
+				exit(1);
+			}
+		}
+	}
 	for ( ;; ) {
 		if (read(r, cptr, 1) != 1 ||
 			write(w, cptr, 1) != 1) {
@@ -2,6 +2,13 @@
  * lat_mem_rd.c - measure memory load latency
  *
  * usage: lat_mem_rd [-P <parallelism>] [-W <warmup>] [-N <repetitions>] [-t] size-in-MB [stride ...]
+ *	lat_mem_rd [-P <parallelism>] [-W <warmup>] [-N <repetitions>] -p pattern[:n][,...] size-in-MB [stride ...]
+ *	lat_mem_rd [-P <parallelism>] [-W <warmup>] [-N <repetitions>] -d size-in-MB [stride ...]
+ *
+ * -p walks the chain in other patterns than a forward stride, to see
+ * which ones the hardware prefetchers follow.  -d measures random
+ * independent loads, like the probes of a hash join, with software
+ * prefetches issued a varying number of loads ahead.
  *
  * Copyright (c) 1994 Larry McVoy.  
  * Copyright (c) 2003, 2004 Carl Staelin.
@@ -17,8 +24,42 @@ char	*id = "$Id: s.lat_mem_rd.c 1.13 98/06/30 16:13:49-07:00 lm@lm.bitmover.com
 #include "bench.h"
 #define STRIDE  (512/sizeof(char *))
 #define	LOWER	512
-void	loads(size_t range, size_t stride, 
+#define	MAX_DISTANCE	64	/* furthest software prefetch, in loads */
+#define	MAX_PATTERNS	16
+
+#if defined(__GNUC__)
+#define	PREFETCH(a)	__builtin_prefetch((a), 0, 3)
+#else
+#define	PREFETCH(a)
+#endif
+
+struct pattern {
+	char*	name;
+	int	pattern;	/* PATTERN_*, or 0 for fpInit */
+	size_t	ways;
+};
+
+struct pattern patterns[] = {
+	{ "forward",	0,			0 },
+	{ "backward",	PATTERN_BACKWARD,	0 },
+	{ "tile",	PATTERN_TILE,		8 },
+	{ "streams",	PATTERN_STREAMS,	4 },
+	{ "pages",	PATTERN_PAGES,		0 },
+	{ "inpage",	PATTERN_INPAGE,		0 },
+	{ NULL,		0,			0 }
+};
+
+struct prefetch_state {
+	struct mem_state mem;
+	size_t	n;		/* loads per pass */
+	size_t	distance;	/* how far ahead to prefetch, or 0 */
+};
+
+void	loads(size_t range, size_t stride, struct pattern* pattern,
 	      int parallel, int warmup, int repetitions);
+void	prefetches(size_t len, size_t stride,
+		   int parallel, int warmup, int repetitions);
+int	parse_patterns(char* list, struct pattern* selected);
 size_t	step(size_t k);
 void	initialize(iter_t iterations, void* cookie);
 
@@ -32,16 +73,26 @@ main(int ac, char **av)
 	int	parallel = 1;
 	int	warmup = 0;
 	int	repetitions = -1;
+	int	npatterns = 0;
+	int	prefetch = 0;
         size_t	len;
 	size_t	range;
 	size_t	stride;
-	char   *usage = "[-P <parallelism>] [-W <warmup>] [-N <repetitions>] [-t] len [stride...]\n";
+	struct pattern selected[MAX_PATTERNS];
+	char   *usage = "[-P <parallelism>] [-W <warmup>] [-N <repetitions>] [-t | -p pattern[:n][,...] | -d] len [stride...]\n";
 
-	while (( c = getopt(ac, av, "tP:W:N:")) != EOF) {
+	while (( c = getopt(ac, av, "tp:dP:W:N:")) != EOF) {
 		switch(c) {
 		case 't':
 			fpInit = thrash_initialize;
 			break;
+		case 'p':
+			npatterns = parse_patterns(optarg, selected);
+			if (npatterns <= 0) lmbench_usage(ac, av, usage);
+			break;
+		case 'd':
+			prefetch = 1;
+			break;
 		case 'P':
 			parallel = atoi(optarg);
 			if (parallel <= 0) lmbench_usage(ac, av, usage);
@@ -64,10 +115,35 @@ main(int ac, char **av)
         len = atoi(av[optind]);
 	len *= 1024 * 1024;
 
+	if (prefetch) {
+		for (i = optind + 1; i < ac || i == optind + 1; ++i) {
+			stride = i < ac ? bytes(av[i]) : STRIDE;
+			fprintf(stderr, "\"prefetch stride=%d\n", (int)stride);
+			prefetches(len, stride, parallel, warmup, repetitions);
+			fprintf(stderr, "\n");
+		}
+		return (0);
+	}
+	for (c = 0; c < npatterns; ++c) {
+		for (i = optind + 1; i < ac || i == optind + 1; ++i) {
+			stride = i < ac ? bytes(av[i]) : STRIDE;
+			fprintf(stderr, "\"%s", selected[c].name);
+			if (selected[c].ways)
+				fprintf(stderr, ":%d", (int)selected[c].ways);
+			fprintf(stderr, " stride=%d\n", (int)stride);
+			for (range = LOWER; 0 < range && range <= len; range = step(range)) {
+				loads(range, stride, &selected[c], parallel, 
+				      warmup, repetitions);
+			}
+			fprintf(stderr, "\n");
+		}
+	}
+	if (npatterns) return (0);
+
 	if (optind == ac - 1) {
 		fprintf(stderr, "\"stride=%d\n", (int)STRIDE);
 		for (range = LOWER; 0 < range && range <= len; range = step(range)) {
-			loads(range, STRIDE, parallel, 
+			loads(range, STRIDE, NULL, parallel, 
 			      warmup, repetitions);
 		}
 	} else {
@@ -75,7 +151,7 @@ main(int ac, char **av)
 			stride = bytes(av[i]);
 			fprintf(stderr, "\"stride=%d\n", (int)stride);
 			for (range = LOWER; 0 < range && range <= len; range = step(range)) {
-				loads(range, stride, parallel, 
+				loads(range, stride, NULL, parallel, 
 				      warmup, repetitions);
 			}
 			fprintf(stderr, "\n");
@@ -84,6 +160,47 @@ main(int ac, char **av)
 	return(0);
 }
 
+/*
+ * Parse a comma separated list of pattern names, each optionally
+ * followed by :n for the tile width or the number of streams, or
+ * "all".  Returns the number of patterns, or -1 for an unknown one.
+ */
+int
+parse_patterns(char* list, struct pattern* selected)
+{
+	int	i, n = 0;
+	size_t	ways;
+	char	*name, *arg;
+
+	for (name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+		if (!strcmp(name, "all")) {
+			for (i = 0; patterns[i].name && n < MAX_PATTERNS; ++i)
+				selected[n++] = patterns[i];
+			continue;
+		}
+		if ((arg = strchr(name, ':'))) *arg++ = 0;
+		for (i = 0; patterns[i].name; ++i) {
+			if (!strcmp(name, patterns[i].name)) break;
+		}
+		if (!patterns[i].name || n == MAX_PATTERNS) return (-1);
+		selected[n] = patterns[i];
+		if (arg && selected[n].ways) {
+			ways = atoi(arg);
+			if (ways < 1) return (-1);
+			if (selected[n].pattern == PATTERN_TILE) {
+				/* tiles must divide the rows evenly */
+				for (selected[n].ways = 1;
+				     2 * selected[n].ways <= ways; )
+					selected[n].ways *= 2;
+			} else {
+				selected[n].ways = ways;
+			}
+		}
+		++n;
+	}
+	return (n);
+}
+
 #define	ONE	p = (char **)*p;
 #define	FIVE	ONE ONE ONE ONE ONE
 #define	TEN	FIVE FIVE
@@ -111,15 +228,21 @@ benchmark_loads(iter_t iterations, void *cookie)
 
 
 void
-loads(size_t range, size_t stride, 
+loads(size_t range, size_t stride, struct pattern* pattern,
 	int parallel, int warmup, int repetitions)
 {
 	double result;
 	size_t count;
 	struct mem_state state;
+	benchmp_f init = fpInit;
 
 	if (range < stride) return;
 
+	if (pattern && pattern->pattern) {
+		init = pattern_initialize;
+		state.pattern = pattern->pattern;
+		state.ways = pattern->ways;
+	}
 	state.width = 1;
 	state.len = range;
 	state.maxlen = range;
@@ -140,7 +263,7 @@ loads(size_t range, size_t stride,
 	/*
 	 * Now walk them and time it.
 	 */
-	benchmp(fpInit, benchmark_loads, mem_cleanup, 
+	benchmp(init, benchmark_loads, mem_cleanup, 
 		100000, parallel, warmup, repetitions, &state);
 #endif
 
@@ -152,6 +275,92 @@ loads(size_t range, size_t stride,
 	}
 }
 
+/*
+ * The loads go to the lines of the range in a random order, each
+ * independent of the others, so the only thing holding them back is
+ * how many misses the processor can have outstanding.  Prefetching
+ * far enough ahead hides the latency; too far and the lines are
+ * evicted again before they are used.
+ */
+void
+prefetch_initialize(iter_t iterations, void* cookie)
+{
+	struct prefetch_state* state = (struct prefetch_state*)cookie;
+	size_t	i, n = state->mem.len / state->mem.line;
+	size_t*	words;
+
+	base_initialize(iterations, cookie);
+	if (!state->mem.initialized) return;
+
+	words = permutation(n, state->mem.line);
+	if (words) words = (size_t*)realloc(words,
+			(n + MAX_DISTANCE) * sizeof(size_t));
+	if (!words) {
+		perror("prefetch_initialize: malloc");
+		exit(1);
+	}
+	/* so the prefetches can run off the end */
+	for (i = 0; i < MAX_DISTANCE; ++i)
+		words[n + i] = words[i % n];
+	for (i = 0; i < n; ++i)
+		*(size_t*)(state->mem.base + i * state->mem.line) = i;
+	state->mem.words = words;
+	state->n = n;
+}
+
+void
+benchmark_prefetch(iter_t iterations, void *cookie)
+{
+	struct prefetch_state* state = (struct prefetch_state*)cookie;
+	register char* base = state->mem.base;
+	register size_t* words = state->mem.words;
+	register size_t i, n = state->n;
+	register size_t d = state->distance;
+	register size_t sum = 0;
+
+	while (iterations-- > 0) {
+		if (d == 0) {
+			for (i = 0; i < n; ++i)
+				sum += *(size_t*)(base + words[i]);
+		} else {
+			for (i = 0; i < n; ++i) {
+				PREFETCH(base + words[i + d]);
+				sum += *(size_t*)(base + words[i]);
+			}
+		}
+	}
+	use_int((int)sum);
+}
+
+void
+prefetches(size_t len, size_t stride, 
+	   int parallel, int warmup, int repetitions)
+{
+	size_t	d;
+	struct prefetch_state state;
+
+	if (len < stride) return;
+
+	state.mem.width = 1;
+	state.mem.len = len;
+	state.mem.maxlen = len;
+	state.mem.line = stride;
+	state.mem.pagesize = getpagesize();
+	state.n = len / stride;
+
+	for (d = 0; d <= MAX_DISTANCE; d += (d < 4 ? 1 : d / 2)) {
+		state.distance = d;
+		benchmp(prefetch_initialize, benchmark_prefetch, mem_cleanup,
+			0, parallel, warmup, repetitions, &state);
+		save_minimum();
+		if (0 < gettime()) {
+			fprintf(stderr, "%d %.3f\n", (int)d,
+				(1000. * (double)gettime())
+				/ (double)(state.n * get_n()));
+		}
+	}
+}
+
 size_t
 step(size_t k)
 {
@@ -31,51 +31,13 @@ struct _state {
 	int	N;
 	int	M;
 	int	K;
-	double*	data;
+	void*	data;
 };
 
 #define FIVE(a) a a a a a
 #define TEN(a) a a a a a a a a a a
 #define HUNDRED(a) TEN(TEN(a))
 
-void
-float_initialize(iter_t iterations, void* cookie)
-{
-	struct _state *pState = (struct _state*)cookie;
-	register int i;
-	register float* x;
-
-	if (iterations) return;
-
-	x = (float*)malloc(pState->M * sizeof(float));
-	pState->data = (double*)x;
-	if (!pState->data) {
-		perror("malloc");
-		exit(1);
-	}
-	for (i = 0; i < pState->M; ++i) {
-		x[i] = 3.14159265;
-	}
-}
-
-void
-double_initialize(iter_t iterations, void* cookie)
-{
-	struct _state *pState = (struct _state*)cookie;
-	register int i;
-
-	if (iterations) return;
-
-	pState->data = (double*)malloc(pState->M * sizeof(double));
-	if (!pState->data) {
-		perror("malloc");
-		exit(1);
-	}
-	for (i = 0; i < pState->M; ++i) {
-		pState->data[i] = 3.14159265;
-	}
-}
-
 void
 cleanup(iter_t iterations, void* cookie)
 {
@@ -87,303 +49,284 @@ cleanup(iter_t iterations, void* cookie)
 		free(pState->data);
 }
 
-void
-do_integer_bitwise(iter_t iterations, void* cookie)
-{
-	struct _state *pState = (struct _state*)cookie;
-	register int r = pState->N;
-	register int s = (int)iterations;
-
-	while (iterations-- > 0) {
-		HUNDRED(r ^= iterations; s ^= r; r |= s;)
-	}
-	use_int(r);
-}
-
-void
-do_integer_add(iter_t iterations, void* cookie)
-{
-	struct _state *pState = (struct _state*)cookie;
-	register int i;
-	register int a = pState->N + 57;
-
-	while (iterations-- > 0) {
-		for (i = 1; i < 1001; ++i) {
+/*
+ * The integer kernels are generated for each width by INT_OPS.  The
+ * starting values of each kernel come from T##_BIT, T##_ADD and so on.
+ * int and int64 keep the values they have always had, since divide
+ * times depend on the size of the operands; the int128 ones are spread
+ * over the upper bits so that its divides really are of the full width.
+ */
 #ifndef __GNUC__
-			/* required because of an HP ANSI/C compiler bug */
-			HUNDRED(a=(a+i)^a;)
+/* required because of an HP ANSI/C compiler bug */
+#define	INT_ADD(a, i)	HUNDRED(a=(a+i)^a;)
+#define	INT_ADDS	100000	/* per iteration */
 #else
-			TEN(a=a+a+i;)
+#define	INT_ADD(a, i)	TEN(a=a+a+i;)
+#define	INT_ADDS	(10000 * 2)
 #endif
-		}
-	}
-	use_int(a);
-}
-
-void
-do_integer_mul(iter_t iterations, void* cookie)
-{
-	struct _state *pState = (struct _state*)cookie;
-	register int r = pState->N + 37431;
-	register int s = pState->N + 4;
-	register int t = r * s * s * s * s * s * s * s * s * s * s - r;
 
-	while (iterations-- > 0) {
-		TEN(r *= s;); r -= t;
-		TEN(r *= s;); r -= t;
-	}
-	use_int(r);
-}
-
-void
-do_integer_div(iter_t iterations, void* cookie)
-{
-	struct _state *pState = (struct _state*)cookie;
-	register int r = pState->N + 36;
-	register int s = (r + 1) << 20;
-
-	while (iterations-- > 0) {
-		HUNDRED(r = s / r;)
-	}
-	use_int(r);
-}
-
-void
-do_integer_mod(iter_t iterations, void* cookie)
-{
-	struct _state *pState = (struct _state*)cookie;
-	register int r = pState->N + iterations;
-	register int s = pState->N + 62;
-
-	while (iterations-- > 0) {
-		HUNDRED(r %= s; r |= s;)
-	}
-	use_int(r);
-}
-
-void
-do_int64_bitwise(iter_t iterations, void* cookie)
-{
-	struct _state *pState = (struct _state*)cookie;
-	register int64 r = (int64)pState->N | ((int64)pState->N << 32);
-	register int64 s = (int64)iterations | ((int64)iterations << 32);
-	register int64 i = ((int64)iterations << 34) - 1;
-
-	while (iterations-- > 0) {
-		HUNDRED(r ^= i; s ^= r; r |= s;)
-		i--;
-	}
-	use_int((int)r);
-}
-
-void
-do_int64_add(iter_t iterations, void* cookie)
-{
-	struct _state *pState = (struct _state*)cookie;
-	register int64 i;
-	register int64 a = (int64)pState->N + 37420;
-	register int64 b = (int64)pState->N + 21698324;
-
-	a += (int64)(0xFE + pState->N)<<30;
-	b += (int64)(0xFFFE + pState->N)<<29;
-
-	while (iterations-- > 0) {
-		for (i = 1; i < 1001; ++i) {
-#ifndef __GNUC__
-			/* required because of an HP ANSI/C compiler bug */
-			HUNDRED(a=(a+i)^a;)
-#else
-			TEN(a=a+a+i;)
+#define	integer_BIT(r, s, i)	r = pState->N; s = (int)iterations;	\
+				i = (int)iterations - 1;
+#define	integer_ADD(a)		a = pState->N + 57;
+#define	integer_MUL(r, s)	r = pState->N + 37431; s = pState->N + 4;
+#define	integer_DIV(r, s)	r = pState->N + 36; s = (r + 1) << 20;
+#define	integer_MOD(r, s)	r = pState->N + iterations; s = pState->N + 62;
+
+#define	int64_BIT(r, s, i)	r = (int64)pState->N | ((int64)pState->N << 32); \
+				s = (int64)iterations | ((int64)iterations << 32); \
+				i = ((int64)iterations << 34) - 1;
+#define	int64_ADD(a)		a = (int64)pState->N + 37420		\
+					+ ((int64)(0xFE + pState->N) << 30);
+#define	int64_MUL(r, s)		r = (int64)pState->N + 37420		\
+					+ ((int64)(pState->N + 6) << 32); \
+				s = (int64)pState->N + 4;
+#define	int64_DIV(r, s)		r = (int64)pState->N + 36; r += r << 33; \
+				s = (r + 17) << 13;
+#define	int64_MOD(r, s)		r = iterations + ((int64)iterations << 32); \
+				s = (int64)pState->N + ((int64)pState->N << 56);
+
+#ifdef __SIZEOF_INT128__
+#define	U128			unsigned __int128
+#define	int128_BIT(r, s, i)	r = (__int128)((U128)pState->N		\
+					| ((U128)pState->N << 96));	\
+				s = (__int128)((U128)iterations		\
+					| ((U128)iterations << 96));	\
+				i = (__int128)(((U128)iterations << 98) - 1);
+#define	int128_ADD(a)		a = (__int128)((U128)pState->N + 57	\
+					+ ((U128)(0xFE + pState->N) << 96));
+#define	int128_MUL(r, s)	r = (__int128)((U128)pState->N + 37431	\
+					+ ((U128)(pState->N + 6) << 96)); \
+				s = (__int128)pState->N + 4;
+#define	int128_DIV(r, s)	r = (__int128)pState->N + 36;		\
+				r = (__int128)((U128)r + ((U128)r << 97)); \
+				s = (__int128)((U128)(r + 17) << 13);
+#define	int128_MOD(r, s)	r = (__int128)((U128)iterations		\
+					+ ((U128)iterations << 96));	\
+				s = (__int128)((U128)pState->N + 62	\
+					+ ((U128)pState->N << 120));
 #endif
-		}
-	}
-	use_int((int)a+(int)b);
-}
-
-void
-do_int64_mul(iter_t iterations, void* cookie)
-{
-	struct _state *pState = (struct _state*)cookie;
-	register int64 r = (int64)pState->N + 37420;
-	register int64 s = (int64)pState->N + 4;
-	register int64 t;
 
-	r += (int64)(pState->N + 6)<<32;
-	t = r * s * s * s * s * s * s * s * s * s * s - r;
-
-	while (iterations-- > 0) {
-		TEN(r *= s;); r -= t;
-		TEN(r *= s;); r -= t;
-	}
-	use_int((int)r);
+#define	INT_OPS(T, type)						\
+void									\
+do_##T##_bitwise(iter_t iterations, void* cookie)			\
+{									\
+	struct _state *pState = (struct _state*)cookie;			\
+	register type r, s, i;						\
+									\
+	T##_BIT(r, s, i)						\
+	while (iterations-- > 0) {					\
+		HUNDRED(r ^= i; s ^= r; r |= s;)			\
+		i--;							\
+	}								\
+	use_int((int)r);						\
+}									\
+									\
+void									\
+do_##T##_add(iter_t iterations, void* cookie)				\
+{									\
+	struct _state *pState = (struct _state*)cookie;			\
+	register type i;						\
+	register type a;						\
+									\
+	T##_ADD(a)							\
+	while (iterations-- > 0) {					\
+		for (i = 1; i < 1001; ++i) {				\
+			INT_ADD(a, i)					\
+		}							\
+	}								\
+	use_int((int)a);						\
+}									\
+									\
+void									\
+do_##T##_mul(iter_t iterations, void* cookie)				\
+{									\
+	struct _state *pState = (struct _state*)cookie;			\
+	register type r, s, t;						\
+									\
+	T##_MUL(r, s)							\
+	t = r * s * s * s * s * s * s * s * s * s * s - r;		\
+									\
+	while (iterations-- > 0) {					\
+		TEN(r *= s;); r -= t;					\
+		TEN(r *= s;); r -= t;					\
+	}								\
+	use_int((int)r);						\
+}									\
+									\
+void									\
+do_##T##_div(iter_t iterations, void* cookie)				\
+{									\
+	struct _state *pState = (struct _state*)cookie;			\
+	register type r, s;						\
+									\
+	T##_DIV(r, s)							\
+	while (iterations-- > 0) {					\
+		HUNDRED(r = s / r;)					\
+	}								\
+	use_int((int)r);						\
+}									\
+									\
+void									\
+do_##T##_mod(iter_t iterations, void* cookie)			\
+{									\
+	struct _state *pState = (struct _state*)cookie;			\
+	register type r, s;						\
+									\
+	T##_MOD(r, s)							\
+	while (iterations-- > 0) {					\
+		HUNDRED(r %= s; r |= s;);				\
+	}								\
+	use_int((int)r);						\
 }
 
-void
-do_int64_div(iter_t iterations, void* cookie)
-{
-	struct _state *pState = (struct _state*)cookie;
-	register int64 r = (int64)pState->N + 36;
-	register int64 s;
-
-	r += r << 33;
-	s = (r + 17) << 13;
-
-	while (iterations-- > 0) {
-		HUNDRED(r = s / r;)
-	}
-	use_int((int)r);
-}
-
-void
-do_int64_mod(iter_t iterations, void* cookie)
-{
-	struct _state *pState = (struct _state*)cookie;
-	register int64 r = iterations + ((int64)iterations << 32);
-	register int64 s = (int64)pState->N + ((int64)pState->N << 56);
-
-	while (iterations-- > 0) {
-		HUNDRED(r %= s; r |= s;);
-	}
-	use_int((int)r);
-}
-
-void
-do_float_add(iter_t iterations, void* cookie)
-{
-	struct _state *pState = (struct _state*)cookie;
-	register float f = (float)pState->N;
-	register float g = (float)pState->K;
-
-	while (iterations-- > 0) {
-		TEN(f += (float)f;) f += (float)g;
-		TEN(f += (float)f;) f += (float)g;
-	}
-	use_int((int)f);
-	use_int((int)g);
-}
-
-void
-do_float_mul(iter_t iterations, void* cookie)
-{
-	struct _state *pState = (struct _state*)cookie;
-	register float f = 8.0f * (float)pState->N;
-	register float g = 0.125f * (float)pState->M / 1000.0;
-
-	while (iterations-- > 0) {
-		TEN(f *= f; f *= g;);
-		TEN(f *= f; f *= g;);
-	}
-	use_int((int)f);
-	use_int((int)g);
-}
-
-void
-do_float_div(iter_t iterations, void* cookie)
-{
-	struct _state *pState = (struct _state*)cookie;
-	register float f = 1.41421356f * (float)pState->N;
-	register float g = 3.14159265f * (float)pState->M / 1000.0;
-
-	while (iterations-- > 0) {
-		FIVE(TEN(f = g / f;) TEN(g = f / g;))
-	}
-	use_int((int)f);
-	use_int((int)g);
-}
-
-void
-do_double_add(iter_t iterations, void* cookie)
-{
-	struct _state *pState = (struct _state*)cookie;
-	register double f = (double)pState->N;
-	register double g = (double)pState->K;
-
-	while (iterations-- > 0) {
-		TEN(f += (double)f;) f += (double)g;
-		TEN(f += (double)f;) f += (double)g;
-	}
-	use_int((int)f);
-	use_int((int)g);
-}
-
-void
-do_double_mul(iter_t iterations, void* cookie)
-{
-	struct _state *pState = (struct _state*)cookie;
-	register double f = 8.0 * (double)pState->N;
-	register double g = 0.125 * (double)pState->M / 1000.0;
-
-	while (iterations-- > 0) {
-		TEN(f *= f; f *= g;)
-		TEN(f *= f; f *= g;)
-	}
-	use_int((int)f);
-	use_int((int)g);
-}
-
-void
-do_double_div(iter_t iterations, void* cookie)
-{
-	struct _state *pState = (struct _state*)cookie;
-	register double f = 1.41421356 * (double)pState->N;
-	register double g = 3.14159265 * (double)pState->M / 1000.0;
-
-	while (iterations-- > 0) {
-		FIVE(TEN(f = g / f;) TEN(g = f / g;))
-	}
-	use_int((int)f);
-	use_int((int)g);
+/*
+ * The floating point kernels, generated for each type by FLOAT_OPS
+ */
+#define	FLOAT_OPS(T, type)						\
+void									\
+do_##T##_add(iter_t iterations, void* cookie)				\
+{									\
+	struct _state *pState = (struct _state*)cookie;			\
+	register type f = (type)pState->N;				\
+	register type g = (type)pState->K;				\
+									\
+	while (iterations-- > 0) {					\
+		TEN(f += (type)f;) f += (type)g;			\
+		TEN(f += (type)f;) f += (type)g;			\
+	}								\
+	use_int((int)f);						\
+	use_int((int)g);						\
+}									\
+									\
+void									\
+do_##T##_mul(iter_t iterations, void* cookie)				\
+{									\
+	struct _state *pState = (struct _state*)cookie;			\
+	register type f = (type)8.0 * (type)pState->N;			\
+	register type g = (type)0.125 * (type)pState->M / (type)1000.0;	\
+									\
+	while (iterations-- > 0) {					\
+		TEN(f *= f; f *= g;);					\
+		TEN(f *= f; f *= g;);					\
+	}								\
+	use_int((int)f);						\
+	use_int((int)g);						\
+}									\
+									\
+void									\
+do_##T##_div(iter_t iterations, void* cookie)				\
+{									\
+	struct _state *pState = (struct _state*)cookie;			\
+	register type f = (type)1.41421356 * (type)pState->N;		\
+	register type g = (type)3.14159265 * (type)pState->M / (type)1000.0; \
+									\
+	while (iterations-- > 0) {					\
+		FIVE(TEN(f = g / f;) TEN(g = f / g;))			\
+	}								\
+	use_int((int)f);						\
+	use_int((int)g);						\
+}									\
+									\
+void									\
+T##_initialize(iter_t iterations, void* cookie)				\
+{									\
+	struct _state *pState = (struct _state*)cookie;			\
+	register int i;							\
+	register type* x;						\
+									\
+	if (iterations) return;						\
+									\
+	x = (type*)malloc(pState->M * sizeof(type));			\
+	pState->data = (void*)x;					\
+	if (!pState->data) {						\
+		perror("malloc");					\
+		exit(1);						\
+	}								\
+	for (i = 0; i < pState->M; ++i) {				\
+		x[i] = (type)3.14159265;				\
+	}								\
+}									\
+									\
+void									\
+do_##T##_bogomflops(iter_t iterations, void* cookie)			\
+{									\
+	struct _state *pState = (struct _state*)cookie;			\
+	register int i;							\
+	register int M = pState->M / 10;				\
+									\
+	while (iterations-- > 0) {					\
+		register type *x = (type*)pState->data;			\
+		for (i = 0; i < M; ++i) {				\
+			TEN_BOGO(type)					\
+			x += 10;					\
+		}							\
+	}								\
 }
 
-void
-do_float_bogomflops(iter_t iterations, void* cookie)
-{
-	struct _state *pState = (struct _state*)cookie;
-	register int i;
-	register int M = pState->M / 10;
-
-	while (iterations-- > 0) {
-		register float *x = (float*)pState->data;
-		for (i = 0; i < M; ++i) {
-			x[0] = (1.0f + x[0]) * (1.5f - x[0]) / x[0];
-			x[1] = (1.0f + x[1]) * (1.5f - x[1]) / x[1];
-			x[2] = (1.0f + x[2]) * (1.5f - x[2]) / x[2];
-			x[3] = (1.0f + x[3]) * (1.5f - x[3]) / x[3];
-			x[4] = (1.0f + x[4]) * (1.5f - x[4]) / x[4];
-			x[5] = (1.0f + x[5]) * (1.5f - x[5]) / x[5];
-			x[6] = (1.0f + x[6]) * (1.5f - x[6]) / x[6];
-			x[7] = (1.0f + x[7]) * (1.5f - x[7]) / x[7];
-			x[8] = (1.0f + x[8]) * (1.5f - x[8]) / x[8];
-			x[9] = (1.0f + x[9]) * (1.5f - x[9]) / x[9];
-			x += 10;
-		}
-	}
-}
+#define	BOGO(type, j)	x[j] = ((type)1.0 + x[j]) * ((type)1.5 - x[j]) / x[j];
+#define	TEN_BOGO(type)	BOGO(type, 0) BOGO(type, 1) BOGO(type, 2)	\
+			BOGO(type, 3) BOGO(type, 4) BOGO(type, 5)	\
+			BOGO(type, 6) BOGO(type, 7) BOGO(type, 8)	\
+			BOGO(type, 9)
 
-void
-do_double_bogomflops(iter_t iterations, void* cookie)
-{
-	struct _state *pState = (struct _state*)cookie;
-	register int i;
-	register int M = pState->M / 10;
+INT_OPS(integer, int)
+INT_OPS(int64, int64)
+#ifdef __SIZEOF_INT128__
+INT_OPS(int128, __int128)
+#endif
+FLOAT_OPS(float, float)
+FLOAT_OPS(double, double)
+FLOAT_OPS(ldouble, long double)
 
-	while (iterations-- > 0) {
-		register double *x = (double*)pState->data;
-		for (i = 0; i < M; ++i) {
-			x[0] = (1.0f + x[0]) * (1.5f - x[0]) / x[0];
-			x[1] = (1.0f + x[1]) * (1.5f - x[1]) / x[1];
-			x[2] = (1.0f + x[2]) * (1.5f - x[2]) / x[2];
-			x[3] = (1.0f + x[3]) * (1.5f - x[3]) / x[3];
-			x[4] = (1.0f + x[4]) * (1.5f - x[4]) / x[4];
-			x[5] = (1.0f + x[5]) * (1.5f - x[5]) / x[5];
-			x[6] = (1.0f + x[6]) * (1.5f - x[6]) / x[6];
-			x[7] = (1.0f + x[7]) * (1.5f - x[7]) / x[7];
-			x[8] = (1.0f + x[8]) * (1.5f - x[8]) / x[8];
-			x[9] = (1.0f + x[9]) * (1.5f - x[9]) / x[9];
-			x += 10;
-		}
-	}
-}
+/*
+ * The integer results for one width; bit and add are timed first
+ * so that their cost can be taken out of the others.
+ */
+#define	INT_RESULTS(T, name, addname)					\
+	benchmp(NULL, do_##T##_bitwise, NULL, 				\
+		0, 1, warmup, repetitions, &state);			\
+	nano(name " bit", get_n() * 100 * 3);				\
+	iop_time = gettime();						\
+	iop_N = get_n() * 100 * 3;					\
+									\
+	benchmp(NULL, do_##T##_add, NULL, 				\
+		0, 1, warmup, repetitions, &state);			\
+	if (INT_ADDS == 100000)						\
+		settime(gettime() - (get_n() * 100000 * iop_time) / iop_N); \
+	nano(addname " add", get_n() * INT_ADDS);			\
+									\
+	benchmp(NULL, do_##T##_mul, NULL, 				\
+		0, 1, warmup, repetitions, &state);			\
+	settime(gettime() - (get_n() * 2 * iop_time) / iop_N);		\
+	nano(name " mul", get_n() * 10 * 2);				\
+									\
+	benchmp(NULL, do_##T##_div, NULL, 				\
+		0, 1, warmup, repetitions, &state);			\
+	nano(name " div", get_n() * 100);				\
+									\
+	benchmp(NULL, do_##T##_mod, NULL, 				\
+		0, 1, warmup, repetitions, &state);			\
+	settime(gettime() - (get_n() * 100 * iop_time) / iop_N);	\
+	nano(name " mod", get_n() * 100);
+
+#define	FLOAT_RESULTS(T, name)						\
+	benchmp(NULL, do_##T##_add, NULL, 				\
+		0, 1, warmup, repetitions, &state);			\
+	nano(name " add", get_n() * (10 + 1) * 2);			\
+									\
+	benchmp(NULL, do_##T##_mul, NULL, 				\
+		0, 1, warmup, repetitions, &state);			\
+	nano(name " mul", get_n() * 10 * 2 * 2);			\
+									\
+	benchmp(NULL, do_##T##_div, NULL, 				\
+		0, 1, warmup, repetitions, &state);			\
+	nano(name " div", get_n() * 100);
+
+#define	BOGOMFLOPS(T, name)						\
+	benchmp(T##_initialize, do_##T##_bogomflops, cleanup, 		\
+		0, parallel, warmup, repetitions, &state);		\
+	nano(name " bogomflops", get_n() * state.M);			\
+	fflush(stdout); fflush(stderr);
 
 int
 main(int ac, char **av)
@@ -420,97 +363,17 @@ main(int ac, char **av)
 		}
 	}
 
-	benchmp(NULL, do_integer_bitwise, NULL, 
-		0, 1, warmup, repetitions, &state);
-	nano("integer bit", get_n() * 100 * 3);
-	iop_time = gettime();
-	iop_N = get_n() * 100 * 3;
-	
-	benchmp(NULL, do_integer_add, NULL, 
-		0, 1, warmup, repetitions, &state);
-#ifndef __GNUC__
-	settime(gettime() - (get_n() * 100000 * iop_time) / iop_N);
-	nano("integer add", get_n() * 100000);
-#else
-	nano("integer add", get_n() * 10000 * 2);
-#endif
-	
-	benchmp(NULL, do_integer_mul, NULL, 
-		0, 1, warmup, repetitions, &state);
-	settime(gettime() - (get_n() * 2 * iop_time) / iop_N);
-	nano("integer mul", get_n() * 10 * 2);
-	
-	benchmp(NULL, do_integer_div, NULL, 
-		0, 1, warmup, repetitions, &state);
-	nano("integer div", get_n() * 100);
-	
-	benchmp(NULL, do_integer_mod, NULL, 
-		0, 1, warmup, repetitions, &state);
-	settime(gettime() - (get_n() *  100 * iop_time) / iop_N);
-	nano("integer mod", get_n() * 100);
-	
-	benchmp(NULL, do_int64_bitwise, NULL, 
-		0, 1, warmup, repetitions, &state);
-	nano("int64 bit", get_n() * 100 * 3);
-	iop_time = gettime();
-	iop_N = get_n() * 100 * 3;
-
-	benchmp(NULL, do_int64_add, NULL, 
-		0, 1, warmup, repetitions, &state);
-#ifndef __GNUC__
-	settime(gettime() - (get_n() * 100000 * iop_time) / iop_N);
-	nano("uint64 add", get_n() * 100000);
-#else
-	nano("uint64 add", get_n() * 10000 * 2);
+	INT_RESULTS(integer, "integer", "integer")
+	INT_RESULTS(int64, "int64", "uint64")
+#ifdef __SIZEOF_INT128__
+	INT_RESULTS(int128, "int128", "int128")
 #endif
-	
-	benchmp(NULL, do_int64_mul, NULL, 
-		0, 1, warmup, repetitions, &state);
-	settime(gettime() - (get_n() * 2 * iop_time) / iop_N);
-	nano("int64 mul", get_n() * 10 * 2);
-	
-	benchmp(NULL, do_int64_div, NULL, 
-		0, 1, warmup, repetitions, &state);
-	nano("int64 div", get_n() * 100);
-	
-	benchmp(NULL, do_int64_mod, NULL, 
-		0, 1, warmup, repetitions, &state);
-	settime(gettime() - (get_n() * 100 * iop_time) / iop_N);
-	nano("int64 mod", get_n() * 100);
-	
-	benchmp(NULL, do_float_add, NULL, 
-		0, 1, warmup, repetitions, &state);
-	nano("float add", get_n() * (10 + 1) * 2);
-	
-	benchmp(NULL, do_float_mul, NULL, 
-		0, 1, warmup, repetitions, &state);
-	nano("float mul", get_n() * 10 * 2 * 2);
-	
-	benchmp(NULL, do_float_div, NULL, 
-		0, 1, warmup, repetitions, &state);
-	nano("float div", get_n() * 100);
-
-	benchmp(NULL, do_double_add, NULL, 
-		0, 1, warmup, repetitions, &state);
-	nano("double add", get_n() * (10 + 1) * 2);
-	
-	benchmp(NULL, do_double_mul, NULL, 
-		0, 1, warmup, repetitions, &state);
-	nano("double mul", get_n() * 10 * 2 * 2);
-	
-	benchmp(NULL, do_double_div, NULL, 
-		0, 1, warmup, repetitions, &state);
-	nano("double div", get_n() * 100);
-
-	benchmp(float_initialize, do_float_bogomflops, cleanup, 
-		0, parallel, warmup, repetitions, &state);
-	nano("float bogomflops", get_n() * state.M);
-	fflush(stdout); fflush(stderr);
-
-	benchmp(double_initialize, do_double_bogomflops, cleanup, 
-		0, parallel, warmup, repetitions, &state);
-	nano("double bogomflops", get_n() * state.M);
-	fflush(stdout); fflush(stderr);
+	FLOAT_RESULTS(float, "float")
+	FLOAT_RESULTS(double, "double")
+	FLOAT_RESULTS(ldouble, "long double")
+	BOGOMFLOPS(float, "float")
+	BOGOMFLOPS(double, "double")
+	BOGOMFLOPS(ldouble, "long double")
 
 	return(0);
 }
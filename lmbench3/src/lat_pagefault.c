@@ -1,7 +1,7 @@
 /*
  * lat_pagefault.c - time a page fault in
  *
- * Usage: lat_pagefault [-C] [-P <parallel>] [-W <warmup>] [-N <repetitions>] file 
+ * Usage: lat_pagefault [-C] [-c cold|warm] [-P <parallel>] [-W <warmup>] [-N <repetitions>] file 
  *
  * Copyright (c) 2000 Carl Staelin.
  * Copyright (c) 1994 Larry McVoy.  Distributed under the FSF GPL with
@@ -21,6 +21,7 @@ typedef struct _state {
 	int size;
 	int npages;
 	int clone;
+	int cold;
 	char* file;
 	char* where;
 	size_t* pages;
@@ -30,6 +31,7 @@ void	initialize(iter_t iterations, void *cookie);
 void	cleanup(iter_t iterations, void *cookie);
 void	benchmark(iter_t iterations, void * cookie);
 void	benchmark_mmap(iter_t iterations, void * cookie);
+void	evict(state_t *state);
 
 int
 main(int ac, char **av)
@@ -43,11 +45,12 @@ main(int ac, char **av)
 	struct stat   st;
 	struct _state state;
 	char buf[2048];
-	char* usage = "[-C] [-P <parallel>] [-W <warmup>] [-N <repetitions>] file\n";
+	char* usage = "[-C] [-c cold|warm] [-P <parallel>] [-W <warmup>] [-N <repetitions>] file\n";
 
 	state.clone = 0;
+	state.cold = 0;
 
-	while (( c = getopt(ac, av, "P:W:N:C")) != EOF) {
+	while (( c = getopt(ac, av, "P:W:N:Cc:")) != EOF) {
 		switch(c) {
 		case 'P':
 			parallel = atoi(optarg);
@@ -62,6 +65,11 @@ main(int ac, char **av)
 		case 'C':
 			state.clone = 1;
 			break;
+		case 'c':
+			if (!strcmp(optarg, "cold")) state.cold = 1;
+			else if (!strcmp(optarg, "warm")) state.cold = 0;
+			else lmbench_usage(ac, av, usage);
+			break;
 		default:
 			lmbench_usage(ac, av, usage);
 			break;
@@ -143,6 +151,7 @@ initialize(iter_t iterations, void* cookie)
 		exit(1);
 	}
 #endif
+	if (state->cold) evict(state);
 }
 
 void
@@ -177,6 +186,7 @@ benchmark(iter_t iterations, void* cookie)
 			exit(1);
 		}
 #endif
+		if (state->cold) evict(state);
 	}
 	use_int(sum);
 }
@@ -197,7 +207,25 @@ benchmark_mmap(iter_t iterations, void* cookie)
 			exit(1);
 		}
 #endif
+		if (state->cold) evict(state);
 	}
 	use_int(sum);
 }
 
+/*
+ * Evict the file from the buffer cache without charging the time
+ * to the benchmark.  The new mapping has not been touched yet, so
+ * it does not pin any pages.
+ */
+void
+evict(state_t *state)
+{
+	static int warned = 0;
+	uint64	t = now();
+
+	if (evict_file(state->fd) != 0 && !warned) {
+		fprintf(stderr, "lat_pagefault: could not evict %s from the buffer cache\n", state->file);
+		warned = 1;
+	}
+	adjust((int)(now() - t));
+}
@@ -1,7 +1,8 @@
 /*
  * lat_pipe.c - pipe transaction test
  *
- * usage: lat_pipe [-P <parallelism>] [-W <warmup>] [-N <repetitions>]
+ * usage: lat_pipe [-m <message size>] [-s <pipe size>] [-D] \
+ *		[-P <parallelism>] [-W <warmup>] [-N <repetitions>]
  *
  * Copyright (c) 1994 Larry McVoy.  Distributed under the FSF GPL with
  * additional restriction that results may published only if
@@ -11,17 +12,25 @@
  */
 char	*id = "$Id$\n";
 
+#if defined(linux) || defined(__linux__)
+#define _GNU_SOURCE	/* O_DIRECT */
+#endif
+
 #include "bench.h"
 
 void initialize(iter_t iterations, void *cookie);
 void cleanup(iter_t iterations, void *cookie);
 void doit(iter_t iterations, void *cookie);
-void writer(int w, int r);
+void writer(int w, int r, char* buf, int msize);
 
 typedef struct _state {
 	int	pid;
 	int	p1[2];
 	int	p2[2];
+	int	msize;
+	int	size;	/* requested pipe capacity, 0 for the default */
+	int	packet;	/* O_DIRECT packet mode */
+	char*	buf;
 } state_t;
 
 int 
@@ -32,10 +41,30 @@ main(int ac, char **av)
 	int warmup = 0;
 	int repetitions = -1;
 	int c;
-	char* usage = "[-P <parallelism>] [-W <warmup>] [-N <repetitions>]\n";
-
-	while (( c = getopt(ac, av, "P:W:N:")) != EOF) {
+	int p[2], capacity;
+	char	buf[256];
+	char* usage = "[-m <message size>] [-s <pipe size>] [-D] [-P <parallelism>] [-W <warmup>] [-N <repetitions>]\n";
+
+	state.msize = 1;
+	state.size = 0;
+	state.packet = 0;
+	while (( c = getopt(ac, av, "m:s:DP:W:N:")) != EOF) {
 		switch(c) {
+		case 'm':
+			state.msize = bytes(optarg);
+			if (state.msize <= 0) lmbench_usage(ac, av, usage);
+			break;
+		case 's':
+			state.size = bytes(optarg);
+			if (state.size <= 0) lmbench_usage(ac, av, usage);
+			break;
+		case 'D':
+#ifndef O_DIRECT
+			fprintf(stderr, "lat_pipe: no packet mode pipes\n");
+			exit(1);
+#endif
+			state.packet = 1;
+			break;
 		case 'P':
 			parallel = atoi(optarg);
 			if (parallel <= 0) lmbench_usage(ac, av, usage);
@@ -59,26 +88,44 @@ main(int ac, char **av)
 
 	benchmp(initialize, doit, cleanup, SHORT, parallel, 
 		warmup, repetitions, &state);
-	micro("Pipe latency", get_n());
+	if (state.msize == 1 && !state.size && !state.packet) {
+		micro("Pipe latency", get_n());
+		return (0);
+	}
+	sprintf(buf, "Pipe latency, %s%d bytes", 
+		state.packet ? "packet mode, " : "", state.msize);
+	if (state.size) {
+		/* the capacity the kernel gave, not the one asked for */
+		if ((capacity = make_pipe(p, state.size, state.packet)) == -1) {
+			perror("lat_pipe: pipe");
+			exit(1);
+		}
+		close(p[0]);
+		close(p[1]);
+		sprintf(buf + strlen(buf), ", capacity %d", capacity);
+	}
+	micro(buf, get_n());
 	return (0);
 }
 
 void 
 initialize(iter_t iterations, void* cookie)
 {
-	char	c;
 	state_t * state = (state_t *)cookie;
 
 	if (iterations) return;
 
-	if (pipe(state->p1) == -1) {
-		perror("pipe");
+	if (make_pipe(state->p1, state->size, state->packet) == -1
+	    || make_pipe(state->p2, state->size, state->packet) == -1) {
+		perror("lat_pipe: pipe");
 		exit(1);
 	}
-	if (pipe(state->p2) == -1) {
-		perror("pipe");
+	state->buf = (char*)malloc(state->msize);
+	if (!state->buf) {
+		perror("malloc");
 		exit(1);
 	}
+	bzero(state->buf, state->msize);
 	handle_scheduler(benchmp_childid(), 0, 1);
 	switch (state->pid = fork()) {
 	    case 0:
@@ -86,7 +133,7 @@ initialize(iter_t iterations, void* cookie)
 		signal(SIGTERM, exit);
 		close(state->p1[1]);
 		close(state->p2[0]);
-		writer(state->p2[1], state->p1[0]);
+		writer(state->p2[1], state->p1[0], state->buf, state->msize);
 		return;
 
 	    case -1:
@@ -102,7 +149,7 @@ initialize(iter_t iterations, void* cookie)
 	/*
 	 * One time around to make sure both processes are started.
 	 */
-	if (write(state->p1[1], &c, 1) != 1 || read(state->p2[0], &c, 1) != 1){
+	if (xfer(state->p1[1], state->p2[0], state->buf, state->msize) == -1) {
 		perror("(i) read/write on pipe");
 		exit(1);
 	}
@@ -120,6 +167,7 @@ cleanup(iter_t iterations, void* cookie)
 		waitpid(state->pid, NULL, 0);
 		state->pid = 0;
 	}
+	free(state->buf);
 }
 
 void 
@@ -131,6 +179,15 @@ doit(register iter_t iterations, void *cookie)
 	register int	r = state->p2[0];
 	register char	*cptr = &c;
 
+	if (state->msize > 1) {
+		while (iterations-- > 0) {
+			if (xfer(w, r, state->buf, state->msize) == -1) {
+				perror("(r) read/write on pipe");
+				exit(1);
+			}
+		}
+		return;
+	}
 	while (iterations-- > 0) {
 		if (write(w, cptr, 1) != 1 ||
 		    read(r, cptr, 1) != 1) {
@@ -141,11 +198,26 @@ doit(register iter_t iterations, void *cookie)
 }
 
 void 
-writer(register int w, register int r)
+writer(register int w, register int r, char* buf, int msize)
 {
 	char		c;
 	register char	*cptr = &c;
-
+	int		n, done;
+
+	if (msize > 1) {
+		for ( ;; ) {
+			for (done = 0; done < msize; done += n) {
+				if ((n = read(r, buf + done, msize - done)) <= 0) {
+					perror("(w) read/write on pipe");
+					exit(1);
+				}
+			}
+			if (write(w, buf, msize) != msize) {
+				perror("(w) read/write on pipe");
+				exit(1);
+			}
+		}
+	}
 	for ( ;; ) {
 		if (read(r, cptr, 1) != 1 ||
 			write(w, cptr, 1) != 1) {
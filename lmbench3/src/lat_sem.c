@@ -1,7 +1,12 @@
 /*
  * lat_sem.c - semaphore test
  *
- * usage: lat_sem [-P <parallelism>] [-W <warmup>] [-N <repetitions>]
+ * usage: lat_sem [-r] [-d <depth>] [-m <message size>]
+ *	[-t sysv|posix|named|futex|mqueue|all] [-P <parallelism>] [-W <warmup>] [-N <repetitions>]
+ *
+ * Two processes hand a token back and forth through a pair of
+ * semaphores, or through a pair of message queues.  With -r there are
+ * depth tokens in flight, and the result is the rate of handoffs.
  *
  * Copyright (c) 2000 Carl Staelin.
  * Copyright (c) 1994 Larry McVoy.  Distributed under the FSF GPL with
@@ -14,16 +19,144 @@ char	*id = "$Id$\n";
 
 #include "bench.h"
 #include <sys/sem.h>
+#include <semaphore.h>
+
+#if defined(linux) || defined(__linux__)
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#ifdef HAVE_MQUEUE
+#include <mqueue.h>
+#endif
+
+
+typedef struct _state state_t;
+
+/*
+ * Each primitive provides two semaphores, 0 and 1.  waitpost, if
+ * present, waits on one and posts the other in a single call.
+ */
+typedef struct _sem_ops {
+	char*	name;
+	char*	label;
+	int	(*create)(state_t* state);
+	void	(*destroy)(state_t* state);
+	void	(*wait)(state_t* state, int which);
+	void	(*post)(state_t* state, int which);
+	void	(*waitpost)(state_t* state, int w, int p);
+} sem_ops_t;
+
+struct _state {
+	int	pid;
+	int	semid;
+	sem_t*	sem[2];
+	char	name[2][64];
+	int*	futex;
+#ifdef HAVE_MQUEUE
+	mqd_t	mq[2];
+#endif
+	char*	buf;
+	int	msize;
+	int	depth;
+	sem_ops_t* ops;
+};
 
 void initialize(iter_t iterations, void *cookie);
 void cleanup(iter_t iterations, void *cookie);
 void doit(iter_t iterations, void *cookie);
-void writer(int sid);
+void writer(state_t* state);
 
-typedef struct _state {
-	int	pid;
-	int	semid;
-} state_t;
+int	sysv_create(state_t* state);
+void	sysv_destroy(state_t* state);
+void	sysv_wait(state_t* state, int which);
+void	sysv_post(state_t* state, int which);
+void	sysv_waitpost(state_t* state, int w, int p);
+#ifdef _POSIX_SEMAPHORES
+int	posix_create(state_t* state);
+void	posix_destroy(state_t* state);
+int	named_create(state_t* state);
+void	named_destroy(state_t* state);
+void	posix_wait(state_t* state, int which);
+void	posix_post(state_t* state, int which);
+#endif
+#ifdef SYS_futex
+int	futex_create(state_t* state);
+void	futex_destroy(state_t* state);
+void	futex_wait(state_t* state, int which);
+void	futex_post(state_t* state, int which);
+#endif
+#ifdef HAVE_MQUEUE
+int	mqueue_create(state_t* state);
+void	mqueue_destroy(state_t* state);
+void	mqueue_wait(state_t* state, int which);
+void	mqueue_post(state_t* state, int which);
+#endif
+
+sem_ops_t ops[] = {
+	{ "sysv", "Semaphore",
+	  sysv_create, sysv_destroy, sysv_wait, sysv_post, sysv_waitpost },
+#ifdef _POSIX_SEMAPHORES
+	{ "posix", "POSIX semaphore",
+	  posix_create, posix_destroy, posix_wait, posix_post, NULL },
+	{ "named", "POSIX named semaphore",
+	  named_create, named_destroy, posix_wait, posix_post, NULL },
+#endif
+#ifdef SYS_futex
+	{ "futex", "Futex",
+	  futex_create, futex_destroy, futex_wait, futex_post, NULL },
+#endif
+#ifdef HAVE_MQUEUE
+	{ "mqueue", "POSIX mqueue",
+	  mqueue_create, mqueue_destroy, mqueue_wait, mqueue_post, NULL },
+#endif
+	{ NULL }
+};
+
+/* message sizes used for mqueue unless -m is given */
+int	msizes[] = { 8, 128, 1024, 8192, 0 };
+
+/*
+ * Is the test named by the len bytes at p, or "all", this primitive?
+ */
+int
+selected(char* p, int len, char* name)
+{
+	if (len == 3 && !strncmp(p, "all", 3)) return 1;
+	return (strlen(name) == len && !strncmp(p, name, len));
+}
+
+void
+bench(state_t* state, int rate, int parallel, int warmup, int repetitions)
+{
+	char	buf[256];
+
+	/* make sure the primitive works here before forking the benchmark */
+	if (state->ops->create(state) < 0) {
+		fprintf(stderr, "lat_sem: %s not supported\n", state->ops->name);
+		return;
+	}
+	state->ops->destroy(state);
+
+	benchmp(initialize, doit, cleanup, SHORT, parallel, 
+		warmup, repetitions, state);
+
+	strcpy(buf, state->ops->label);
+	strcat(buf, rate ? " rate" : " latency");
+#ifdef HAVE_MQUEUE
+	if (state->ops->create == mqueue_create)
+		sprintf(buf + strlen(buf), ", %d byte messages", state->msize);
+#endif
+	if (rate) {
+		sprintf(buf + strlen(buf), ", depth %d", state->depth);
+		if (gettime() > 0) {
+			fprintf(stderr, "%s: %.0f handoffs/sec\n", buf,
+				(double)get_n() * 1000000. / (double)gettime());
+		}
+	} else {
+		micro(buf, get_n() * 2);
+	}
+}
 
 int 
 main(int ac, char **av)
@@ -32,11 +165,30 @@ main(int ac, char **av)
 	int parallel = 1;
 	int warmup = 0;
 	int repetitions = -1;
-	int c;
-	char* usage = "[-P <parallelism>] [-W <warmup>] [-N <repetitions>]\n";
+	int rate = 0;
+	int msize = 0;
+	int c, i, len;
+	char* tests = "sysv";
+	char* p;
+	char* usage = "[-r] [-d <depth>] [-m <message size>] [-t sysv|posix|named|futex|mqueue|all[,...]] [-P <parallelism>] [-W <warmup>] [-N <repetitions>]\n";
 
-	while (( c = getopt(ac, av, "P:W:N:")) != EOF) {
+	state.depth = 0;
+	while (( c = getopt(ac, av, "rd:m:t:P:W:N:")) != EOF) {
 		switch(c) {
+		case 'r':
+			rate = 1;
+			break;
+		case 'd':
+			state.depth = atoi(optarg);
+			if (state.depth <= 0) lmbench_usage(ac, av, usage);
+			break;
+		case 'm':
+			msize = bytes(optarg);
+			if (msize <= 0) lmbench_usage(ac, av, usage);
+			break;
+		case 't':
+			tests = optarg;
+			break;
 		case 'P':
 			parallel = atoi(optarg);
 			if (parallel <= 0) lmbench_usage(ac, av, usage);
@@ -56,32 +208,64 @@ main(int ac, char **av)
 		lmbench_usage(ac, av, usage);
 	}
 
-	state.pid = 0;
+	/* the default mqueue limit is 10 messages */
+	if (state.depth == 0) state.depth = rate ? 8 : 1;
+	if (!rate && state.depth != 1) lmbench_usage(ac, av, usage);
 
-	benchmp(initialize, doit, cleanup, SHORT, parallel, 
-		warmup, repetitions, &state);
-	micro("Semaphore latency", get_n() * 2);
+	/* check the test names before running anything */
+	for (p = tests; *p; p += len + (p[len] == ',')) {
+		len = strcspn(p, ",");
+		for (i = 0; ops[i].name; ++i) {
+			if (selected(p, len, ops[i].name)) break;
+		}
+		if (!ops[i].name) lmbench_usage(ac, av, usage);
+	}
+
+	for (i = 0; ops[i].name; ++i) {
+		for (p = tests; *p; p += len + (p[len] == ',')) {
+			len = strcspn(p, ",");
+			if (selected(p, len, ops[i].name)) break;
+		}
+		if (!*p) continue;
+
+		state.pid = 0;
+		state.ops = &ops[i];
+		state.msize = msize;
+#ifdef HAVE_MQUEUE
+		if (ops[i].create == mqueue_create && msize == 0) {
+			int	j;
+
+			for (j = 0; msizes[j]; ++j) {
+				state.msize = msizes[j];
+				bench(&state, rate, parallel, warmup, repetitions);
+			}
+			continue;
+		}
+#endif
+		if (state.msize == 0) state.msize = 8;
+		bench(&state, rate, parallel, warmup, repetitions);
+	}
 	return (0);
 }
 
 void 
 initialize(iter_t iterations, void* cookie)
 {
-	char	c;
 	state_t * state = (state_t *)cookie;
 
 	if (iterations) return;
 
-	state->semid = semget(IPC_PRIVATE, 2, IPC_CREAT | IPC_EXCL | 0600);
-	semctl(state->semid, 0, SETVAL, 0);
-	semctl(state->semid, 1, SETVAL, 0);
+	if (state->ops->create(state) < 0) {
+		fprintf(stderr, "lat_sem: cannot create %s\n", state->ops->name);
+		exit(1);
+	}
 
 	handle_scheduler(benchmp_childid(), 0, 1);
 	switch (state->pid = fork()) {
 	    case 0:
 		signal(SIGTERM, exit);
 		handle_scheduler(benchmp_childid(), 1, 1);
-		writer(state->semid);
+		writer(state);
 		return;
 
 	    case -1:
@@ -106,57 +290,303 @@ cleanup(iter_t iterations, void* cookie)
 		state->pid = 0;
 	}
 	/* free the semaphores */
-	semctl(state->semid, 0, IPC_RMID);
+	state->ops->destroy(state);
 }
 
 void 
 doit(register iter_t iterations, void *cookie)
 {
 	state_t *state = (state_t *) cookie;
+	sem_ops_t *ops = state->ops;
+
+	if (ops->waitpost) {
+		while (iterations-- > 0) {
+			ops->waitpost(state, 1, 0);
+		}
+		return;
+	}
+	while (iterations-- > 0) {
+		ops->wait(state, 1);
+		ops->post(state, 0);
+	}
+}
+
+void 
+writer(state_t* state)
+{
+	sem_ops_t *ops = state->ops;
+	int	i;
+
+	for (i = 0; i < state->depth; ++i) {
+		ops->post(state, 1);
+	}
+
+	for ( ;; ) {
+		if (ops->waitpost) {
+			ops->waitpost(state, 0, 1);
+		} else {
+			ops->wait(state, 0);
+			ops->post(state, 1);
+		}
+	}
+}
+
+int
+sysv_create(state_t* state)
+{
+	state->semid = semget(IPC_PRIVATE, 2, IPC_CREAT | IPC_EXCL | 0600);
+	if (state->semid < 0) return -1;
+	semctl(state->semid, 0, SETVAL, 0);
+	semctl(state->semid, 1, SETVAL, 0);
+	return 0;
+}
+
+void
+sysv_destroy(state_t* state)
+{
+	semctl(state->semid, 0, IPC_RMID);
+}
+
+void
+sysv_wait(state_t* state, int which)
+{
+	struct sembuf sop;
+
+	sop.sem_num = which;
+	sop.sem_op = -1;
+	sop.sem_flg = 0;
+	if (semop(state->semid, &sop, 1) < 0) {
+		perror("error on semaphore");
+		exit(1);
+	}
+}
+
+void
+sysv_post(state_t* state, int which)
+{
+	struct sembuf sop;
+
+	sop.sem_num = which;
+	sop.sem_op = 1;
+	sop.sem_flg = 0;
+	if (semop(state->semid, &sop, 1) < 0) {
+		perror("error on semaphore");
+		exit(1);
+	}
+}
+
+void
+sysv_waitpost(state_t* state, int w, int p)
+{
 	struct sembuf sop[2];
 
-	sop[0].sem_num = 1;
+	sop[0].sem_num = w;
 	sop[0].sem_op = -1;
 	sop[0].sem_flg = 0;
 
-	sop[1].sem_num = 0;
+	sop[1].sem_num = p;
 	sop[1].sem_op = 1;
 	sop[1].sem_flg = 0;
 
-	while (iterations-- > 0) {
-		if (semop(state->semid, sop, 2) < 0) {
-			perror("(r) error on semaphore");
-			exit(1);
+	if (semop(state->semid, sop, 2) < 0) {
+		perror("error on semaphore");
+		exit(1);
+	}
+}
+
+#ifdef _POSIX_SEMAPHORES
+/*
+ * Unnamed semaphores live in memory shared with the writer
+ */
+int
+posix_create(state_t* state)
+{
+	sem_t*	sem;
+
+	sem = (sem_t*)mmap(0, 2 * sizeof(sem_t), PROT_READ|PROT_WRITE,
+			   MAP_SHARED|MAP_ANON, -1, 0);
+	if (sem == (sem_t*)MAP_FAILED) return -1;
+	state->sem[0] = &sem[0];
+	state->sem[1] = &sem[1];
+	if (sem_init(state->sem[0], 1, 0) < 0
+	    || sem_init(state->sem[1], 1, 0) < 0) {
+		munmap((void*)sem, 2 * sizeof(sem_t));
+		return -1;
+	}
+	return 0;
+}
+
+void
+posix_destroy(state_t* state)
+{
+	sem_destroy(state->sem[0]);
+	sem_destroy(state->sem[1]);
+	munmap((void*)state->sem[0], 2 * sizeof(sem_t));
+}
+
+int
+named_create(state_t* state)
+{
+	int	i;
+
+	for (i = 0; i < 2; ++i) {
+		sprintf(state->name[i], "/lmbench.sem.%d.%d", (int)getpid(), i);
+		state->sem[i] = sem_open(state->name[i],
+					 O_CREAT|O_EXCL, 0600, 0);
+		if (state->sem[i] == SEM_FAILED) {
+			if (i) {
+				sem_close(state->sem[0]);
+				sem_unlink(state->name[0]);
+			}
+			return -1;
 		}
 	}
+	return 0;
 }
 
-void 
-writer(register int sid)
+void
+named_destroy(state_t* state)
 {
-	struct sembuf sop[2];
+	int	i;
 
-	sop[0].sem_num = 1;
-	sop[0].sem_op = 1;
-	sop[0].sem_flg = 0;
+	for (i = 0; i < 2; ++i) {
+		sem_close(state->sem[i]);
+		sem_unlink(state->name[i]);
+	}
+}
+
+void
+posix_wait(state_t* state, int which)
+{
+	while (sem_wait(state->sem[which]) < 0) {
+		if (errno != EINTR) {
+			perror("sem_wait");
+			exit(1);
+		}
+	}
+}
 
-	if (semop(sid, sop, 1) < 0) {
-		perror("(w) error on initial semaphore");
+void
+posix_post(state_t* state, int which)
+{
+	if (sem_post(state->sem[which]) < 0) {
+		perror("sem_post");
 		exit(1);
 	}
+}
+#endif /* _POSIX_SEMAPHORES */
 
-	sop[0].sem_num = 0;
-	sop[0].sem_op = -1;
-	sop[0].sem_flg = 0;
+#ifdef SYS_futex
+/*
+ * A bare counting semaphore on a shared futex word.  Unlike a library
+ * semaphore it does not track waiters, so every post makes a FUTEX_WAKE
+ * call.
+ */
+int
+futex_create(state_t* state)
+{
+	state->futex = (int*)mmap(0, 2 * sizeof(int), PROT_READ|PROT_WRITE,
+				  MAP_SHARED|MAP_ANON, -1, 0);
+	if (state->futex == (int*)MAP_FAILED) return -1;
+	state->futex[0] = state->futex[1] = 0;
+	return 0;
+}
 
-	sop[1].sem_num = 1;
-	sop[1].sem_op = 1;
-	sop[1].sem_flg = 0;
+void
+futex_destroy(state_t* state)
+{
+	munmap((void*)state->futex, 2 * sizeof(int));
+}
+
+void
+futex_wait(state_t* state, int which)
+{
+	int*	f = &state->futex[which];
+	int	v;
 
 	for ( ;; ) {
-		if (semop(sid, sop, 2) < 0) {
-			perror("(w) error on semaphore");
+		v = __atomic_load_n(f, __ATOMIC_ACQUIRE);
+		if (v > 0) {
+			if (__atomic_compare_exchange_n(f, &v, v - 1, 0,
+			    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+				return;
+			continue;
+		}
+		if (syscall(SYS_futex, f, FUTEX_WAIT, 0, NULL, NULL, 0) < 0
+		    && errno != EAGAIN && errno != EINTR) {
+			perror("FUTEX_WAIT");
 			exit(1);
 		}
 	}
 }
+
+void
+futex_post(state_t* state, int which)
+{
+	int*	f = &state->futex[which];
+
+	__atomic_add_fetch(f, 1, __ATOMIC_RELEASE);
+	if (syscall(SYS_futex, f, FUTEX_WAKE, 1, NULL, NULL, 0) < 0) {
+		perror("FUTEX_WAKE");
+		exit(1);
+	}
+}
+#endif /* SYS_futex */
+
+#ifdef HAVE_MQUEUE
+/*
+ * The queues are unlinked as soon as they are open; the writer
+ * inherits the descriptors.  A token is a message of msize bytes.
+ */
+int
+mqueue_create(state_t* state)
+{
+	int	i;
+	struct mq_attr attr;
+
+	attr.mq_flags = 0;
+	attr.mq_maxmsg = state->depth;
+	attr.mq_msgsize = state->msize;
+	attr.mq_curmsgs = 0;
+	for (i = 0; i < 2; ++i) {
+		sprintf(state->name[i], "/lmbench.mq.%d.%d", (int)getpid(), i);
+		state->mq[i] = mq_open(state->name[i], O_RDWR|O_CREAT|O_EXCL,
+				       0600, &attr);
+		if (state->mq[i] == (mqd_t)-1) {
+			if (i) mq_close(state->mq[0]);
+			return -1;
+		}
+		mq_unlink(state->name[i]);
+	}
+	state->buf = (char*)malloc(state->msize);
+	bzero(state->buf, state->msize);
+	return 0;
+}
+
+void
+mqueue_destroy(state_t* state)
+{
+	mq_close(state->mq[0]);
+	mq_close(state->mq[1]);
+	free(state->buf);
+}
+
+void
+mqueue_wait(state_t* state, int which)
+{
+	if (mq_receive(state->mq[which], state->buf, state->msize, NULL)
+	    != state->msize) {
+		perror("mq_receive");
+		exit(1);
+	}
+}
+
+void
+mqueue_post(state_t* state, int which)
+{
+	if (mq_send(state->mq[which], state->buf, state->msize, 0) < 0) {
+		perror("mq_send");
+		exit(1);
+	}
+}
+#endif /* HAVE_MQUEUE */
@@ -0,0 +1,310 @@
+/*
+ * lat_shootdown.c - time munmap/mprotect/madvise while other threads
+ *	sharing the address space run on other processors
+ *
+ * Usage: lat_shootdown [-K <max threads>] [-s <size>] [-W <warmup>] [-N <repetitions>] munmap|mprotect|madvise
+ *
+ * lat_mmap measures mapping and unmapping in a single threaded process,
+ * where the kernel only has to flush the local TLB.  Here K threads,
+ * each pinned to its own processor with sched_pin(), hold TLB entries
+ * for every page of a shared mapping while the main thread tears the
+ * mapping down, so each call must also pay for the inter-processor
+ * interrupts which shoot down the remote TLB entries.
+ *
+ * The latency of each individual call is recorded and the median and
+ * 99th percentile are reported for K = 0, 1, ..., <max threads>.
+ *
+ * Copyright (c) 2000 Carl Staelin.
+ * Copyright (c) 1994 Larry McVoy.  Distributed under the FSF GPL with
+ * additional restriction that results may published only if
+ * (1) the benchmark is unmodified, and
+ * (2) the version in the sccsid below is included in the report.
+ */
+char	*id = "$Id$\n";
+
+#include "bench.h"
+#include <pthread.h>
+
+#ifndef MAP_ANONYMOUS
+#define	MAP_ANONYMOUS	MAP_ANON
+#endif
+
+#ifdef __GNUC__
+#define	BARRIER()	__sync_synchronize()
+#else
+#define	BARRIER()
+#endif
+
+#define	MAX_SPINNERS	256
+
+#define	OP_MUNMAP	0
+#define	OP_MPROTECT	1
+#define	OP_MADVISE	2
+
+typedef struct _state {
+	int		op;
+	int		nspinners;
+	size_t		size;
+	size_t		pagesize;
+	char* volatile	where;
+	volatile int	gen;
+	volatile int	done;
+	volatile int	ack[MAX_SPINNERS];
+} state_t;
+
+typedef struct _spinner {
+	state_t*	state;
+	int		id;
+	pthread_t	tid;
+} spinner_t;
+
+void*	spinner(void* cookie);
+void	prepare(state_t* state);
+void	operate(state_t* state);
+void	measure(state_t* state, int warmup, int repetitions);
+
+int
+main(int ac, char **av)
+{
+	state_t	state;
+	spinner_t* spinners;
+	int	i;
+	int	c;
+	int	max = sched_ncpus() - 1;
+	int	warmup = 10;
+	int	repetitions = 1000;
+	char	*usage = "[-K <max threads>] [-s <size>] [-W <warmup>] [-N <repetitions>] munmap|mprotect|madvise\n";
+
+	state.pagesize = getpagesize();
+	state.size = state.pagesize;
+	while (( c = getopt(ac, av, "K:s:W:N:")) != EOF) {
+		switch(c) {
+		case 'K':
+			max = atoi(optarg);
+			if (max < 0) lmbench_usage(ac, av, usage);
+			break;
+		case 's':
+			state.size = bytes(optarg);
+			if (state.size < state.pagesize)
+				state.size = state.pagesize;
+			break;
+		case 'W':
+			warmup = atoi(optarg);
+			break;
+		case 'N':
+			repetitions = atoi(optarg);
+			if (repetitions <= 0) lmbench_usage(ac, av, usage);
+			break;
+		default:
+			lmbench_usage(ac, av, usage);
+			break;
+		}
+	}
+	if (optind != ac - 1) {
+		lmbench_usage(ac, av, usage);
+	}
+
+	if (!strcmp("munmap", av[optind])) {
+		state.op = OP_MUNMAP;
+	} else if (!strcmp("mprotect", av[optind])) {
+		state.op = OP_MPROTECT;
+#ifdef MADV_DONTNEED
+	} else if (!strcmp("madvise", av[optind])) {
+		state.op = OP_MADVISE;
+#endif
+	} else {
+		lmbench_usage(ac, av, usage);
+	}
+	if (max < 0) max = 0;
+	if (max > MAX_SPINNERS) max = MAX_SPINNERS;
+
+	state.nspinners = 0;
+	state.gen = 0;
+	state.done = 0;
+	state.where = NULL;
+	if (state.op != OP_MUNMAP) {
+		state.where = mmap(0, state.size, PROT_READ|PROT_WRITE,
+				   MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if (state.where == (char*)MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+	}
+	spinners = (spinner_t*)malloc((max + 1) * sizeof(spinner_t));
+	if (!spinners) {
+		perror("malloc");
+		exit(1);
+	}
+
+	/* the main thread stays on the first processor */
+	sched_pin(0);
+
+	fprintf(stderr, "\"%s size=%lu\n", av[optind], (unsigned long)state.size);
+	for (i = 0; i <= max; ++i) {
+		if (i > 0) {
+			/*
+			 * Start one more spinner and wait for it to pin
+			 * itself.  sched_pin() is not reentrant, so only
+			 * one thread may be inside it at a time.
+			 */
+			spinners[i-1].state = &state;
+			spinners[i-1].id = i - 1;
+			state.ack[i-1] = -1;
+			BARRIER();
+			if (pthread_create(&spinners[i-1].tid, NULL,
+					   spinner, &spinners[i-1]) != 0) {
+				perror("pthread_create");
+				break;
+			}
+			while (state.ack[i-1] != state.gen)
+				;
+			state.nspinners = i;
+		}
+		measure(&state, warmup, repetitions);
+	}
+	fprintf(stderr, "\n");
+
+	state.done = 1;
+	BARRIER();
+	for (i = 0; i < state.nspinners; ++i) {
+		pthread_join(spinners[i].tid, NULL);
+	}
+	if (state.op != OP_MUNMAP) {
+		munmap(state.where, state.size);
+	}
+	free(spinners);
+	return (0);
+}
+
+/*
+ * Each spinner reads every page of the mapping whenever the main
+ * thread announces a new generation, so that it holds a TLB entry
+ * for each page, and then acknowledges.  It does not touch the
+ * mapping again until the next generation, so the main thread may
+ * safely unmap it, but it keeps running on its processor inside our
+ * address space, which is what forces the remote TLB flush.
+ */
+void*
+spinner(void* cookie)
+{
+	spinner_t* s = (spinner_t*)cookie;
+	state_t* state = s->state;
+	int	seen;
+	int	sum = 0;
+	char	*p, *end;
+
+	sched_pin(s->id + 1);
+	seen = state->gen;
+	BARRIER();
+	state->ack[s->id] = seen;
+
+	while (!state->done) {
+		if (state->gen == seen)
+			continue;
+		BARRIER();
+		seen = state->gen;
+		end = state->where + state->size;
+		for (p = state->where; p < end; p += state->pagesize) {
+			sum += *(volatile char*)p;
+		}
+		BARRIER();
+		state->ack[s->id] = seen;
+	}
+	use_int(sum);
+	return (NULL);
+}
+
+/*
+ * Make every page of the mapping present and writable, then wait
+ * until all spinners have loaded it into their TLBs.
+ */
+void
+prepare(state_t* state)
+{
+	int	i;
+	char	*p, *end;
+
+	switch (state->op) {
+	case OP_MUNMAP:
+		state->where = mmap(0, state->size, PROT_READ|PROT_WRITE,
+				    MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if (state->where == (char*)MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+		break;
+	case OP_MPROTECT:
+		if (mprotect(state->where, state->size,
+			     PROT_READ|PROT_WRITE) < 0) {
+			perror("mprotect");
+			exit(1);
+		}
+		break;
+	default:
+		break;
+	}
+	end = state->where + state->size;
+	for (p = state->where; p < end; p += state->pagesize) {
+		*p = 1;
+	}
+
+	BARRIER();
+	state->gen++;
+	for (i = 0; i < state->nspinners; ++i) {
+		while (state->ack[i] != state->gen)
+			;
+	}
+	BARRIER();
+}
+
+void
+operate(state_t* state)
+{
+	switch (state->op) {
+	case OP_MUNMAP:
+		if (munmap(state->where, state->size) < 0) {
+			perror("munmap");
+			exit(1);
+		}
+		break;
+	case OP_MPROTECT:
+		if (mprotect(state->where, state->size, PROT_READ) < 0) {
+			perror("mprotect");
+			exit(1);
+		}
+		break;
+#ifdef MADV_DONTNEED
+	case OP_MADVISE:
+		if (madvise(state->where, state->size, MADV_DONTNEED) < 0) {
+			perror("madvise");
+			exit(1);
+		}
+		break;
+#endif
+	}
+}
+
+void
+measure(state_t* state, int warmup, int repetitions)
+{
+	int	i;
+	uint64	begin;
+	double	t;
+	double*	times = (double*)malloc(repetitions * sizeof(double));
+
+	if (!times) {
+		perror("malloc");
+		exit(1);
+	}
+	for (i = 0; i < warmup + repetitions; ++i) {
+		prepare(state);
+		begin = now_nsecs();
+		operate(state);
+		t = (double)(now_nsecs() - begin) / 1000.;
+		if (i >= warmup) times[i - warmup] = t;
+	}
+	fprintf(stderr, "%d %.4f %.4f\n", state->nspinners,
+		double_median(times, repetitions),
+		double_percentile(99., times, repetitions));
+	free(times);
+}
@@ -15,14 +15,41 @@
  */
 char	*id = "$Id$\n";
 
+#if defined(linux) || defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
 #include "bench.h"
 #include <setjmp.h>
+#include <pthread.h>
+
+#if defined(linux) || defined(__linux__)
+#include <sys/syscall.h>
+#include <sys/signalfd.h>
+#include <sys/epoll.h>
+#endif
 
 uint64	caught, n;
 double	adj;
 void	handler(int s) { }
 jmp_buf	prot_env;
 
+struct _state {
+	char*	fname;
+	char*	where;
+	int	sfd;		/* signalfd */
+	int	epfd;
+	int	depth;		/* signals queued per burst */
+	pid_t	pid;
+	pid_t	tid;		/* the thread running the benchmark */
+	volatile pid_t	peer;	/* the thread being signalled */
+	volatile int	done;
+	pthread_t	thread;
+};
+
+/* the signal handlers need to find the peer thread */
+struct _state*	tstate;
+
 void
 do_send(iter_t iterations, void* cookie)
 {
@@ -62,10 +89,250 @@ do_catch(iter_t iterations, void* cookie)
 	}
 }
 
-struct _state {
-	char*	fname;
-	char*	where;
-};
+void
+rt_handler(int s, siginfo_t* info, void* context)
+{
+	caught++;
+}
+
+#ifdef SIGRTMIN
+void
+do_sigqueue_send(iter_t iterations, void* cookie)
+{
+	int	me = getpid();
+	union sigval value;
+
+	value.sival_int = 0;
+	while (iterations-- > 0) {
+		sigqueue(me, 0, value);
+	}
+}
+
+void
+do_sigqueue(iter_t iterations, void* cookie)
+{
+	int	me = getpid();
+	union sigval value;
+	struct	sigaction sa;
+
+	sa.sa_sigaction = rt_handler;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_SIGINFO;
+	sigaction(SIGRTMIN, &sa, 0);
+
+	value.sival_int = 0;
+	while (iterations-- > 0) {
+		sigqueue(me, SIGRTMIN, value);
+	}
+}
+
+/*
+ * Queue realtime signals while they are blocked, then unblock them
+ * and let the whole queue drain through the handler.  By default the
+ * queue is filled up to RLIMIT_SIGPENDING, which is shared by all of
+ * the user's processes, so check once that it really holds that many.
+ */
+void
+init_burst(iter_t iterations, void* cookie)
+{
+	struct _state* state = (struct _state*)cookie;
+	int	i;
+	sigset_t set;
+	union sigval value;
+	struct	sigaction sa;
+
+	if (iterations) return;
+
+	sa.sa_sigaction = rt_handler;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_SIGINFO;
+	sigaction(SIGRTMIN, &sa, 0);
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGRTMIN);
+	sigprocmask(SIG_BLOCK, &set, 0);
+	value.sival_int = 0;
+	for (i = 0; i < state->depth; ++i) {
+		if (sigqueue(getpid(), SIGRTMIN, value) < 0) break;
+	}
+	caught = 0;
+	sigprocmask(SIG_UNBLOCK, &set, 0);
+	if (i < state->depth || caught != i) {
+		fprintf(stderr, "lat_sig: queued %d of %d signals, caught %lu; "
+			"try a smaller -q\n",
+			i, state->depth, (unsigned long)caught);
+		exit(1);
+	}
+}
+
+void
+do_burst(iter_t iterations, void* cookie)
+{
+	struct _state* state = (struct _state*)cookie;
+	int	i;
+	int	me = getpid();
+	sigset_t set;
+	union sigval value;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGRTMIN);
+	value.sival_int = 0;
+	while (iterations-- > 0) {
+		sigprocmask(SIG_BLOCK, &set, 0);
+		for (i = 0; i < state->depth; ++i) {
+			sigqueue(me, SIGRTMIN, value);
+		}
+		sigprocmask(SIG_UNBLOCK, &set, 0);
+	}
+}
+#endif /* SIGRTMIN */
+
+#if defined(SYS_tgkill) && defined(SYS_gettid)
+/*
+ * The peer thread spins, so every SIGUSR1 has to interrupt a running
+ * thread on another processor; its handler answers with SIGUSR2 to
+ * the benchmark thread, which sleeps in sigsuspend() until it arrives.
+ */
+void
+peer_handler(int s)
+{
+	syscall(SYS_tgkill, tstate->pid, tstate->tid, SIGUSR2);
+}
+
+void*
+peer(void* cookie)
+{
+	struct _state* state = (struct _state*)cookie;
+
+	sched_pin(2 * benchmp_childid() + 1);
+	state->peer = syscall(SYS_gettid);
+	while (!state->done)
+		;
+	return NULL;
+}
+
+void
+init_thread(iter_t iterations, void* cookie)
+{
+	struct _state* state = (struct _state*)cookie;
+	sigset_t set;
+	struct	sigaction sa;
+
+	if (iterations) return;
+
+	tstate = state;
+	state->pid = getpid();
+	state->tid = syscall(SYS_gettid);
+	state->peer = 0;
+	state->done = 0;
+
+	sa.sa_handler = peer_handler;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = 0;
+	sigaction(SIGUSR1, &sa, 0);
+	sa.sa_handler = handler;
+	sigaction(SIGUSR2, &sa, 0);
+
+	/* the peer inherits the mask, so only we ever take SIGUSR2 */
+	sigemptyset(&set);
+	sigaddset(&set, SIGUSR2);
+	sigprocmask(SIG_BLOCK, &set, 0);
+
+	sched_pin(2 * benchmp_childid());
+	if (pthread_create(&state->thread, NULL, peer, state) != 0) {
+		perror("pthread_create");
+		exit(1);
+	}
+	while (!state->peer)
+		;
+}
+
+void
+do_thread(iter_t iterations, void* cookie)
+{
+	struct _state* state = (struct _state*)cookie;
+	sigset_t mask;
+
+	sigprocmask(SIG_SETMASK, 0, &mask);
+	sigdelset(&mask, SIGUSR2);
+	while (iterations-- > 0) {
+		syscall(SYS_tgkill, state->pid, state->peer, SIGUSR1);
+		sigsuspend(&mask);
+	}
+}
+
+void
+cleanup_thread(iter_t iterations, void* cookie)
+{
+	struct _state* state = (struct _state*)cookie;
+
+	if (iterations) return;
+
+	state->done = 1;
+	pthread_join(state->thread, NULL);
+}
+#endif /* SYS_tgkill */
+
+#ifdef SFD_NONBLOCK
+/*
+ * SIGUSR1 stays blocked and is consumed by reading a signalfd once
+ * epoll says it is readable, the way event loops handle signals.
+ */
+void
+init_signalfd(iter_t iterations, void* cookie)
+{
+	struct _state* state = (struct _state*)cookie;
+	sigset_t set;
+	struct epoll_event ev;
+
+	if (iterations) return;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGUSR1);
+	sigprocmask(SIG_BLOCK, &set, 0);
+	state->sfd = signalfd(-1, &set, SFD_NONBLOCK);
+	state->epfd = epoll_create(1);
+	if (state->sfd < 0 || state->epfd < 0) {
+		perror("signalfd");
+		exit(1);
+	}
+	ev.events = EPOLLIN;
+	ev.data.fd = state->sfd;
+	if (epoll_ctl(state->epfd, EPOLL_CTL_ADD, state->sfd, &ev) < 0) {
+		perror("epoll_ctl");
+		exit(1);
+	}
+}
+
+void
+do_signalfd(iter_t iterations, void* cookie)
+{
+	struct _state* state = (struct _state*)cookie;
+	int	me = getpid();
+	struct epoll_event ev;
+	struct signalfd_siginfo info;
+
+	while (iterations-- > 0) {
+		kill(me, SIGUSR1);
+		if (epoll_wait(state->epfd, &ev, 1, -1) != 1
+		    || read(state->sfd, &info, sizeof(info)) != sizeof(info)) {
+			perror("signalfd");
+			exit(1);
+		}
+	}
+}
+
+void
+cleanup_signalfd(iter_t iterations, void* cookie)
+{
+	struct _state* state = (struct _state*)cookie;
+
+	if (iterations) return;
+
+	close(state->epfd);
+	close(state->sfd);
+}
+#endif /* SFD_NONBLOCK */
 
 void
 prot(int s)
@@ -115,22 +382,25 @@ do_prot(iter_t iterations, void* cookie)
 }
 
 /*
- * Cost of catching the signal less the cost of sending it
+ * Cost of receiving signals less the cost of sending them, which
+ * base measures
  */
 void
-bench_catch(int parallel, int warmup, int repetitions)
+bench_less(benchmp_f base, benchmp_f initialize, benchmp_f benchmark,
+	   benchmp_f cleanup, void* cookie,
+	   int parallel, int warmup, int repetitions)
 {
 	uint64 send_usecs, send_n;
 
 	/* measure cost of sending signal */
-	benchmp(NULL, do_send, NULL, 0, parallel, 
+	benchmp(NULL, base, NULL, 0, parallel, 
 		warmup, repetitions, NULL);
 	send_usecs = gettime();
 	send_n = get_n();
 
 	/* measure cost of sending & catching signal */
-	benchmp(NULL, do_catch, NULL, 0, parallel, 
-		warmup, repetitions, NULL);
+	benchmp(initialize, benchmark, cleanup, 0, parallel, 
+		warmup, repetitions, cookie);
 
 	/* subtract cost of sending signal */
 	if (gettime() > (send_usecs * get_n()) / send_n) {
@@ -140,6 +410,16 @@ bench_catch(int parallel, int warmup, int repetitions)
 	}
 }
 
+/*
+ * Cost of catching the signal less the cost of sending it
+ */
+void
+bench_catch(int parallel, int warmup, int repetitions)
+{
+	bench_less(do_send, NULL, do_catch, NULL, NULL,
+		   parallel, warmup, repetitions);
+}
+
 void
 bench_prot(char* fname, int parallel, int warmup, int repetitions)
 {
@@ -173,10 +453,18 @@ main(int ac, char **av)
 	int warmup = 0;
 	int repetitions = -1;
 	int c;
-	char* usage = "[-P <parallelism>] [-W <warmup>] [-N <repetitions>] install|catch|prot [file]\n";
+	int depth = 0;
+	struct _state state;
+	char	buf[256];
+	char* usage = "[-P <parallelism>] [-W <warmup>] [-N <repetitions>] [-q <depth>] install|catch|prot [file]\n"
+		"\tor: sigqueue|thread|signalfd|burst\n";
 
-	while (( c = getopt(ac, av, "P:W:N:")) != EOF) {
+	while (( c = getopt(ac, av, "q:P:W:N:")) != EOF) {
 		switch(c) {
+		case 'q':
+			depth = atoi(optarg);
+			if (depth <= 0) lmbench_usage(ac, av, usage);
+			break;
 		case 'P':
 			parallel = atoi(optarg);
 			if (parallel <= 0) lmbench_usage(ac, av, usage);
@@ -206,6 +494,47 @@ main(int ac, char **av)
 	} else if (!strcmp("prot", av[optind]) && optind == ac - 2) {
 		bench_prot(av[optind+1], parallel, warmup, repetitions);
 		micro("Protection fault", get_n());
+#ifdef SIGRTMIN
+	} else if (!strcmp("sigqueue", av[optind])) {
+		bench_less(do_sigqueue_send, NULL, do_sigqueue, NULL, NULL,
+			   parallel, warmup, repetitions);
+		micro("Realtime signal handler overhead", get_n());
+	} else if (!strcmp("burst", av[optind])) {
+		if (depth == 0) {
+			struct rlimit rl;
+
+			/*
+			 * The pending signal limit is per user, so leave
+			 * a little room for the user's other processes
+			 */
+			depth = 65536;
+			if (getrlimit(RLIMIT_SIGPENDING, &rl) == 0
+			    && rl.rlim_cur != RLIM_INFINITY
+			    && rl.rlim_cur - rl.rlim_cur / 16 < depth) {
+				depth = rl.rlim_cur - rl.rlim_cur / 16;
+			}
+			depth /= parallel;
+		}
+		state.depth = depth;
+		benchmp(init_burst, do_burst, NULL, 0, parallel,
+			warmup, repetitions, &state);
+		sprintf(buf, "Realtime signal throughput, queue depth %d",
+			state.depth);
+		micro(buf, get_n() * state.depth);
+#endif
+#if defined(SYS_tgkill) && defined(SYS_gettid)
+	} else if (!strcmp("thread", av[optind])) {
+		benchmp(init_thread, do_thread, cleanup_thread, 0, parallel,
+			warmup, repetitions, &state);
+		micro("Signal round trip between threads", get_n());
+#endif
+#ifdef SFD_NONBLOCK
+	} else if (!strcmp("signalfd", av[optind])) {
+		bench_less(do_send, init_signalfd, do_signalfd,
+			   cleanup_signalfd, &state,
+			   parallel, warmup, repetitions);
+		micro("Signal via signalfd and epoll", get_n());
+#endif
 	} else {
 		lmbench_usage(ac, av, usage);
 	}
@@ -8,14 +8,48 @@
  */
 char	*id = "$Id: s.lat_syscall.c 1.11 97/06/15 22:38:58-07:00 lm $\n";
 
+#if defined(linux) || defined(__linux__)
+#define	_GNU_SOURCE	/* sched_getcpu */
+#endif
 #include "bench.h"
+#if defined(linux) || defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+#ifdef HAVE_SECCOMP
+#include <stddef.h>
+#include <sys/prctl.h>
+#include <linux/seccomp.h>
+#include <linux/filter.h>
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define	ARG_HIGH	0	/* offset of the upper half of an argument */
+#else
+#define	ARG_HIGH	4
+#endif
+#endif
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#endif
 #define	FNAME "/usr/include/sys/types.h"
 
 struct _state {
 	int fd;
 	char* file;
+	int batch;
+#ifdef HAVE_IO_URING
+	int ring;
+	unsigned *sq_tail;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+#endif
 };
 
+int	nrules = 0;		/* seccomp rules installed */
+
+char*	label(char *s);
+int	run(char *test, struct _state *state, int parallel, int warmup, int repetitions);
+void	install_filter(int rules);
+
 void
 do_getppid(iter_t iterations, void *cookie)
 {
@@ -96,18 +130,171 @@ do_openclose(iter_t iterations, void *cookie)
 	}
 }
 
+void
+do_clock(iter_t iterations, void *cookie)
+{
+	struct timespec ts;
+
+	while (iterations-- > 0) {
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+	}
+}
+
+#ifdef SYS_clock_gettime
+void
+do_clock_syscall(iter_t iterations, void *cookie)
+{
+	struct timespec ts;
+
+	while (iterations-- > 0) {
+		syscall(SYS_clock_gettime, CLOCK_MONOTONIC, &ts);
+	}
+}
+#endif
+
+#ifdef SYS_getcpu
+void
+do_getcpu(iter_t iterations, void *cookie)
+{
+	int	cpu = 0;
+
+	while (iterations-- > 0) {
+		cpu += sched_getcpu();
+	}
+	use_int(cpu);
+}
+
+void
+do_getcpu_syscall(iter_t iterations, void *cookie)
+{
+	unsigned cpu;
+
+	while (iterations-- > 0) {
+		syscall(SYS_getcpu, &cpu, NULL, NULL);
+	}
+}
+#endif
+
+#ifdef HAVE_IO_URING
+/*
+ * A bare io_uring, set up with the raw system calls so that we do not
+ * need liburing.  Every submission queue entry is a NOP, and the
+ * submission array maps each slot to its own entry, so submitting n
+ * NOPs is just moving the tail.
+ */
+void
+uring_init(iter_t iterations, void *cookie)
+{
+	struct _state *pState = (struct _state*)cookie;
+	struct io_uring_params p;
+	struct io_uring_sqe *sqes;
+	unsigned i, *array;
+	size_t	sq_size, cq_size;
+	char	*sq, *cq;
+
+	if (iterations) return;
+
+	bzero(&p, sizeof(p));
+	pState->ring = syscall(__NR_io_uring_setup, pState->batch, &p);
+	if (pState->ring < 0) {
+		perror("io_uring_setup");
+		exit(1);
+	}
+	sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (cq_size > sq_size) sq_size = cq_size;
+		cq_size = sq_size;
+	}
+	sq = mmap(0, sq_size, PROT_READ|PROT_WRITE, MAP_SHARED,
+		  pState->ring, IORING_OFF_SQ_RING);
+	cq = sq;
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+		cq = mmap(0, cq_size, PROT_READ|PROT_WRITE, MAP_SHARED,
+			  pState->ring, IORING_OFF_CQ_RING);
+	}
+	sqes = (struct io_uring_sqe*)mmap(0,
+		p.sq_entries * sizeof(struct io_uring_sqe),
+		PROT_READ|PROT_WRITE, MAP_SHARED, pState->ring, IORING_OFF_SQES);
+	if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED) {
+		perror("io_uring mmap");
+		exit(1);
+	}
+	pState->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+	pState->cq_head = (unsigned*)(cq + p.cq_off.head);
+	pState->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+	array = (unsigned*)(sq + p.sq_off.array);
+	bzero(sqes, p.sq_entries * sizeof(struct io_uring_sqe));
+	for (i = 0; i < p.sq_entries; ++i) {
+		sqes[i].opcode = IORING_OP_NOP;
+		array[i] = i;
+	}
+}
+
+void
+uring_cleanup(iter_t iterations, void *cookie)
+{
+	struct _state *pState = (struct _state*)cookie;
+
+	if (iterations) return;
+	close(pState->ring);
+}
+
+void
+do_uring(iter_t iterations, void *cookie)
+{
+	struct _state *pState = (struct _state*)cookie;
+	unsigned batch = pState->batch;
+	unsigned tail;
+
+	while (iterations-- > 0) {
+		tail = *pState->sq_tail + batch;
+		__atomic_store_n(pState->sq_tail, tail, __ATOMIC_RELEASE);
+		if (syscall(__NR_io_uring_enter, pState->ring, batch, batch,
+			    IORING_ENTER_GETEVENTS, NULL, 0) != batch) {
+			perror("io_uring_enter");
+			exit(1);
+		}
+		tail = __atomic_load_n(pState->cq_tail, __ATOMIC_ACQUIRE);
+		__atomic_store_n(pState->cq_head, tail, __ATOMIC_RELEASE);
+	}
+}
+#endif
+
 int
 main(int ac, char **av)
 {
 	int parallel = 1;
 	int warmup = 0;
 	int repetitions = -1;
+	int rules = 0;
 	int c;
 	struct _state state;
-	char* usage = "[-P <parallelism>] [-W <warmup>] [-N <repetitions>] null|read|write|stat|fstat|open [file]\n";
+	char* usage = "[-f <seccomp rules>] [-b <batch>] [-P <parallelism>] [-W <warmup>] [-N <repetitions>] null|read|write|stat|fstat|open|clock|getcpu|uring [file]\n";
+
+	state.batch = 1;
 
-	while (( c = getopt(ac, av, "P:W:N:")) != EOF) {
+	while (( c = getopt(ac, av, "f:b:P:W:N:")) != EOF) {
 		switch(c) {
+		case 'f':
+			rules = atoi(optarg);
+			if (rules <= 0) lmbench_usage(ac, av, usage);
+#ifndef HAVE_SECCOMP
+			fprintf(stderr, "lat_syscall: seccomp is not supported\n");
+			exit(1);
+#else
+			if (2 * rules + 2 > BPF_MAXINSNS) {
+				fprintf(stderr, "lat_syscall: at most %d seccomp rules\n",
+					(BPF_MAXINSNS - 2) / 2);
+				exit(1);
+			}
+#endif
+			break;
+		case 'b':
+			state.batch = atoi(optarg);
+			if (state.batch <= 0 || state.batch > 4096)
+				lmbench_usage(ac, av, usage);
+			break;
 		case 'P':
 			parallel = atoi(optarg);
 			if (parallel <= 0) lmbench_usage(ac, av, usage);
@@ -131,42 +318,144 @@ main(int ac, char **av)
 	if (optind == ac - 2) 
 		state.file = av[optind + 1];
 
-	if (!strcmp("null", av[optind])) {
+	/*
+	 * A seccomp filter cannot be removed, so measure without it
+	 * first and then again with it, in the same process.
+	 */
+	if (run(av[optind], &state, parallel, warmup, repetitions) < 0) {
+		lmbench_usage(ac, av, usage);
+	}
+	if (rules) {
+		install_filter(rules);
+		run(av[optind], &state, parallel, warmup, repetitions);
+	}
+	return(0);
+}
+
+/*
+ * Name the result after the seccomp filter, if there is one.
+ */
+char*
+label(char *s)
+{
+	static char buf[256];
+
+	if (!nrules) return (s);
+	sprintf(buf, "%s (%d seccomp rules)", s, nrules);
+	return (buf);
+}
+
+int
+run(char *test, struct _state *state, int parallel, int warmup, int repetitions)
+{
+	if (!strcmp("null", test)) {
 		benchmp(NULL, do_getppid, NULL, 0, parallel, 
-			warmup, repetitions, &state);
-		micro("Simple syscall", get_n());
-	} else if (!strcmp("write", av[optind])) {
-		state.fd = open("/dev/null", 1);
+			warmup, repetitions, state);
+		micro(label("Simple syscall"), get_n());
+	} else if (!strcmp("write", test)) {
+		state->fd = open("/dev/null", 1);
 		benchmp(NULL, do_write, NULL, 0, parallel, 
-			warmup, repetitions, &state);
-		micro("Simple write", get_n());
-		close(state.fd);
-	} else if (!strcmp("read", av[optind])) {
-		state.fd = open("/dev/zero", 0);
-		if (state.fd == -1) {
+			warmup, repetitions, state);
+		micro(label("Simple write"), get_n());
+		close(state->fd);
+	} else if (!strcmp("read", test)) {
+		state->fd = open("/dev/zero", 0);
+		if (state->fd == -1) {
 			fprintf(stderr, "Simple read: -1\n");
-			return(1);
+			exit(1);
 		}
 		benchmp(NULL, do_read, NULL, 0, parallel, 
-			warmup, repetitions, &state);
-		micro("Simple read", get_n());
-		close(state.fd);
-	} else if (!strcmp("stat", av[optind])) {
+			warmup, repetitions, state);
+		micro(label("Simple read"), get_n());
+		close(state->fd);
+	} else if (!strcmp("stat", test)) {
 		benchmp(NULL, do_stat, NULL, 0, parallel, 
-			warmup, repetitions, &state);
-		micro("Simple stat", get_n());
-	} else if (!strcmp("fstat", av[optind])) {
-		state.fd = open(state.file, 0);
+			warmup, repetitions, state);
+		micro(label("Simple stat"), get_n());
+	} else if (!strcmp("fstat", test)) {
+		state->fd = open(state->file, 0);
 		benchmp(NULL, do_fstat, NULL, 0, parallel, 
-			warmup, repetitions, &state);
-		micro("Simple fstat", get_n());
-		close(state.fd);
-	} else if (!strcmp("open", av[optind])) {
+			warmup, repetitions, state);
+		micro(label("Simple fstat"), get_n());
+		close(state->fd);
+	} else if (!strcmp("open", test)) {
 		benchmp(NULL, do_openclose, NULL, 0, parallel, 
-			warmup, repetitions, &state);
-		micro("Simple open/close", get_n());
+			warmup, repetitions, state);
+		micro(label("Simple open/close"), get_n());
+	} else if (!strcmp("clock", test)) {
+		benchmp(NULL, do_clock, NULL, 0, parallel, 
+			warmup, repetitions, state);
+		micro(label("clock_gettime"), get_n());
+#ifdef SYS_clock_gettime
+		benchmp(NULL, do_clock_syscall, NULL, 0, parallel, 
+			warmup, repetitions, state);
+		micro(label("clock_gettime syscall"), get_n());
+#endif
+#ifdef SYS_getcpu
+	} else if (!strcmp("getcpu", test)) {
+		benchmp(NULL, do_getcpu, NULL, 0, parallel, 
+			warmup, repetitions, state);
+		micro(label("getcpu"), get_n());
+		benchmp(NULL, do_getcpu_syscall, NULL, 0, parallel, 
+			warmup, repetitions, state);
+		micro(label("getcpu syscall"), get_n());
+#endif
+#ifdef HAVE_IO_URING
+	} else if (!strcmp("uring", test)) {
+		char	buf[64];
+
+		benchmp(uring_init, do_uring, uring_cleanup, 0, parallel, 
+			warmup, repetitions, state);
+		sprintf(buf, "io_uring nop (batch %d)", state->batch);
+		micro(label(buf), get_n() * state->batch);
+#endif
 	} else {
-		lmbench_usage(ac, av, usage);
+		return (-1);
 	}
-	return(0);
+	return (0);
+}
+
+/*
+ * Install a seccomp filter that checks the first argument against
+ * <rules> values, one at a time, before allowing the call, which is
+ * how a list of argument rules compiles.  A filter which only looks
+ * at the system call number is cached by recent kernels and never
+ * run, so each rule looks at the argument instead.  The rules compare
+ * the upper half of the argument with values that no file descriptor
+ * or user address has, so nothing is actually denied.
+ */
+void
+install_filter(int rules)
+{
+#ifdef HAVE_SECCOMP
+	int	i;
+	struct sock_fprog prog;
+	struct sock_filter *f;
+
+	f = (struct sock_filter*)malloc((2 * rules + 2) * sizeof(struct sock_filter));
+	if (!f) {
+		perror("malloc");
+		exit(1);
+	}
+	f[0] = (struct sock_filter)BPF_STMT(BPF_LD|BPF_W|BPF_ABS,
+			offsetof(struct seccomp_data, args[0]) + ARG_HIGH);
+	for (i = 0; i < rules; ++i) {
+		f[2 * i + 1] = (struct sock_filter)BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K,
+			0x80000000 + i, 0, 1);
+		f[2 * i + 2] = (struct sock_filter)BPF_STMT(BPF_RET|BPF_K,
+			SECCOMP_RET_ERRNO | EPERM);
+	}
+	f[2 * rules + 1] = (struct sock_filter)BPF_STMT(BPF_RET|BPF_K,
+			SECCOMP_RET_ALLOW);
+	prog.len = 2 * rules + 2;
+	prog.filter = f;
+
+	if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0
+	    || prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog) < 0) {
+		perror("lat_syscall: seccomp");
+		exit(1);
+	}
+	free(f);
+	nrules = rules;
+#endif
 }
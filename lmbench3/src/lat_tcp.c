@@ -4,8 +4,16 @@
  * Three programs in one -
  *	server usage:	tcp_xact -s
  *	client usage:	tcp_xact [-m <message size>] [-P <parallelism>] [-W <warmup>] [-N <repetitions>] hostname
+ *			tcp_xact -r [-w write|writev|more|cork] [-b <batch>] [-n] [-m <message size>] [...] hostname
  *	shutdown:	tcp_xact -S hostname
  *
+ * With -r, the client streams messages one way instead of ping-ponging
+ * them, and reports messages per second and the sender and receiver CPU
+ * time per message.  Each benchmark iteration sends <batch> messages
+ * with one write() each, one writev(), one send() each with MSG_MORE on
+ * all but the last, or one write() each between setting and clearing
+ * TCP_CORK.  -n turns on TCP_NODELAY on the sending side.
+ *
  * Copyright (c) 1994 Larry McVoy.  Distributed under the FSF GPL with
  * additional restriction that results may published only if
  * (1) the benchmark is unmodified, and
@@ -15,19 +23,49 @@
 char	*id = "$Id$\n";
 
 #include "bench.h"
+#include <sys/uio.h>
+#include <netinet/tcp.h>
+
+#define	MAX_BATCH	1024
+#define	SINKBUF		(64 * 1024)
+
+#define	SEND_WRITE	0
+#define	SEND_WRITEV	1
+#define	SEND_MORE	2
+#define	SEND_CORK	3
+
+char	*methods[] = { "write", "writev", "more", "cork", NULL };
+
+/* -r: what each benchmark process did, for the parent to report */
+typedef struct _usage {
+	uint64	msgs;
+	uint64	usecs;		/* sender CPU */
+	uint64	rusecs;		/* receiver CPU */
+} usage_t;
 
 typedef struct _state {
 	int	msize;
 	int	sock;
 	char	*server;
 	char	*buf;
+	int	rate;
+	int	method;
+	int	batch;
+	int	nodelay;
+	struct iovec *iov;
+	uint64	msgs;
+	uint64	rusecs;
+	usage_t	*usage;
 } state_t;
 
 void	init(iter_t iterations, void* cookie);
 void	cleanup(iter_t iterations, void* cookie);
 void	doclient(iter_t iterations, void* cookie);
+void	doclient_rate(iter_t iterations, void* cookie);
+int	send_batch(state_t *state);
 void	server_main();
 void	doserver(int sock);
+void	sink(int sock);
 
 int
 main(int ac, char **av)
@@ -36,13 +74,17 @@ main(int ac, char **av)
 	int	parallel = 1;
 	int	warmup = 0;
 	int	repetitions = -1;
-	int 	c;
+	int 	c, i;
 	char	buf[256];
-	char	*usage = "-s\n OR [-m <message size>] [-P <parallelism>] [-W <warmup>] [-N <repetitions>] server\n OR -S server\n";
+	char	*usage = "-s\n OR [-m <message size>] [-P <parallelism>] [-W <warmup>] [-N <repetitions>] server\n OR -r [-w write|writev|more|cork] [-b <batch>] [-n] [-m <message size>] [-P <parallelism>] [-W <warmup>] [-N <repetitions>] server\n OR -S server\n";
 
 	state.msize = 1;
+	state.rate = 0;
+	state.method = SEND_WRITE;
+	state.batch = 1;
+	state.nodelay = 0;
 
-	while (( c = getopt(ac, av, "sS:m:P:W:N:")) != EOF) {
+	while (( c = getopt(ac, av, "sS:m:rw:b:nP:W:N:")) != EOF) {
 		switch(c) {
 		case 's': /* Server */
 			if (fork() == 0) {
@@ -58,6 +100,30 @@ main(int ac, char **av)
 		case 'm':
 			state.msize = atoi(optarg);
 			break;
+		case 'r':
+			state.rate = 1;
+			break;
+		case 'w':
+			for (i = 0; methods[i]; ++i) {
+				if (!strcmp(optarg, methods[i])) break;
+			}
+			if (!methods[i]) lmbench_usage(ac, av, usage);
+#if !defined(MSG_MORE) || !defined(TCP_CORK)
+			if (i == SEND_MORE || i == SEND_CORK) {
+				fprintf(stderr, "lat_tcp: %s is not supported\n", optarg);
+				exit(1);
+			}
+#endif
+			state.method = i;
+			break;
+		case 'b':
+			state.batch = atoi(optarg);
+			if (state.batch <= 0 || state.batch > MAX_BATCH)
+				lmbench_usage(ac, av, usage);
+			break;
+		case 'n':
+			state.nodelay = 1;
+			break;
 		case 'P':
 			parallel = atoi(optarg);
 			if (parallel <= 0)
@@ -80,6 +146,36 @@ main(int ac, char **av)
 	}
 
 	state.server = av[optind];
+	if (state.rate) {
+		uint64	msgs = 0, usecs = 0, rusecs = 0;
+
+		if (state.msize <= 0) lmbench_usage(ac, av, usage);
+		state.usage = (usage_t*)mmap(0, parallel * sizeof(usage_t),
+					     PROT_READ|PROT_WRITE,
+					     MAP_SHARED|MAP_ANON, -1, 0);
+		if (state.usage == (usage_t*)MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+		bzero(state.usage, parallel * sizeof(usage_t));
+		benchmp(init, doclient_rate, cleanup, MEDIUM, parallel,
+			warmup, repetitions, &state);
+		if (gettime() == 0) exit(1);
+		for (i = 0; i < parallel; ++i) {
+			msgs += state.usage[i].msgs;
+			usecs += state.usage[i].usecs;
+			rusecs += state.usage[i].rusecs;
+		}
+		if (msgs == 0) msgs = 1;
+		fprintf(stderr, "TCP message rate using %s: %d byte messages, %s x %d%s: %.0f messages/sec, %.3f sender + %.3f receiver CPU microseconds/message\n",
+			state.server, state.msize, methods[state.method],
+			state.batch, state.nodelay ? ", nodelay" : "",
+			(double)get_n() * state.batch * parallel * 1000000.
+			/ (double)gettime(),
+			(double)usecs / (double)msgs,
+			(double)rusecs / (double)msgs);
+		exit(0);
+	}
 	benchmp(init, doclient, cleanup, MEDIUM, parallel, 
 		warmup, repetitions, &state);
 
@@ -93,7 +189,8 @@ void
 init(iter_t iterations, void* cookie)
 {
 	state_t *state = (state_t *) cookie;
-	int	msize  = htonl(state->msize);
+	int	msize  = htonl(state->rate ? -state->msize : state->msize);
+	int	i;
 
 	if (iterations) return;
 
@@ -105,6 +202,25 @@ init(iter_t iterations, void* cookie)
 	}
 
 	write(state->sock, &msize, sizeof(int));
+	if (!state->rate) return;
+
+	/* a negative message size asks the server to sink messages */
+	state->msgs = 0;
+	state->rusecs = 0;
+	if (state->nodelay) {
+		int	one = 1;
+
+		setsockopt(state->sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	}
+	state->iov = (struct iovec*)malloc(state->batch * sizeof(struct iovec));
+	if (!state->iov) {
+		perror("malloc");
+		exit(1);
+	}
+	for (i = 0; i < state->batch; ++i) {
+		state->iov[i].iov_base = state->buf;
+		state->iov[i].iov_len = state->msize;
+	}
 }
 
 void
@@ -114,6 +230,14 @@ cleanup(iter_t iterations, void* cookie)
 
 	if (iterations) return;
 
+	if (state->rate) {
+		usage_t	*u = &state->usage[benchmp_childid()];
+
+		u->msgs = state->msgs;
+		u->usecs = cpu_usecs(RUSAGE_SELF);
+		u->rusecs = state->rusecs;
+		free(state->iov);
+	}
 	close(state->sock);
 	free(state->buf);
 }
@@ -130,6 +254,82 @@ doclient(iter_t iterations, void* cookie)
 	}
 }
 
+/*
+ * Send iterations * batch messages, preceded by their total size and
+ * followed by waiting for the server to say it has read them all and
+ * how much CPU time it has used so far.
+ */
+void
+doclient_rate(iter_t iterations, void* cookie)
+{
+	state_t *state = (state_t *) cookie;
+	int	sock = state->sock;
+	int	i, n, hdr[2];
+	uint64	total = (uint64)iterations * state->batch * state->msize;
+
+	state->msgs += (uint64)iterations * state->batch;
+	hdr[0] = htonl((int)(total >> 32));
+	hdr[1] = htonl((int)(total & 0xffffffff));
+	if (write(sock, hdr, sizeof(hdr)) != sizeof(hdr)) {
+		perror("lat_tcp: write");
+		exit(1);
+	}
+	while (iterations-- > 0) {
+		if (send_batch(state) < 0) {
+			perror("lat_tcp: write");
+			exit(1);
+		}
+	}
+	for (i = 0; i < sizeof(hdr); i += n) {
+		if ((n = read(sock, (char*)hdr + i, sizeof(hdr) - i)) <= 0) {
+			perror("lat_tcp: read");
+			exit(1);
+		}
+	}
+	state->rusecs = ((uint64)ntohl(hdr[0]) << 32) | (unsigned int)ntohl(hdr[1]);
+}
+
+int
+send_batch(state_t *state)
+{
+	int	i;
+	int	sock = state->sock;
+	int	msize = state->msize;
+
+	switch (state->method) {
+	case SEND_WRITEV:
+		if (writev(sock, state->iov, state->batch) != state->batch * msize)
+			return (-1);
+		break;
+#if defined(MSG_MORE) && defined(TCP_CORK)
+	case SEND_MORE:
+		for (i = 0; i < state->batch; ++i) {
+			if (send(sock, state->buf, msize,
+				 i < state->batch - 1 ? MSG_MORE : 0) != msize)
+				return (-1);
+		}
+		break;
+	case SEND_CORK:
+		i = 1;
+		setsockopt(sock, IPPROTO_TCP, TCP_CORK, &i, sizeof(i));
+		for (i = 0; i < state->batch; ++i) {
+			if (write(sock, state->buf, msize) != msize)
+				return (-1);
+		}
+		i = 0;
+		setsockopt(sock, IPPROTO_TCP, TCP_CORK, &i, sizeof(i));
+		break;
+#endif
+	default:
+		for (i = 0; i < state->batch; ++i) {
+			if (write(sock, state->buf, msize) != msize)
+				return (-1);
+		}
+		break;
+	}
+	return (0);
+}
+
 void
 server_main()
 {
@@ -162,7 +362,13 @@ doserver(int sock)
 
 	if (read(sock, &n, sizeof(int)) == sizeof(int)) {
 		int	msize = ntohl(n);
-		char*   buf = (char*)malloc(msize);
+		char*   buf;
+
+		if (msize < 0) {
+			sink(sock);
+			return;
+		}
+		buf = (char*)malloc(msize);
 
 		if (!buf) {
 			perror("malloc");
@@ -181,3 +387,35 @@ doserver(int sock)
 		exit(0);
 	}
 }
+
+/*
+ * Read batches of messages, each preceded by its size, and answer each
+ * with the CPU time used so far.
+ */
+void
+sink(int sock)
+{
+	int	i, n, hdr[2];
+	uint64	left, usecs;
+	char	*buf = (char*)malloc(SINKBUF);
+
+	if (!buf) {
+		perror("malloc");
+		exit(4);
+	}
+	for (;;) {
+		for (i = 0; i < sizeof(hdr); i += n) {
+			if ((n = read(sock, (char*)hdr + i, sizeof(hdr) - i)) <= 0)
+				exit(0);
+		}
+		left = ((uint64)ntohl(hdr[0]) << 32) | (unsigned int)ntohl(hdr[1]);
+		for (; left > 0; left -= n) {
+			n = read(sock, buf, left < SINKBUF ? left : SINKBUF);
+			if (n <= 0) exit(0);
+		}
+		usecs = cpu_usecs(RUSAGE_SELF);
+		hdr[0] = htonl((int)(usecs >> 32));
+		hdr[1] = htonl((int)(usecs & 0xffffffff));
+		if (write(sock, hdr, sizeof(hdr)) != sizeof(hdr)) exit(0);
+	}
+}
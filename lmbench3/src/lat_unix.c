@@ -1,7 +1,13 @@
 /*
  * tcp_unix.c - simple UNIX socket transaction latency test
  *
- *	lat_unix [-P <parallelism>] [-W <warmup>] [-N <repetitions>]
+ *	lat_unix [-m <message size>] [-P <parallelism>] [-W <warmup>] [-N <repetitions>]
+ *	lat_unix -r [-w write|writev] [-b <batch>] [-m <message size>] [...]
+ *
+ * With -r, messages are streamed one way instead of ping-ponged, and
+ * the result is messages per second and the sender and receiver CPU
+ * time per message.  Each benchmark iteration sends <batch> messages,
+ * with one write() each or with a single writev().
  *
  * Copyright (c) 1994-2000 Carl Staelin and Larry McVoy.  
  * Distributed under the FSF GPL with additional restriction that 
@@ -12,16 +18,35 @@
  */
 char	*id = "$Id$\n";
 #include "bench.h"
+#include <sys/uio.h>
+
+#define	MAX_BATCH	1024
+#define	SINKBUF		(64 * 1024)
+
+/* -r: what each benchmark process did, for the parent to report */
+typedef struct _usage {
+	uint64	msgs;
+	uint64	usecs;		/* sender CPU */
+	uint64	rusecs;		/* receiver CPU */
+} usage_t;
 
 struct _state {
 	int	sv[2];
 	int	pid;
 	int	msize;
 	char*	buf;
+	int	rate;
+	int	writev;
+	int	batch;
+	struct iovec *iov;
+	uint64	msgs;
+	usage_t	*usage;
 };
 void	initialize(iter_t iterations, void* cookie);
 void	benchmark(iter_t iterations, void* cookie);
+void	benchmark_rate(iter_t iterations, void* cookie);
 void	cleanup(iter_t iterations, void* cookie);
+void	sink(int sock, char *buf);
 
 int
 main(int ac, char **av)
@@ -30,17 +55,33 @@ main(int ac, char **av)
 	int warmup = 0;
 	int repetitions = -1;
 	struct _state state;
-	int c;
-	char* usage = "[-m <message size>] [-P <parallelism>] [-W <warmup>] [-N <repetitions>]\n";
+	int c, i;
+	char* usage = "[-m <message size>] [-P <parallelism>] [-W <warmup>] [-N <repetitions>]\n OR -r [-w write|writev] [-b <batch>] [-m <message size>] [-P <parallelism>] [-W <warmup>] [-N <repetitions>]\n";
 
 	state.msize = 1;
 	state.pid = 0;
+	state.rate = 0;
+	state.writev = 0;
+	state.batch = 1;
 
-	while (( c = getopt(ac, av, "m:P:W:N:")) != EOF) {
+	while (( c = getopt(ac, av, "m:rw:b:P:W:N:")) != EOF) {
 		switch(c) {
 		case 'm':
 			state.msize = atoi(optarg);
 			break;
+		case 'r':
+			state.rate = 1;
+			break;
+		case 'w':
+			if (!strcmp(optarg, "write")) state.writev = 0;
+			else if (!strcmp(optarg, "writev")) state.writev = 1;
+			else lmbench_usage(ac, av, usage);
+			break;
+		case 'b':
+			state.batch = atoi(optarg);
+			if (state.batch <= 0 || state.batch > MAX_BATCH)
+				lmbench_usage(ac, av, usage);
+			break;
 		case 'P':
 			parallel = atoi(optarg);
 			if (parallel <= 0) lmbench_usage(ac, av, usage);
@@ -56,10 +97,40 @@ main(int ac, char **av)
 			break;
 		}
 	}
-	if (optind < ac) {
+	if (optind < ac || state.msize <= 0) {
 		lmbench_usage(ac, av, usage);
 	}
 
+	if (state.rate) {
+		uint64	msgs = 0, usecs = 0, rusecs = 0;
+
+		state.usage = (usage_t*)mmap(0, parallel * sizeof(usage_t),
+					     PROT_READ|PROT_WRITE,
+					     MAP_SHARED|MAP_ANON, -1, 0);
+		if (state.usage == (usage_t*)MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+		bzero(state.usage, parallel * sizeof(usage_t));
+		benchmp(initialize, benchmark_rate, cleanup, 0, parallel,
+			warmup, repetitions, &state);
+		if (gettime() == 0) return (1);
+		for (i = 0; i < parallel; ++i) {
+			msgs += state.usage[i].msgs;
+			usecs += state.usage[i].usecs;
+			rusecs += state.usage[i].rusecs;
+		}
+		if (msgs == 0) msgs = 1;
+		fprintf(stderr, "AF_UNIX sock stream message rate: %d byte messages, %s x %d: %.0f messages/sec, %.3f sender + %.3f receiver CPU microseconds/message\n",
+			state.msize, state.writev ? "writev" : "write",
+			state.batch,
+			(double)get_n() * state.batch * parallel * 1000000.
+			/ (double)gettime(),
+			(double)usecs / (double)msgs,
+			(double)rusecs / (double)msgs);
+		return (0);
+	}
+
 	benchmp(initialize, benchmark, cleanup, 0, parallel, 
 		warmup, repetitions, &state);
 
@@ -85,6 +156,21 @@ initialize(iter_t iterations, void* cookie)
 	}
 	handle_scheduler(benchmp_childid(), 0, 1);
 
+	if (pState->rate) {
+		int	i;
+
+		pState->msgs = 0;
+		pState->iov = (struct iovec*)malloc(pState->batch * sizeof(struct iovec));
+		if (!pState->iov) {
+			perror("malloc");
+			exit(1);
+		}
+		for (i = 0; i < pState->batch; ++i) {
+			pState->iov[i].iov_base = pState->buf;
+			pState->iov[i].iov_len = pState->msize;
+		}
+	}
+
 	if (pState->pid = fork())
 		return;
 
@@ -92,6 +178,9 @@ initialize(iter_t iterations, void* cookie)
 
 	/* Child sits and ping-pongs packets back to parent */
 	signal(SIGTERM, exit);
+	if (pState->rate) {
+		sink(pState->sv[0], pState->buf);
+	}
 	while (read(pState->sv[0], pState->buf, pState->msize) == pState->msize) {
 		write(pState->sv[0], pState->buf, pState->msize);
 	}
@@ -113,6 +202,66 @@ benchmark(iter_t iterations, void* cookie)
 	}
 }
 
+/*
+ * Send iterations * batch messages, preceded by their total size, and
+ * wait for the child to say it has read them all.
+ */
+void
+benchmark_rate(iter_t iterations, void* cookie)
+{
+	struct _state* pState = (struct _state*)cookie;
+	int	i, sock = pState->sv[1];
+	int	msize = pState->msize;
+	uint64	total = (uint64)iterations * pState->batch * msize;
+	char	c;
+
+	pState->msgs += (uint64)iterations * pState->batch;
+	if (write(sock, &total, sizeof(total)) != sizeof(total)) {
+		perror("lat_unix: write");
+		exit(1);
+	}
+	while (iterations-- > 0) {
+		if (pState->writev) {
+			if (writev(sock, pState->iov, pState->batch) != pState->batch * msize) {
+				perror("lat_unix: writev");
+				exit(1);
+			}
+			continue;
+		}
+		for (i = 0; i < pState->batch; ++i) {
+			if (write(sock, pState->buf, msize) != msize) {
+				perror("lat_unix: write");
+				exit(1);
+			}
+		}
+	}
+	if (read(sock, &c, 1) != 1) {
+		perror("lat_unix: read");
+		exit(1);
+	}
+}
+
+void
+sink(int sock, char *buf)
+{
+	int	n;
+	uint64	left;
+	char	*p = (char*)malloc(SINKBUF);
+
+	if (!p) {
+		perror("malloc");
+		exit(1);
+	}
+	while (read(sock, &left, sizeof(left)) == sizeof(left)) {
+		for (; left > 0; left -= n) {
+			n = read(sock, p, left < SINKBUF ? left : SINKBUF);
+			if (n <= 0) exit(0);
+		}
+		if (write(sock, buf, 1) != 1) exit(0);
+	}
+	exit(0);
+}
+
 void
 cleanup(iter_t iterations, void* cookie)
 {
@@ -125,5 +274,13 @@ cleanup(iter_t iterations, void* cookie)
 		waitpid(pState->pid, NULL, 0);
 		pState->pid = 0;
 	}
+	if (pState->rate) {
+		/* the receiver has been waited for, so its time is in CHILDREN */
+		usage_t	*u = &pState->usage[benchmp_childid()];
+
+		u->msgs = pState->msgs;
+		u->usecs = cpu_usecs(RUSAGE_SELF);
+		u->rusecs = cpu_usecs(RUSAGE_CHILDREN);
+	}
 }
 
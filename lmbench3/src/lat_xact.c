@@ -0,0 +1,495 @@
+/*
+ * lat_xact.c - pipelined request/response latency and throughput
+ *
+ * Three programs in one -
+ *	server usage:	lat_xact -s [-u] [path]
+ *	client usage:	lat_xact [-m <request size>] [-M <response size>] [-d <depth>] [-c <connections>] [-P <parallelism>] [-t <seconds>] hostname
+ *			lat_xact -u [...] [path]
+ *	shutdown:	lat_xact -S [-u] [hostname|path]
+ *
+ * A minimal binary RPC over TCP or, with -u, Unix domain sockets,
+ * which needs neither SunRPC nor the portmapper.  Every message is an
+ * 8 byte header, the payload length and the length of the reply
+ * wanted, both in network byte order, followed by the payload.  The
+ * server answers each request in order, batching the replies to all
+ * of the requests it finds in one read into a single write.
+ *
+ * Each of <parallelism> client processes opens <connections>
+ * connections and keeps <depth> calls outstanding on each of them for
+ * a fixed time, timing every call from when it is issued until its
+ * reply has been read.  The result is the aggregate call rate and the
+ * median, 99th and 99.9th percentile call latency.
+ *
+ * Copyright (c) 1994 Larry McVoy.  Distributed under the FSF GPL with
+ * additional restriction that results may published only if
+ * (1) the benchmark is unmodified, and
+ * (2) the version in the sccsid below is included in the report.
+ */
+char	*id = "$Id$\n";
+
+#include "bench.h"
+#include <poll.h>
+#include <netinet/tcp.h>
+
+#define	HDR	(2 * sizeof(int))
+#define	RBUF	(64 * 1024)
+
+typedef struct _conn {
+	int	fd;
+	int	outstanding;	/* calls issued without a reply */
+	int	head;		/* oldest outstanding call in start[] */
+	uint64	wleft;		/* bytes of issued calls not yet written */
+	uint64	written;
+	uint64	rgot;		/* bytes of the current reply */
+	uint64	*start;		/* when each outstanding call was issued */
+} conn_t;
+
+typedef struct _state {
+	int	unixsock;
+	char	*server;
+	int	msize;		/* request payload */
+	int	rsize;		/* response payload */
+	int	depth;
+	int	nconns;
+} state_t;
+
+void	server_main(state_t *state);
+void	doserver(state_t *state, int sock);
+int	connect_server(state_t *state);
+void	call(state_t *state, int sock, char *buf);
+void	rate(state_t *state, int parallel, uint64 nsecs);
+void	client(state_t *state, int go, int out, uint64 nsecs);
+
+int
+main(int ac, char **av)
+{
+	state_t state;
+	int	server = 0;
+	int	shutdown = 0;
+	int	parallel = 1;
+	int	seconds = 1;
+	int 	c;
+	char	*usage = "-s [-u] [path]\n OR [-u] [-m <request size>] [-M <response size>] [-d <depth>] [-c <connections>] [-P <parallelism>] [-t <seconds>] server|path\n OR -S [-u] server|path\n";
+
+	state.unixsock = 0;
+	state.server = NULL;
+	state.msize = 64;
+	state.rsize = 64;
+	state.depth = 1;
+	state.nconns = 1;
+
+	while (( c = getopt(ac, av, "sSum:M:d:c:P:t:")) != EOF) {
+		switch(c) {
+		case 's': /* Server */
+			server = 1;
+			break;
+		case 'S': /* shutdown serverhost */
+			shutdown = 1;
+			break;
+		case 'u':
+			state.unixsock = 1;
+			break;
+		case 'm':
+			state.msize = bytes(optarg);
+			if (state.msize < 0) lmbench_usage(ac, av, usage);
+			break;
+		case 'M':
+			state.rsize = bytes(optarg);
+			if (state.rsize < 0) lmbench_usage(ac, av, usage);
+			break;
+		case 'd':
+			state.depth = atoi(optarg);
+			if (state.depth <= 0) lmbench_usage(ac, av, usage);
+			break;
+		case 'c':
+			state.nconns = atoi(optarg);
+			if (state.nconns <= 0) lmbench_usage(ac, av, usage);
+			break;
+		case 'P':
+			parallel = atoi(optarg);
+			if (parallel <= 0) lmbench_usage(ac, av, usage);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			if (seconds <= 0) lmbench_usage(ac, av, usage);
+			break;
+		default:
+			lmbench_usage(ac, av, usage);
+			break;
+		}
+	}
+
+	if (optind < ac - 1 || (optind == ac && !state.unixsock && !server)) {
+		lmbench_usage(ac, av, usage);
+	}
+	if (optind < ac) {
+		state.server = av[optind];
+	} else if (state.unixsock) {
+		state.server = UNIX_RPC;
+	}
+
+	if (server) {
+		if (fork() == 0) {
+			server_main(&state);
+		}
+		exit(0);
+	}
+	if (shutdown) {
+		close(connect_server(&state));
+		exit(0);
+	}
+
+	rate(&state, parallel, (uint64)seconds * 1000000000);
+	exit(0);
+}
+
+int
+connect_server(state_t *state)
+{
+	int	sock;
+
+	if (state->unixsock) {
+		return (unix_connect(state->server));
+	}
+	sock = tcp_connect(state->server, TCP_RPC, SOCKOPT_NONE);
+	if (sock >= 0) {
+		int	one = 1;
+
+		setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	}
+	return (sock);
+}
+
+/*
+ * Run <parallel> client processes for nsecs and report the call rate
+ * and latency distribution over all of them.
+ */
+void
+rate(state_t *state, int parallel, uint64 nsecs)
+{
+	int	i, n;
+	int	go[2];
+	int	*fds;
+	pid_t	*pids;
+	uint64	hdr[2];
+	uint64	count = 0;
+	uint64	size = 0;
+	uint64	*samples = NULL;
+	double	cps = 0.;
+	char	*p;
+
+	fds = (int*)malloc(parallel * sizeof(int));
+	pids = (pid_t*)malloc(parallel * sizeof(pid_t));
+	if (!fds || !pids || pipe(go) < 0) {
+		perror("lat_xact");
+		exit(1);
+	}
+	for (i = 0; i < parallel; ++i) {
+		int	r[2];
+
+		if (pipe(r) < 0) {
+			perror("pipe");
+			exit(1);
+		}
+		switch (pids[i] = fork()) {
+		case -1:
+			perror("fork");
+			exit(1);
+		case 0:
+			close(go[1]);
+			close(r[0]);
+			client(state, go[0], r[1], nsecs);
+			exit(0);
+		default:
+			close(r[1]);
+			fds[i] = r[0];
+			break;
+		}
+	}
+	/* closing the pipe starts all the clients at once */
+	close(go[0]);
+	close(go[1]);
+
+	for (i = 0; i < parallel; ++i) {
+		/* { calls, elapsed nsecs } then samples */
+		if (read(fds[i], hdr, sizeof(hdr)) != sizeof(hdr)) {
+			fprintf(stderr, "lat_xact: client %d failed\n", i);
+			exit(1);
+		}
+		samples = (uint64*)realloc(samples,
+				(count + hdr[0] + 1) * sizeof(uint64));
+		if (!samples) {
+			perror("realloc");
+			exit(1);
+		}
+		p = (char*)(samples + count);
+		for (size = hdr[0] * sizeof(uint64); size > 0; size -= n) {
+			if ((n = read(fds[i], p, size)) <= 0) {
+				fprintf(stderr, "lat_xact: client %d failed\n", i);
+				exit(1);
+			}
+			p += n;
+		}
+		close(fds[i]);
+		waitpid(pids[i], NULL, 0);
+		if (hdr[1] > 0) cps += (double)hdr[0] * 1.0e9 / (double)hdr[1];
+		count += hdr[0];
+	}
+
+	fprintf(stderr, "%s RPC using %s: %d x %d connections, depth %d, %d/%d bytes: %.0f calls/sec, p50 %.2f p99 %.2f p99.9 %.2f microseconds\n",
+		state->unixsock ? "Unix" : "TCP", state->server,
+		parallel, state->nconns, state->depth,
+		state->msize, state->rsize, cps,
+		(double)uint64_percentile(50., samples, count) / 1000.,
+		(double)uint64_percentile(99., samples, count) / 1000.,
+		(double)uint64_percentile(99.9, samples, count) / 1000.);
+	free(samples);
+	free(pids);
+	free(fds);
+}
+
+void
+client(state_t *state, int go, int out, uint64 nsecs)
+{
+	int	i, n;
+	char	c;
+	char	*p, *req, *rbuf;
+	size_t	reqlen = HDR + state->msize;
+	size_t	replen = HDR + state->rsize;
+	size_t	size = 1024;
+	uint64	hdr[2];
+	uint64	start, t, deadline;
+	uint64	*samples = (uint64*)malloc(size * sizeof(uint64));
+	conn_t	*conns = (conn_t*)calloc(state->nconns, sizeof(conn_t));
+	struct pollfd *pfds = (struct pollfd*)calloc(state->nconns, sizeof(struct pollfd));
+
+	/* a buffer of <depth> requests, so any batch is a single write */
+	req = (char*)malloc(reqlen * state->depth);
+	rbuf = (char*)malloc(RBUF > replen ? RBUF : replen);
+	if (!samples || !conns || !pfds || !req || !rbuf) {
+		perror("malloc");
+		exit(1);
+	}
+	bzero(req, reqlen * state->depth);
+	for (i = 0; i < state->depth; ++i) {
+		int	*h = (int*)(req + i * reqlen);
+
+		h[0] = htonl(state->msize);
+		h[1] = htonl(state->rsize);
+	}
+
+	/* connect, and make one call on each connection, before the clock starts */
+	for (i = 0; i < state->nconns; ++i) {
+		if ((conns[i].fd = connect_server(state)) < 0) {
+			perror("lat_xact: connect");
+			exit(1);
+		}
+		call(state, conns[i].fd, rbuf);
+		fcntl(conns[i].fd, F_SETFL, fcntl(conns[i].fd, F_GETFL) | O_NONBLOCK);
+		conns[i].start = (uint64*)malloc(state->depth * sizeof(uint64));
+		if (!conns[i].start) {
+			perror("malloc");
+			exit(1);
+		}
+		pfds[i].fd = conns[i].fd;
+	}
+	hdr[0] = 0;
+	(void)read(go, &c, 1);
+
+	start = now_nsecs();
+	deadline = start + nsecs;
+	while ((t = now_nsecs()) < deadline) {
+		for (i = 0; i < state->nconns; ++i) {
+			conn_t	*cp = &conns[i];
+
+			/* keep <depth> calls outstanding */
+			while (cp->outstanding < state->depth) {
+				cp->start[(cp->head + cp->outstanding++) % state->depth] = t;
+				cp->wleft += reqlen;
+			}
+			if (cp->wleft) {
+				size_t	off = cp->written % reqlen;
+				size_t	len = reqlen * state->depth - off;
+
+				if (len > cp->wleft) len = cp->wleft;
+				if ((n = write(cp->fd, req + off, len)) > 0) {
+					cp->wleft -= n;
+					cp->written += n;
+				} else if (n < 0 && errno != EAGAIN) {
+					perror("lat_xact: write");
+					exit(1);
+				}
+			}
+			pfds[i].events = POLLIN | (cp->wleft ? POLLOUT : 0);
+			pfds[i].revents = 0;
+		}
+		if (poll(pfds, state->nconns, 100) < 0) {
+			if (errno == EINTR) continue;
+			perror("poll");
+			exit(1);
+		}
+		for (i = 0; i < state->nconns; ++i) {
+			conn_t	*cp = &conns[i];
+
+			if (!(pfds[i].revents & (POLLIN|POLLERR|POLLHUP)))
+				continue;
+			if ((n = read(cp->fd, rbuf, RBUF)) <= 0) {
+				if (n < 0 && errno == EAGAIN) continue;
+				fprintf(stderr, "lat_xact: lost connection\n");
+				exit(1);
+			}
+			t = now_nsecs();
+			for (cp->rgot += n; cp->rgot >= replen; cp->rgot -= replen) {
+				if (hdr[0] == size) {
+					size *= 2;
+					samples = (uint64*)realloc(samples, size * sizeof(uint64));
+					if (!samples) {
+						perror("realloc");
+						exit(1);
+					}
+				}
+				samples[hdr[0]++] = t - cp->start[cp->head];
+				cp->head = (cp->head + 1) % state->depth;
+				cp->outstanding--;
+			}
+		}
+	}
+	hdr[1] = now_nsecs() - start;
+
+	if (write(out, hdr, sizeof(hdr)) != sizeof(hdr)) exit(1);
+	p = (char*)samples;
+	for (size = hdr[0] * sizeof(uint64); size > 0; size -= n) {
+		if ((n = write(out, p, size)) <= 0) exit(1);
+		p += n;
+	}
+	close(out);
+}
+
+/*
+ * One synchronous call on a blocking socket.
+ */
+void
+call(state_t *state, int sock, char *buf)
+{
+	int	n;
+	int	h[2];
+	size_t	left;
+
+	h[0] = htonl(0);
+	h[1] = htonl(state->rsize);
+	if (write(sock, h, sizeof(h)) != sizeof(h)) {
+		perror("lat_xact: write");
+		exit(1);
+	}
+	for (left = HDR + state->rsize; left > 0; left -= n) {
+		if ((n = read(sock, buf, left < RBUF ? left : RBUF)) <= 0) {
+			perror("lat_xact: read");
+			exit(1);
+		}
+	}
+}
+
+void
+server_main(state_t *state)
+{
+	int     newsock, sock;
+
+	GO_AWAY;
+	signal(SIGCHLD, sigchld_wait_handler);
+	if (state->unixsock) {
+		sock = unix_server(state->server);
+	} else {
+		sock = tcp_server(TCP_RPC, SOCKOPT_REUSE);
+	}
+	for (;;) {
+		if (state->unixsock) {
+			newsock = unix_accept(sock);
+		} else {
+			int	one = 1;
+
+			newsock = tcp_accept(sock, SOCKOPT_NONE);
+			setsockopt(newsock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		}
+		switch (fork()) {
+		    case -1:
+			perror("fork");
+			break;
+		    case 0:
+			doserver(state, newsock);
+			if (state->unixsock) {
+				unix_done(sock, state->server);
+			} else {
+				tcp_done(TCP_RPC);
+			}
+			kill(getppid(), SIGTERM);
+			exit(0);
+		    default:
+			close(newsock);
+			break;
+		}
+	}
+	/* NOTREACHED */
+}
+
+/*
+ * Answer requests until the client goes away, and return only if the
+ * connection carried no requests at all, which means shut down.
+ */
+void
+doserver(state_t *state, int sock)
+{
+	int	n;
+	int	calls = 0;
+	size_t	have = 0, used, outlen;
+	size_t	insize = RBUF, outsize = RBUF;
+	char	*in = (char*)malloc(insize);
+	char	*out = (char*)malloc(outsize);
+
+	if (!in || !out) {
+		perror("malloc");
+		exit(4);
+	}
+	while ((n = read(sock, in + have, insize - have)) > 0) {
+		have += n;
+		used = outlen = 0;
+		while (have - used >= HDR) {
+			int	*h = (int*)(in + used);
+			size_t	len = ntohl(h[0]);
+			size_t	rlen = ntohl(h[1]);
+
+			if (HDR + len > insize) {
+				insize = HDR + len;
+				if (!(in = (char*)realloc(in, insize))) {
+					perror("realloc");
+					exit(4);
+				}
+			}
+			if (have - used < HDR + len) break;
+			used += HDR + len;
+
+			if (outlen + HDR + rlen > outsize) {
+				outsize = 2 * (outlen + HDR + rlen);
+				if (!(out = (char*)realloc(out, outsize))) {
+					perror("realloc");
+					exit(4);
+				}
+			}
+			h = (int*)(out + outlen);
+			h[0] = htonl(rlen);
+			h[1] = 0;
+			outlen += HDR + rlen;
+			calls++;
+		}
+		if (used) {
+			have -= used;
+			memmove(in, in + used, have);
+		}
+		for (used = 0; used < outlen; used += n) {
+			if ((n = write(sock, out + used, outlen - used)) <= 0)
+				exit(0);
+		}
+	}
+	if (calls) exit(0);
+	free(in);
+	free(out);
+}
@@ -12,7 +12,20 @@
  * Support for this development by Sun Microsystems is gratefully acknowledged.
  */
 
+#if defined(linux) || defined(__linux__)
+#define _GNU_SOURCE	/* sched_getcpu, CPU_AND, MAP_HUGETLB */
+#endif
+
 #include "bench.h"
+#include <string.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#if defined(HAVE_SCHED_SETAFFINITY)
+#include <sched.h>
+#include <dirent.h>
+#endif
 
 #define	FIVE(m)		m m m m m
 #define	TEN(m)		FIVE(m) FIVE(m)
@@ -67,6 +80,203 @@ MEM_BENCHMARK_DEF(15, REPEAT_15, DEREF)
 
 size_t*	words_initialize(size_t max, int scale);
 
+/*
+ * Chains for large working sets are built by several threads, each
+ * handling a contiguous range of the pages.  The random numbers come
+ * from a counter-based generator, so the chain is the same whatever
+ * the number of threads.  Each page is first touched by the thread
+ * that writes the chain into it, so the threads are kept on the NUMA
+ * node where the caller (and so the benchmark) is running.
+ */
+#define	MEM_PARALLEL_MIN	(16 * 1024 * 1024)
+#define	MEM_MAX_THREADS		64
+
+/*
+ * Walking the whole chain once to clear the cache is the slowest part
+ * of setting up a large chain, but the caches can only hold the end of
+ * the walk anyway, so walk at most this many bytes worth of lines.
+ */
+#define	MEM_WARMUP_MAX		(256 * 1024 * 1024)
+
+typedef struct _mem_work {
+	mem_range_f	f;
+	void*		cookie;
+	size_t		start;
+	size_t		end;
+#ifdef HAVE_PTHREAD
+	pthread_t	thread;
+#endif
+} mem_work_t;
+
+/*
+ * splitmix64: the i'th random number of the stream named by seed
+ */
+uint64
+mem_random(uint64 seed, uint64 i)
+{
+	uint64	z = seed + (i + 1) * 0x9e3779b97f4a7c15ULL;
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return (z ^ (z >> 31));
+}
+
+/*
+ * Returns the i'th element of a random permutation of [0, n) without
+ * keeping any state: a four round Feistel network on the smallest even
+ * number of bits covering n, cycle-walking until the value falls
+ * inside [0, n).  Each seed gives a different permutation.
+ */
+size_t
+mem_permute(size_t i, size_t n, uint64 seed)
+{
+	int	half, r;
+	uint64	mask, left, right, t, x = i;
+
+	if (n <= 1) return (0);
+	for (half = 1; ((uint64)1 << (2 * half)) < n; ++half)
+		;
+	mask = ((uint64)1 << half) - 1;
+	do {
+		left = x >> half;
+		right = x & mask;
+		for (r = 0; r < 4; ++r) {
+			t = left ^ (mem_random(seed ^ ((uint64)r << 56), right) & mask);
+			left = right;
+			right = t;
+		}
+		x = (left << half) | right;
+	} while (x >= n);
+	return ((size_t)x);
+}
+
+#if defined(HAVE_PTHREAD) && defined(HAVE_SCHED_SETAFFINITY) && defined(CPU_AND)
+/*
+ * The CPUs we may run on which share a NUMA node with the CPU we are
+ * running on now, according to /sys/devices/system/node.
+ */
+static int
+mem_node_cpus(cpu_set_t* set)
+{
+	int	cpu, lo, hi, c;
+	char	path[256];
+	FILE*	f;
+	DIR*	dir;
+	struct dirent* d;
+	cpu_set_t node;
+
+	if (sched_getaffinity(0, sizeof(cpu_set_t), set) < 0) return (0);
+	if ((cpu = sched_getcpu()) < 0
+	    || !(dir = opendir("/sys/devices/system/node")))
+		return (CPU_COUNT(set));
+
+	while ((d = readdir(dir)) != NULL) {
+		if (strncmp(d->d_name, "node", 4) || !isdigit(d->d_name[4]))
+			continue;
+		sprintf(path, "/sys/devices/system/node/%.64s/cpulist", d->d_name);
+		if (!(f = fopen(path, "r"))) continue;
+		CPU_ZERO(&node);
+		while (fscanf(f, "%d", &lo) == 1) {
+			hi = lo;
+			if ((c = fgetc(f)) == '-') {
+				if (fscanf(f, "%d", &hi) != 1) break;
+				c = fgetc(f);
+			}
+			for (; lo <= hi && lo < CPU_SETSIZE; ++lo)
+				CPU_SET(lo, &node);
+			if (c != ',') break;
+		}
+		fclose(f);
+		if (CPU_ISSET(cpu, &node)) {
+			CPU_AND(set, set, &node);
+			break;
+		}
+	}
+	closedir(dir);
+	return (CPU_COUNT(set));
+}
+#endif
+
+#ifdef HAVE_PTHREAD
+static void*
+mem_worker(void* cookie)
+{
+	mem_work_t* w = (mem_work_t*)cookie;
+
+	(*w->f)(w->start, w->end, w->cookie);
+	return (NULL);
+}
+#endif
+
+/*
+ * Call f on ranges covering [0, n).  Setting up bytes of memory is
+ * worth a few threads only if it is large; otherwise f is called
+ * once, here.
+ */
+void
+mem_parallel(size_t n, size_t bytes, mem_range_f f, void* cookie)
+{
+	int	i, nthreads = 1;
+	mem_work_t work[MEM_MAX_THREADS];
+#ifdef HAVE_PTHREAD
+	pthread_attr_t attr;
+	int	started[MEM_MAX_THREADS];
+	int	threaded = (bytes >= MEM_PARALLEL_MIN && n > 1);
+
+	if (threaded) {
+		pthread_attr_init(&attr);
+#if defined(HAVE_SCHED_SETAFFINITY) && defined(CPU_AND)
+		{
+			cpu_set_t set;
+
+			nthreads = mem_node_cpus(&set);
+			if (nthreads > 1) {
+				pthread_attr_setaffinity_np(&attr,
+					sizeof(cpu_set_t), &set);
+			}
+		}
+#else
+		nthreads = sched_ncpus();
+#endif
+		if (nthreads > MEM_MAX_THREADS) nthreads = MEM_MAX_THREADS;
+		if (nthreads > n) nthreads = n;
+		if (nthreads < 1) nthreads = 1;
+	}
+#endif
+	for (i = 0; i < nthreads; ++i) {
+		work[i].f = f;
+		work[i].cookie = cookie;
+		work[i].start = (n * i) / nthreads;
+		work[i].end = (n * (i + 1)) / nthreads;
+	}
+#ifdef HAVE_PTHREAD
+	for (i = 1; i < nthreads; ++i) {
+		started[i] = !pthread_create(&work[i].thread, &attr,
+					     mem_worker, &work[i]);
+		if (!started[i]) mem_worker(&work[i]);
+	}
+#endif
+	(*f)(work[0].start, work[0].end, cookie);
+#ifdef HAVE_PTHREAD
+	for (i = 1; i < nthreads; ++i) {
+		if (started[i]) pthread_join(work[i].thread, NULL);
+	}
+	if (threaded) pthread_attr_destroy(&attr);
+#endif
+}
+
+/*
+ * Iterations of mem_benchmark_N which run through n elements of the
+ * chain, or MEM_WARMUP_MAX bytes worth of them
+ */
+static iter_t
+mem_warmup(size_t n, struct mem_state* state)
+{
+	if (n > MEM_WARMUP_MAX / state->line)
+		n = MEM_WARMUP_MAX / state->line;
+	return ((n + 100) / 100);
+}
+
 
 void
 mem_reset()
@@ -102,17 +312,12 @@ mem_cleanup(iter_t iterations, void* cookie)
 void
 tlb_cleanup(iter_t iterations, void* cookie)
 {
-	size_t i;
 	struct mem_state* state = (struct mem_state*)cookie;
-	char **addr = (char**)state->addr;
 
 	if (iterations) return;
 
-	if (addr) {
-		for (i = 0; i < state->npages; ++i) {
-			if (addr[i]) free(addr[i]);
-		}
-		free(addr);
+	if (state->addr) {
+		munmap(state->addr, state->maplen);
 		state->addr = NULL;
 	}
 	if (state->pages) {
@@ -182,29 +387,143 @@ base_initialize(iter_t iterations, void* cookie)
  * algorithms.  It should be easily and correctly predicted
  * by any decent hardware prefetch algorithm.
  */
-void
-stride_initialize(iter_t iterations, void* cookie)
+static void
+stride_chain(size_t start, size_t end, void* cookie)
 {
 	struct mem_state* state = (struct mem_state*)cookie;
 	size_t	i;
-	size_t	range = state->len;
 	size_t	stride = state->line;
-	char*	addr;
+	size_t	n = (state->len + stride - 1) / stride;
+	char*	addr = state->base;
+
+	for (i = start; i < end; ++i) {
+		*(char **)&addr[i * stride] = 
+			(char*)&addr[i < n - 1 ? (i + 1) * stride : 0];
+	}
+}
+
+void
+stride_initialize(iter_t iterations, void* cookie)
+{
+	struct mem_state* state = (struct mem_state*)cookie;
 
 	base_initialize(iterations, cookie);
 	if (!state->initialized) return;
-	addr = state->base;
 
-	for (i = stride; i < range; i += stride) {
-		*(char **)&addr[i - stride] = (char*)&addr[i];
-	}
-	*(char **)&addr[i - stride] = (char*)&addr[0];
-	state->p[0] = addr;
+	mem_parallel((state->len + state->line - 1) / state->line,
+		     state->len, stride_chain, state);
+	state->p[0] = state->base;
 	mem_reset();
 }
 
+/*
+ * Access patterns between a forward stride and a random chain, for
+ * finding out what the hardware prefetchers will follow.  Each one
+ * visits the elements of the range in the order given by
+ * pattern_offset(), with state->line as the stride:
+ *
+ * PATTERN_BACKWARD	a stride from the end of the range to the start.
+ * PATTERN_TILE		the range as a square matrix of strides, walked
+ *			one ways x ways tile at a time, row by row
+ *			within each tile.
+ * PATTERN_STREAMS	ways forward strides through ways equal parts
+ *			of the range, taking one load from each in turn.
+ * PATTERN_PAGES	a stride of a page plus state->line, so that
+ *			every load is in a new page.
+ * PATTERN_INPAGE	the pages in order, and the strides within each
+ *			page in a random order.
+ */
+static size_t
+pattern_count(struct mem_state* state)
+{
+	size_t	n = state->len / state->line;
+	size_t	width, per;
+
+	switch (state->pattern) {
+	case PATTERN_TILE:
+		for (width = 1; 4 * width * width <= n; width *= 2)
+			;
+		per = state->ways < width ? state->ways : width;
+		n = n / width / per * per * width;
+		break;
+	case PATTERN_STREAMS:
+		n = n / state->ways * state->ways;
+		break;
+	case PATTERN_PAGES:
+		n = state->len / (state->pagesize + state->line);
+		break;
+	case PATTERN_INPAGE:
+		per = state->pagesize / state->line;
+		if (state->len >= state->pagesize)
+			n = state->len / state->pagesize * per;
+		break;
+	}
+	return (n ? n : 1);
+}
+
+static size_t
+pattern_offset(struct mem_state* state, size_t i, size_t n)
+{
+	size_t	width, tile, per, t, w;
+
+	switch (state->pattern) {
+	case PATTERN_BACKWARD:
+		return ((n - 1 - i) * state->line);
+	case PATTERN_TILE:
+		for (width = 1; 4 * width * width <= n; width *= 2)
+			;
+		tile = state->ways < width ? state->ways : width;
+		t = i / (tile * tile);
+		w = i % (tile * tile);
+		return (((t / (width / tile) * tile + w / tile) * width
+			 + t % (width / tile) * tile + w % tile)
+			* state->line);
+	case PATTERN_STREAMS:
+		per = n / state->ways;
+		return ((i % state->ways * per + i / state->ways)
+			* state->line);
+	case PATTERN_PAGES:
+		return (i * (state->pagesize + state->line));
+	case PATTERN_INPAGE:
+		per = state->pagesize / state->line;
+		if (n < per) per = n;
+		return ((i / per) * state->pagesize
+			+ mem_permute(i % per, per, i / per) * state->line);
+	}
+	return (i * state->line);
+}
+
+static void
+pattern_chain(size_t start, size_t end, void* cookie)
+{
+	struct mem_state* state = (struct mem_state*)cookie;
+	size_t	i;
+	size_t	n = pattern_count(state);
+	char*	addr = state->base;
+
+	for (i = start; i < end; ++i) {
+		*(char **)&addr[pattern_offset(state, i, n)] =
+			&addr[pattern_offset(state, (i + 1) % n, n)];
+	}
+}
+
 void
-thrash_initialize(iter_t iterations, void* cookie)
+pattern_initialize(iter_t iterations, void* cookie)
+{
+	struct mem_state* state = (struct mem_state*)cookie;
+	size_t	n;
+
+	base_initialize(iterations, cookie);
+	if (!state->initialized) return;
+
+	n = pattern_count(state);
+	mem_parallel(n, state->len, pattern_chain, state);
+	state->p[0] = state->base + pattern_offset(state, 0, n);
+	mem_reset();
+}
+
+static void
+thrash_chain(size_t start, size_t end, void* cookie)
 {
 	struct mem_state* state = (struct mem_state*)cookie;
 	size_t	i;
@@ -213,11 +532,42 @@ thrash_initialize(iter_t iterations, void* cookie)
 	size_t	next;
 	size_t	cpage;
 	size_t	npage;
-	char*	addr;
+	char*	addr = state->base;
+
+	if (state->len % state->pagesize) {
+		for (i = start; i < end; ++i) {
+			next = (i < state->nwords - 1) ? state->words[i+1] : 0;
+			*(char **)&addr[state->words[i]] = (char*)&addr[next];
+		}
+		return;
+	}
+	for (i = start; i < end; ++i) {
+		cpage = state->pages[i];
+		if (i < state->npages - 1) {
+			npage = state->pages[i + 1];
+			for (j = 0; j < state->nwords; ++j) {
+				cur = cpage + state->words[(i + j) % state->nwords];
+				next = npage + state->words[(i + j + 1) % state->nwords];
+				*(char **)&addr[cur] = (char*)&addr[next];
+			}
+		} else {
+			npage = state->pages[0];
+			for (j = 0; j < state->nwords; ++j) {
+				cur = cpage + state->words[(i + j) % state->nwords];
+				next = npage + state->words[(j + 1) % state->nwords];
+				*(char **)&addr[cur] = (char*)&addr[next];
+			}
+		}
+	}
+}
+
+void
+thrash_initialize(iter_t iterations, void* cookie)
+{
+	struct mem_state* state = (struct mem_state*)cookie;
 
 	base_initialize(iterations, cookie);
 	if (!state->initialized) return;
-	addr = state->base;
 
 	/*
 	 * Create a circular list of pointers with a random access
@@ -239,11 +589,8 @@ thrash_initialize(iter_t iterations, void* cookie)
 			perror("thrash_initialize: malloc");
 			exit(1);
 		}
-		for (i = 0; i < state->nwords - 1; ++i) {
-			*(char **)&addr[state->words[i]] = (char*)&addr[state->words[i+1]];
-		}
-		*(char **)&addr[state->words[i]] = addr;
-		state->p[0] = addr;
+		mem_parallel(state->nwords, state->len, thrash_chain, state);
+		state->p[0] = state->base;
 	} else {
 		state->nwords = state->pagesize / state->line;
 		state->words = words_initialize(state->nwords, state->line);
@@ -251,23 +598,8 @@ thrash_initialize(iter_t iterations, void* cookie)
 			perror("thrash_initialize: malloc");
 			exit(2);
 		}
-		for (i = 0; i < state->npages - 1; ++i) {
-			cpage = state->pages[i];
-			npage = state->pages[i + 1];
-			for (j = 0; j < state->nwords; ++j) {
-				cur = cpage + state->words[(i + j) % state->nwords];
-				next = npage + state->words[(i + j + 1) % state->nwords];
-				*(char **)&addr[cur] = (char*)&addr[next];
-			}
-		}
-		cpage = state->pages[i];
-		npage = state->pages[0];
-		for (j = 0; j < state->nwords; ++j) {
-			cur = cpage + state->words[(i + j) % state->nwords];
-			next = npage + state->words[(j + 1) % state->nwords];
-			*(char **)&addr[cur] = (char*)&addr[next];
-		}
-		state->p[0] = (char*)&addr[state->pages[0]];
+		mem_parallel(state->npages, state->len, thrash_chain, state);
+		state->p[0] = (char*)&state->base[state->pages[0]];
 	}
 	mem_reset();
 }
@@ -288,15 +620,58 @@ thrash_initialize(iter_t iterations, void* cookie)
  * It initializes state->width pointers to elements evenly
  * spaced through the chain.
  */
+static void
+mem_chain(size_t start, size_t end, void* cookie)
+{
+	struct mem_state* state = (struct mem_state*)cookie;
+	size_t	i, j, k, l, nw;
+	size_t	nwords = state->nwords;
+	size_t	nlines = state->nlines;
+	size_t	npages = state->npages;
+	size_t	npointers = state->len / state->line;
+	size_t*	pages = state->pages;
+	size_t*	lines = state->lines;
+	size_t*	words = state->words;
+	char*	p = state->base;
+
+	for (i = start; i < end; ++i) {
+		/* the run through the lines of the page */
+		l = i * (nlines - 1);
+		for (j = 0; j < nlines - 1 && l < npointers - 1; ++j, ++l) {
+			for (k = 0; k < state->line; k += sizeof(char*)) {
+				*(char**)(p + pages[i] + lines[j] + k) =
+					p + pages[i] + lines[j+1] + k;
+			}
+			if (l % (npointers/state->width) == 0
+			    && l / (npointers/state->width) < MAX_MEM_PARALLELISM) {
+				k = l / (npointers/state->width);
+				state->p[k] = p + pages[i] + lines[j] + words[k % nwords];
+			}
+		}
+
+		/* on to the next page, or back to the next word */
+		if (i < npages - 1) {
+			for (k = 0; k < nwords; ++k) 
+				*(char**)(p + pages[i] + lines[j] + words[k]) =
+					p + pages[i+1] + lines[0] + words[k];
+		} else {
+			for (k = 0; k < nwords; ++k) {
+				nw = (k == nwords - 1) ? 0 : k + 1;
+				*(char**)(p + pages[i] + lines[j] + words[k]) =
+					p + pages[0] + lines[0] + words[nw];
+			}
+		}
+	}
+}
+
 void
 mem_initialize(iter_t iterations, void* cookie)
 {
-	size_t	  i, j, k, l, nw, nwords, nlines, npages, npointers;
+	size_t	  nwords, nlines, npointers;
 	size_t    *pages;
 	size_t    *lines;
 	size_t    *words;
 	struct mem_state* state = (struct mem_state*)cookie;
-	register char *p = 0 /* lint */;
 
 	if (iterations) return;
 
@@ -307,11 +682,9 @@ mem_initialize(iter_t iterations, void* cookie)
 	npointers = state->len / state->line;
 	nwords = state->nwords;
 	nlines = state->nlines;
-	npages = state->npages;
 	words = state->words = words_initialize(nwords, sizeof(char*));
 	lines = state->lines = words_initialize(nlines, state->line);
 	pages = state->pages;
-	p = state->base;
 
 	if (state->addr == NULL \
 	    || pages == NULL || lines == NULL || words == NULL) {
@@ -320,36 +693,11 @@ mem_initialize(iter_t iterations, void* cookie)
 	}
 
 	/* setup the run through the pages */
-	l = 0;
-	j = nlines - 1;
-	for (i = 0; i < npages; ++i) {
-		for (j = 0; j < nlines - 1 && l < npointers - 1; ++j, ++l) {
-			for (k = 0; k < state->line; k += sizeof(char*)) {
-				*(char**)(p + pages[i] + lines[j] + k) =
-					p + pages[i] + lines[j+1] + k;
-			}
-			if (l % (npointers/state->width) == 0
-			    && l / (npointers/state->width) < MAX_MEM_PARALLELISM) {
-				k = l / (npointers/state->width);
-				state->p[k] = p + pages[i] + lines[j] + words[k % nwords];
-			}
-		}
-
-		if (i < npages - 1) {
-			for (k = 0; k < nwords; ++k) 
-				*(char**)(p + pages[i] + lines[j] + words[k]) =
-					p + pages[i+1] + lines[0] + words[k];
-		}
-	}
-	for (k = 0; k < nwords; ++k) {
-		nw = (k == nwords - 1) ? 0 : k + 1;
-		*(char**)(p + pages[npages-1] + lines[j] + words[k]) =
-			p + pages[0] + lines[0] + words[nw];
-	}
+	mem_parallel(state->npages, state->len, mem_chain, state);
 
 	/* now, run through the chain once to clear the cache */
 	mem_reset();
-	(*mem_benchmarks[state->width-1])((nwords * npointers + 100) / 100, state);
+	(*mem_benchmarks[state->width-1])(mem_warmup(nwords * npointers, state), state);
 
 	state->initialized = 1;
 }
@@ -361,10 +709,34 @@ mem_initialize(iter_t iterations, void* cookie)
  * the first element of the cache line to hold the pointer.
  *
  */
+static void
+line_chain(size_t start, size_t end, void* cookie)
+{
+	struct mem_state* state = (struct mem_state*)cookie;
+	size_t	i, j;
+	size_t	nlines = state->nlines;
+	size_t	npages = state->npages;
+	size_t*	pages = state->pages;
+	size_t*	lines = state->lines;
+	char*	p = state->base;
+
+	for (i = start; i < end; ++i) {
+		/* sequence through the first word of each line */
+		for (j = 0; j < nlines - 1; ++j) {
+			*(char**)(p + pages[i] + lines[j]) = 
+				p + pages[i] + lines[j+1];
+		}
+
+		/* jump to the fist word of the first line on next page */
+		*(char**)(p + pages[i] + lines[j]) = 
+			p + pages[(i < npages-1) ? i+1 : 0] + lines[0];
+	}
+}
+
 void
 line_initialize(iter_t iterations, void* cookie)
 {
-	size_t     i, j, nlines, npages;
+	size_t     nlines, npages;
 	size_t    *pages;
 	size_t    *lines;
 	struct mem_state* state = (struct mem_state*)cookie;
@@ -388,22 +760,12 @@ line_initialize(iter_t iterations, void* cookie)
 		return;
 
 	/* new setup runs through the lines */
-	for (i = 0; i < npages; ++i) {
-		/* sequence through the first word of each line */
-		for (j = 0; j < nlines - 1; ++j) {
-			*(char**)(p + pages[i] + lines[j]) = 
-				p + pages[i] + lines[j+1];
-		}
-
-		/* jump to the fist word of the first line on next page */
-		*(char**)(p + pages[i] + lines[j]) = 
-			p + pages[(i < npages-1) ? i+1 : 0] + lines[0];
-	}
+	mem_parallel(npages, state->len, line_chain, state);
 	state->p[0] = p + pages[0] + lines[0];
 
 	/* now, run through the chain once to clear the cache */
 	mem_reset();
-	mem_benchmark_0((nlines * npages + 100) / 100, state);
+	mem_benchmark_0(mem_warmup(nlines * npages, state), state);
 
 	state->initialized = 1;
 }
@@ -425,90 +787,358 @@ line_initialize(iter_t iterations, void* cookie)
  * This means that the average access time for each pointer dereference
  * should be a cache hit plus a TLB miss.
  *
+ * The pages are state->stride pages apart in a single mapping, so
+ * that a stride larger than one can put every page into the same
+ * set of a set-associative TLB, or give every page its own page
+ * table page.  If state->pagesize is larger than the base page
+ * size, the mapping uses hugetlbfs pages of that size or, failing
+ * that, transparent huge pages.
+ */
+struct tlb_shuffle {
+	char*	base;
+	char**	to;
+	size_t	npages;
+	size_t	stride;
+	uint64	seed;
+};
+
+/*
+ * Randomize the page sequence, except for the zeroth page
+ */
+static void
+tlb_shuffle(size_t start, size_t end, void* cookie)
+{
+	struct tlb_shuffle* s = (struct tlb_shuffle*)cookie;
+	size_t	i, j;
+
+	for (i = start; i < end; ++i) {
+		j = (i == 0) ? 0 : 1 + mem_permute(i - 1, s->npages - 1, s->seed);
+		s->to[i] = s->base + j * s->stride;
+	}
+}
+
+/*
+ * The offset of the word used on the i'th page: words of a base
+ * page are used in words_initialize order, and huge pages also
+ * move on to the next base page within the huge page once all
+ * those words have been used.
+ */
+#define TLB_OFFSET(i)	(lines[(i)%nlines] + ((i)/nlines%nbase)*basepage)
+
+static void
+tlb_chain(size_t start, size_t end, void* cookie)
+{
+	struct mem_state* state = (struct mem_state*)cookie;
+	size_t	i;
+	size_t	nlines = state->nlines;
+	size_t	npages = state->npages;
+	size_t	basepage = getpagesize();
+	size_t	nbase = state->pagesize / basepage;
+	size_t*	lines = state->lines;
+	char**	pages = (char**)state->pages;
+
+	for (i = start; i < end; ++i) {
+		if (i < npages - 1) {
+			*(char**)(pages[i] + TLB_OFFSET(i)) = 
+				pages[i+1] + TLB_OFFSET(i+1);
+		} else {
+			*(char**)(pages[i] + TLB_OFFSET(i)) = pages[0] + lines[0];
+		}
+	}
+}
+
+/*
+ * The page size used by transparent huge pages, or 0
+ */
+size_t
+mem_hugepage()
+{
+#ifdef MADV_HUGEPAGE
+	FILE*	f;
+	char	buf[64];
+	int	never;
+	unsigned long size = 0;
+
+	if (!(f = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r")))
+		return (0);
+	never = (fgets(buf, sizeof(buf), f) == NULL || strstr(buf, "[never]"));
+	fclose(f);
+	if (never) return (0);
+
+	if ((f = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r"))) {
+		if (fscanf(f, "%lu", &size) != 1) size = 0;
+		fclose(f);
+	}
+	return ((size_t)size);
+#else
+	return (0);
+#endif
+}
+
+/*
+ * Map len bytes of pages of the given size, aligned to the page size.
+ * Returns the address of the mapping and sets *maplen to its length,
+ * or returns NULL if there are no such pages to be had.
  */
+char*
+mem_map(size_t len, size_t pagesize, size_t* maplen)
+{
+	char*	p;
+	int	flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+#ifdef MAP_NORESERVE
+	/* strided mappings touch only a small part of their length */
+	flags |= MAP_NORESERVE;
+#endif
+	*maplen = len;
+	if (pagesize == (size_t)getpagesize()) {
+		p = (char*)mmap(0, len, PROT_READ|PROT_WRITE, flags, -1, 0);
+		return (p == (char*)MAP_FAILED ? NULL : p);
+	}
+
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+	{
+	int	shift;
+	for (shift = 0; ((size_t)1 << shift) < pagesize; ++shift)
+		;
+	p = (char*)mmap(0, len, PROT_READ|PROT_WRITE, 
+			(flags & ~MAP_NORESERVE) | MAP_HUGETLB 
+			| (shift << MAP_HUGE_SHIFT), -1, 0);
+	if (p != (char*)MAP_FAILED) return (p);
+	}
+#endif
+#ifdef MADV_HUGEPAGE
+	if (pagesize == mem_hugepage()) {
+		*maplen = len + pagesize;
+		p = (char*)mmap(0, *maplen, PROT_READ|PROT_WRITE, flags, -1, 0);
+		if (p == (char*)MAP_FAILED) return (NULL);
+		madvise(p, *maplen, MADV_HUGEPAGE);
+		return (p);
+	}
+#endif
+	return (NULL);
+}
+
+/*
+ * The number after key in a /proc or /sys file, in bytes if it is
+ * given in kB, or 0 if it is not there.  With no key, the number
+ * the file holds, and ~0 if it says "max".
+ */
+static uint64
+mem_sysvalue(char* file, char* key)
+{
+	FILE*	f;
+	char	buf[256];
+	char	*s, *end;
+	size_t	len = key ? strlen(key) : 0;
+	uint64	value = 0;
+
+	if (!(f = fopen(file, "r"))) return (0);
+	while (fgets(buf, sizeof(buf), f)) {
+		if (!key) {
+			value = strncmp(buf, "max", 3) ? strtoull(buf, NULL, 10)
+				: ~(uint64)0;
+			break;
+		}
+		for (s = buf; (s = strstr(s, key)); s += len) {
+			if ((s == buf || s[-1] == ' ')
+			    && (s[len] == ':' || s[len] == ' '))
+				break;
+		}
+		if (!s) continue;
+		value = strtoull(s + len + 1, &end, 10);
+		if (strstr(end, "kB")) value *= 1024;
+		break;
+	}
+	fclose(f);
+	return (value);
+}
+
+/*
+ * The free memory on the NUMA nodes this process may use, or 0 if
+ * it may use all of them.
+ */
+static uint64
+mem_node_free()
+{
+	FILE*	f;
+	char	allowed[256], online[256], file[64];
+	char	*s = NULL;
+	unsigned long node, last;
+	uint64	sum = 0;
+
+	online[0] = allowed[0] = 0;
+	if ((f = fopen("/sys/devices/system/node/online", "r"))) {
+		if (!fgets(online, sizeof(online), f)) online[0] = 0;
+		fclose(f);
+	}
+	if ((f = fopen("/proc/self/status", "r"))) {
+		while (fgets(allowed, sizeof(allowed), f)) {
+			if (!strncmp(allowed, "Mems_allowed_list:", 18)) {
+				s = allowed + 18;
+				break;
+			}
+		}
+		fclose(f);
+	}
+	if (!s || !online[0]) return (0);
+	while (*s == ' ' || *s == '\t') ++s;
+	if (!strcmp(s, online)) return (0);
+
+	while (isdigit(*s)) {
+		node = last = strtoul(s, &s, 10);
+		if (*s == '-') last = strtoul(s + 1, &s, 10);
+		for (; node <= last; ++node) {
+			sprintf(file, "/sys/devices/system/node/node%lu/meminfo",
+				node);
+			sum += mem_sysvalue(file, "MemFree");
+			sum += mem_sysvalue(file, "Inactive(file)");
+		}
+		if (*s == ',') ++s;
+	}
+	return (sum);
+}
+
+/*
+ * The memory left under the tightest limit of this process's
+ * memory cgroup and its parents, or 0 if there is no limit.
+ * Inactive page cache counts as free, as it does for MemAvailable.
+ */
+static uint64
+mem_cgroup_free()
+{
+	FILE*	f;
+	char	buf[1024], dir[1024], file[1100];
+	char	*path, *s;
+	char	*base, *limit, *usage, *cache;
+	uint64	max, used, inactive, left, least = 0;
+
+	if (!(f = fopen("/proc/self/cgroup", "r"))) return (0);
+	while (fgets(buf, sizeof(buf), f)) {
+		if ((s = strchr(buf, '\n'))) *s = 0;
+		if (!(path = strchr(buf, ':')) || !(s = strchr(++path, ':')))
+			continue;
+		*s++ = 0;
+		if (!*path) {
+			/* cgroup v2 */
+			base = access("/sys/fs/cgroup/cgroup.controllers", 0)
+				? "/sys/fs/cgroup/unified" : "/sys/fs/cgroup";
+			limit = "memory.max";
+			usage = "memory.current";
+			cache = "inactive_file";
+		} else if (strstr(path, "memory")) {
+			base = "/sys/fs/cgroup/memory";
+			limit = "memory.limit_in_bytes";
+			usage = "memory.usage_in_bytes";
+			cache = "total_inactive_file";
+		} else {
+			continue;
+		}
+		if (strlen(s) >= sizeof(dir)) continue;
+		strcpy(dir, s);
+		for (;;) {
+			sprintf(file, "%s%s/%s", base, dir, limit);
+			max = mem_sysvalue(file, NULL);
+			if (max && max < ((uint64)1 << 62)) {
+				sprintf(file, "%s%s/%s", base, dir, usage);
+				used = mem_sysvalue(file, NULL);
+				sprintf(file, "%s%s/memory.stat", base, dir);
+				inactive = mem_sysvalue(file, cache);
+				used = used > inactive ? used - inactive : 0;
+				left = used < max ? max - used : 0;
+				/* 0 means no limit, so a full cgroup has 1 */
+				if (!least || left < least) least = left ? left : 1;
+			}
+			if (!(s = strrchr(dir, '/')) || !dir[0]) break;
+			*s = 0;
+		}
+	}
+	fclose(f);
+	return (least);
+}
+
+/*
+ * How much memory this process could have without pushing anything
+ * else out: the smallest of the system's MemAvailable, the free
+ * memory on the NUMA nodes it may use, and what its memory cgroups
+ * leave it.  Returns 0 if the system does not say.
+ */
+size_t
+mem_available()
+{
+	uint64	avail, limit;
+
+	avail = mem_sysvalue("/proc/meminfo", "MemAvailable");
+	if ((limit = mem_node_free()) && (!avail || limit < avail))
+		avail = limit;
+	if ((limit = mem_cgroup_free()) && (!avail || limit < avail))
+		avail = limit;
+	if (avail > (size_t)~0) avail = (size_t)~0;
+	return ((size_t)avail);
+}
+
 void
 tlb_initialize(iter_t iterations, void* cookie)
 {
-	size_t i, nlines, npages, pagesize;
-	unsigned long r;
+	size_t nlines, npages, pagesize, stride;
 	char **pages = NULL;
-	char **addr = NULL;
+	char *base;
 	size_t    *lines = NULL;
 	struct mem_state* state = (struct mem_state*)cookie;
-	register char *p = 0 /* lint */;
+	struct tlb_shuffle shuffle;
 
 	if (iterations) return;
 
 	state->initialized = 0;
 
 	pagesize = state->pagesize;
-	nlines   = pagesize / sizeof(char*);
+	stride   = state->stride ? state->stride : 1;
+	nlines   = getpagesize() / sizeof(char*);
 	npages   = state->len / pagesize;
 
 	srand(getpid() ^ (getppid()<<7));
 
+	state->nwords = 1;
+	state->nlines = nlines;
+	state->npages = npages;
+	state->words = NULL;
+	state->lines = NULL;
+	state->pages = NULL;
+	state->addr = mem_map(npages * stride * pagesize, pagesize, &state->maplen);
+	if (!state->addr) {
+		return;
+	}
+
 	lines = words_initialize(nlines, sizeof(char*));
 	pages = (char**)malloc(npages * sizeof(char**));
-	addr = (char**)malloc(npages * sizeof(char**));
-	if (!lines || !pages || !addr) {
+	if (!lines || !pages) {
 		perror("tlb_initialize: malloc");
 		exit(1);
 	}
-
-	state->nwords = 1;
-	state->nlines = nlines;
-	state->npages = npages;
-	state->words = NULL;
 	state->lines = lines;
 	state->pages = (size_t*)pages;
-	state->addr = (char*)addr;
-	if (addr) bzero(addr, npages * sizeof(char**));
-	if (pages) bzero(pages, npages * sizeof(char**));
-
-	if (addr == NULL || pages == NULL || lines == NULL) {
-		return;
-	}
 
 	/* first, layout the sequence of page accesses */
-	for (i = 0; i < npages; ++i) {
-		p = addr[i] = (char*)valloc(pagesize);
-		if (!p) {
-			perror("tlb_initialize: valloc");
-			exit(4);
-		}
-		if ((unsigned long)p % pagesize) {
-			free(p);
-			p = addr[i] = (char*)valloc(2 * pagesize);
-			if (!p) {
-				perror("tlb_initialize: valloc");
-				exit(5);
-			}
-			p += pagesize - (unsigned long)p % pagesize;
-		}
-		pages[i] = (char*)p;
+	base = state->addr;
+	if ((unsigned long)base % pagesize) {
+		base += pagesize - (unsigned long)base % pagesize;
 	}
 
 	/* randomize the page sequences (except for zeroth page) */
-	r = (rand() << 15) ^ rand();
-	for (i = npages - 2; i > 0; --i) {
-		char* l;
-		r = (r << 1) ^ (rand() >> 4);
-		l = pages[(r % i) + 1];
-		pages[(r % i) + 1] = pages[i + 1];
-		pages[i + 1] = l;
-	}
+	shuffle.base = base;
+	shuffle.to = pages;
+	shuffle.npages = npages;
+	shuffle.stride = stride * pagesize;
+	shuffle.seed = mem_random(((uint64)rand() << 31) ^ rand(), 0);
+	mem_parallel(npages, npages * pagesize, tlb_shuffle, &shuffle);
 
 	/* now setup run through the pages */
-	for (i = 0; i < npages - 1; ++i) {
-		*(char**)(pages[i] + lines[i%nlines]) = 
-			pages[i+1] + lines[(i+1)%nlines];
-	}
-	*(char**)(pages[i] + lines[i%nlines]) = pages[0] + lines[0];
+	mem_parallel(npages, npages * pagesize, tlb_chain, state);
 	state->p[0] = pages[0] + lines[0];
 
 	/* run through the chain once to clear the cache */
 	mem_reset();
-	mem_benchmark_0((npages + 100) / 100, state);
+	mem_benchmark_0(mem_warmup(npages, state), state);
 
 	state->initialized = 1;
 }
@@ -522,27 +1152,44 @@ tlb_initialize(iter_t iterations, void* cookie)
  * as to maximize the number of potential cache misses, and to
  * minimize the possibility of re-using a cache line.
  */
-size_t*
-words_initialize(size_t max, int scale)
+struct words_state {
+	size_t*	words;
+	size_t	nbits;
+	int	scale;
+};
+
+static void
+words_reverse(size_t start, size_t end, void* cookie)
 {
-	size_t	i, j, nbits;
-	size_t*	words = (size_t*)malloc(max * sizeof(size_t));
-
-	if (!words) return NULL;
+	struct words_state* w = (struct words_state*)cookie;
+	size_t	i, j;
 
-	bzero(words, max * sizeof(size_t));
-	for (i = max>>1, nbits = 0; i != 0; i >>= 1, nbits++)
-		;
-	for (i = 0; i < max; ++i) {
+	for (i = start; i < end; ++i) {
 		/* now reverse the bits */
-		for (j = 0; j < nbits; j++) {
-			if (i & (1<<j)) {
-				words[i] |= (1<<(nbits-j-1));
+		for (j = 0; j < w->nbits; j++) {
+			if (i & ((size_t)1<<j)) {
+				w->words[i] |= ((size_t)1<<(w->nbits-j-1));
 			}
 		}
-		words[i] *= scale;
+		w->words[i] *= w->scale;
 	}
-	return words;
+}
+
+size_t*
+words_initialize(size_t max, int scale)
+{
+	size_t	i;
+	struct words_state w;
+
+	w.words = (size_t*)malloc(max * sizeof(size_t));
+	if (!w.words) return NULL;
+	w.scale = scale;
+
+	bzero(w.words, max * sizeof(size_t));
+	for (i = max>>1, w.nbits = 0; i != 0; i >>= 1, w.nbits++)
+		;
+	mem_parallel(max, max * sizeof(size_t), words_reverse, &w);
+	return w.words;
 }
 
 
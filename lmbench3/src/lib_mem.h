@@ -36,12 +36,33 @@ struct mem_state {
 	size_t	nlines;
 	size_t	npages;
 	size_t	nwords;
+	size_t	stride;	/* tlb: distance between pages, in pages */
+	size_t	maplen;	/* tlb: length of the mapping at addr */
+	int	pattern;	/* pattern_initialize: PATTERN_* */
+	size_t	ways;	/* pattern: tile width or number of streams */
 	size_t*	pages;
 	size_t*	lines;
 	size_t*	words;
 };
 
+#define	PATTERN_BACKWARD	1
+#define	PATTERN_TILE		2
+#define	PATTERN_STREAMS		3
+#define	PATTERN_PAGES		4
+#define	PATTERN_INPAGE		5
+
+typedef void (*mem_range_f)(size_t start, size_t end, void* cookie);
+
+uint64	mem_random(uint64 seed, uint64 i);
+size_t	mem_permute(size_t i, size_t n, uint64 seed);
+void	mem_parallel(size_t n, size_t bytes, mem_range_f f, void* cookie);
+size_t	mem_hugepage();
+char*	mem_map(size_t len, size_t pagesize, size_t* maplen);
+size_t	mem_available();
+
+void base_initialize(iter_t iterations, void* cookie);
 void stride_initialize(iter_t iterations, void* cookie);
+void pattern_initialize(iter_t iterations, void* cookie);
 void thrash_initialize(iter_t iterations, void* cookie);
 void mem_initialize(iter_t iterations, void* cookie);
 void line_initialize(iter_t iterations, void* cookie);
@@ -222,6 +222,45 @@ double_max(double *values, int size)
 	return max;
 }
 
+/*
+ * return the p'th percentile (0 <= p <= 100) of an array of int
+ */
+int
+int_percentile(double p, int *values, int size)
+{
+	qsort(values, size, sizeof(int), int_compare);
+
+	if (size == 0) return 0;
+
+	return values[(int)((p / 100.) * (double)(size - 1) + 0.5)];
+}
+
+/*
+ * return the p'th percentile (0 <= p <= 100) of an array of uint64
+ */
+uint64
+uint64_percentile(double p, uint64 *values, int size)
+{
+	qsort(values, size, sizeof(uint64), uint64_compare);
+
+	if (size == 0) return 0;
+
+	return values[(int)((p / 100.) * (double)(size - 1) + 0.5)];
+}
+
+/*
+ * return the p'th percentile (0 <= p <= 100) of an array of doubles
+ */
+double
+double_percentile(double p, double *values, int size)
+{
+	qsort(values, size, sizeof(double), double_compare);
+
+	if (size == 0) return 0.;
+
+	return values[(int)((p / 100.) * (double)(size - 1) + 0.5)];
+}
+
 /*
  * return the variance of an array of ints
  *
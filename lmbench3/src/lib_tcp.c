@@ -190,14 +190,26 @@ tcp_connect(char *host, int prog, int rdwr)
 	return (sock);
 }
 
+static int	sockbuf_size = SOCKBUF;
+
+/*
+ * Set the socket buffer size that sock_optimize() asks for; 0 means
+ * the default, SOCKBUF.
+ */
+void
+sock_setbuf(int size)
+{
+	sockbuf_size = size > 0 ? size : SOCKBUF;
+}
+
 void
 sock_optimize(int sock, int flags)
 {
 	if (flags & SOCKOPT_READ) {
-		int	sockbuf = SOCKBUF;
+		int	sockbuf = sockbuf_size;
 
-		while (setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &sockbuf,
-		    sizeof(int))) {
+		while (sockbuf > 0 && setsockopt(sock, SOL_SOCKET, SO_RCVBUF,
+		    &sockbuf, sizeof(int))) {
 			sockbuf >>= 1;
 		}
 #ifdef	LIBTCP_VERBOSE
@@ -205,10 +217,10 @@ sock_optimize(int sock, int flags)
 #endif
 	}
 	if (flags & SOCKOPT_WRITE) {
-		int	sockbuf = SOCKBUF;
+		int	sockbuf = sockbuf_size;
 
-		while (setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &sockbuf,
-		    sizeof(int))) {
+		while (sockbuf > 0 && setsockopt(sock, SOL_SOCKET, SO_SNDBUF,
+		    &sockbuf, sizeof(int))) {
 			sockbuf >>= 1;
 		}
 #ifdef	LIBTCP_VERBOSE
@@ -222,6 +234,19 @@ sock_optimize(int sock, int flags)
 			perror("SO_REUSEADDR");
 		}
 	}
+	if (flags & SOCKOPT_REUSEPORT) {
+#ifdef	SO_REUSEPORT
+		int	val = 1;
+		if (setsockopt(sock, SOL_SOCKET,
+		    SO_REUSEPORT, &val, sizeof(val)) == -1) {
+			perror("SO_REUSEPORT");
+			exit(1);
+		}
+#else
+		fprintf(stderr, "SO_REUSEPORT is not supported\n");
+		exit(1);
+#endif
+	}
 }
 
 int
@@ -9,4 +9,5 @@ int	tcp_done(int prog);
 int	tcp_accept(int sock, int rdwr);
 int	tcp_connect(char *host, int prog, int rdwr);
 void	sock_optimize(int sock, int rdwr);
+void	sock_setbuf(int size);
 int	sockport(int s);
@@ -14,6 +14,9 @@
  * Support for this development by Sun Microsystems is gratefully acknowledged.
  */
 #define	 _LIB /* bench.h needs this */
+#if defined(linux) || defined(__linux__)
+#define _GNU_SOURCE	/* pipe2, O_DIRECT */
+#endif
 #include "bench.h"
 
 /* #define _DEBUG */
@@ -34,10 +37,52 @@ static volatile uint64	use_result_dummy;
 static		uint64	iterations;
 static		void	init_timing(void);
 
+#define	CALIBRATION_PROBE	2000	/* usecs */
+#define	CALIBRATION_SLOP	0.05
+#ifndef O_NOFOLLOW
+#define	O_NOFOLLOW	0
+#endif
+
+typedef struct {
+	int	enough;		/* < 0 when unknown */
+	double	timing_o;	/* < 0 when unknown */
+	double	loop_o;		/* < 0 when unknown */
+	iter_t	probe_n;	/* duration(probe_n) took */
+	uint64	probe_usecs;	/* probe_usecs when calibrated */
+} calibration_t;
+
+static	calibration_t	calibration = { -1, -1., -1., 0, 0 };
+static	int		calibration_dirty = 0;
+static	void		calibration_load(void);
+static	void		calibration_save(void);
+static	int		calibration_default(void);
+
+/*
+ * Adaptive repetitions: when LMBENCH_PRECISION is set, benchmp()
+ * keeps repeating the experiment until the 95% confidence interval
+ * of the median is within +/- LMBENCH_PRECISION percent, or until
+ * LMBENCH_BUDGET seconds have been spent.
+ */
+#define	CI_Z			1.96	/* 95% interval */
+#define	CI_MIN_REPETITIONS	5
+#define	CI_MAX_REPETITIONS	1000
+#define	CI_BUDGET		30	/* seconds */
+
+static	double	ci_precision = -1.;	/* relative half-width, 0 if off */
+static	uint64	ci_budget;		/* usecs */
+static	double	ci_lo, ci_hi;		/* relative to the median, 0 if none */
+static	int	ci_init(void);
+static	int	ci_interval(result_t* r, double* median, double* halfwidth);
+static	char*	ci_format(char* fmt, double value, int inverse);
+
 #if defined(hpux) || defined(__hpux)
 #include <sys/mman.h>
 #endif
 
+#ifndef WIN32
+#include <sys/utsname.h>
+#endif
+
 #ifdef	RUSAGE
 #include <sys/resource.h>
 #define	SECS(tv)	(tv.tv_sec + tv.tv_usec / 1000000.0)
@@ -66,6 +111,24 @@ rusage(void)
 
 #endif	/* RUSAGE */
 
+/*
+ * User plus system CPU time used so far by this process (RUSAGE_SELF)
+ * or by its children which have been waited for (RUSAGE_CHILDREN).
+ */
+uint64
+cpu_usecs(int who)
+{
+#ifndef WIN32
+	struct rusage ru;
+
+	if (getrusage(who, &ru) < 0) return (0);
+	return ((uint64)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000
+		+ ru.ru_utime.tv_usec + ru.ru_stime.tv_usec);
+#else
+	return (0);
+#endif
+}
+
 void
 lmbench_usage(int argc, char *argv[], char* usage)
 {
@@ -118,6 +181,35 @@ benchmp_sigalrm(int signo)
 	benchmp_sigalrm_timeout = 1;
 }
 
+typedef enum { warmup, timing_interval, cooldown } benchmp_state;
+
+typedef struct {
+	benchmp_state	state;
+	benchmp_f	initialize;
+	benchmp_f	benchmark;
+	benchmp_f	cleanup;
+	int		childid;
+	int		response;
+	int		start_signal;
+	int		result_signal;
+	int		exit_signal;
+	int		enough;
+        iter_t		iterations;
+	int		parallel;
+        int		repetitions;
+	int		min_repetitions;
+	void*		cookie;
+	iter_t		iterations_batch;
+	int		need_warmup;
+	long		i;
+	long		next_check;
+	uint64		deadline;
+	int		r_size;
+	result_t*	r;
+} benchmp_child_state;
+
+static benchmp_child_state _benchmp_child_state;
+
 void 
 benchmp_child(benchmp_f initialize, 
 	      benchmp_f benchmark,
@@ -161,6 +253,7 @@ benchmp(benchmp_f initialize,
 {
 	iter_t		iterations = 1;
 	long		i;
+	int		min_repetitions;
 	pid_t		*pids = NULL;
 	int		response[2];
 	int		start_signal[2];
@@ -175,17 +268,26 @@ benchmp(benchmp_f initialize,
 	fprintf(stderr, "\tenough=%d\n", enough);
 #endif
 
-	if (repetitions < 0)
+	min_repetitions = repetitions;
+	if (repetitions < 0) {
 		repetitions = (1 < parallel || 1000000 <= enough ? 1 : TRIES);
+		min_repetitions = repetitions;
+		if (ci_init()) {
+			if (min_repetitions < CI_MIN_REPETITIONS)
+				min_repetitions = CI_MIN_REPETITIONS;
+			repetitions = CI_MAX_REPETITIONS;
+		}
+	}
 
 	/* initialize results */
 	settime(0);
 	save_n(1);
+	ci_lo = ci_hi = 0.;
 
 	if (parallel > 1) {
 		/* Compute the baseline performance */
-		benchmp(initialize, benchmark, cleanup, 
-			enough, 1, warmup, repetitions, cookie);
+		benchmp(initialize, benchmark, cleanup, enough, 1, warmup, 
+			min_repetitions < repetitions ? -1 : repetitions, cookie);
 
 		/* if we can't even do a single job, then give up */
 		if (gettime() == 0)
@@ -242,6 +344,7 @@ benchmp(benchmp_f initialize,
 			close(result_signal[1]);
 			close(exit_signal[1]);
 			handle_scheduler(i, 0, 0);
+			_benchmp_child_state.min_repetitions = min_repetitions;
 			benchmp_child(initialize, 
 				      benchmark, 
 				      cleanup, 
@@ -276,6 +379,15 @@ benchmp(benchmp_f initialize,
 		       repetitions,
 		       enough
 		);
+	if (min_repetitions < repetitions) {
+		double	median, halfwidth;
+
+		if (ci_interval(get_results(), &median, &halfwidth)) {
+			ci_lo = (median - halfwidth) / median;
+			ci_hi = (median + halfwidth) / median;
+			if (ci_lo < 0.) ci_lo = 0.;
+		}
+	}
 	goto cleanup_exit;
 
 error_exit:
@@ -512,31 +624,6 @@ cleanup_exit:
 }
 
 
-typedef enum { warmup, timing_interval, cooldown } benchmp_state;
-
-typedef struct {
-	benchmp_state	state;
-	benchmp_f	initialize;
-	benchmp_f	benchmark;
-	benchmp_f	cleanup;
-	int		childid;
-	int		response;
-	int		start_signal;
-	int		result_signal;
-	int		exit_signal;
-	int		enough;
-        iter_t		iterations;
-	int		parallel;
-        int		repetitions;
-	void*		cookie;
-	iter_t		iterations_batch;
-	int		need_warmup;
-	long		i;
-	int		r_size;
-	result_t*	r;
-} benchmp_child_state;
-
-static benchmp_child_state _benchmp_child_state;
 
 int
 benchmp_childid()
@@ -612,6 +699,7 @@ benchmp_child(benchmp_f initialize,
 	_benchmp_child_state.cookie = cookie;
 	_benchmp_child_state.need_warmup = 1;
 	_benchmp_child_state.i = 0;
+	_benchmp_child_state.next_check = _benchmp_child_state.min_repetitions;
 	_benchmp_child_state.r_size = sizeof_result(repetitions);
 	_benchmp_child_state.r = (result_t*)malloc(_benchmp_child_state.r_size);
 
@@ -644,6 +732,26 @@ benchmp_child(benchmp_f initialize,
 	}
 }
 
+/*
+ * Decide whether an adaptive benchmark has enough repetitions:
+ * either the median is known precisely enough or we are out of
+ * time.  The bootstrap is not free, so the interval is only
+ * recomputed after the number of results has grown by a quarter.
+ */
+static int
+benchmp_converged(benchmp_child_state* state)
+{
+	double	median, halfwidth;
+
+	if (state->min_repetitions >= state->repetitions) return (0);
+	if (now() >= state->deadline) return (1);
+	if (state->i < state->next_check) return (0);
+
+	state->next_check = state->i + state->i / 4 + 1;
+	return (ci_interval(get_results(), &median, &halfwidth)
+		&& halfwidth <= ci_precision * median);
+}
+
 iter_t
 benchmp_interval(void* _state)
 {
@@ -693,6 +801,8 @@ benchmp_interval(void* _state)
 			state->state = timing_interval;
 			read(state->start_signal, &c, sizeof(char));
 			iterations = state->iterations;
+			if (state->min_repetitions < state->repetitions)
+				state->deadline = now() + ci_budget;
 		}
 		if (state->need_warmup) {
 			state->need_warmup = 0;
@@ -706,7 +816,9 @@ benchmp_interval(void* _state)
 			insertsort(gettime(), get_n(), get_results());
 			state->i++;
 			/* we completed all the experiments, return results */
-			if (state->i >= state->repetitions) {
+			if (state->i >= state->repetitions
+			    || (state->i >= state->min_repetitions
+				&& benchmp_converged(state))) {
 				state->state = cooldown;
 			}
 		}
@@ -763,6 +875,85 @@ benchmp_interval(void* _state)
 }
 
 
+/*
+ * Move the start of the current timing interval forward by usecs,
+ * so that untimed work done in the middle of a benchmark loop, such
+ * as evicting a file from the buffer cache, is not counted.
+ */
+void
+adjust(int usecs)
+{
+	start_tv.tv_sec += usecs / 1000000;
+	start_tv.tv_usec += usecs % 1000000;
+	if (start_tv.tv_usec >= 1000000) {
+		start_tv.tv_sec++;
+		start_tv.tv_usec -= 1000000;
+	}
+}
+
+static int
+ci_init(void)
+{
+	char*	s;
+
+	if (ci_precision >= 0.) return (ci_precision > 0.);
+
+	ci_precision = 0.;
+	if ((s = getenv("LMBENCH_PRECISION")) != NULL && atof(s) > 0.)
+		ci_precision = atof(s) / 100.;
+	ci_budget = (uint64)CI_BUDGET * 1000000;
+	if ((s = getenv("LMBENCH_BUDGET")) != NULL && atof(s) > 0.)
+		ci_budget = (uint64)(atof(s) * 1000000.);
+	return (ci_precision > 0.);
+}
+
+/*
+ * The median time per iteration of the results, and the half-width
+ * of its 95% confidence interval using the bootstrap standard error.
+ */
+static int
+ci_interval(result_t* r, double* median, double* halfwidth)
+{
+	int	i;
+	double*	values;
+
+	if (r->N < 2) return (0);
+	values = (double*)malloc(r->N * sizeof(double));
+	if (!values) return (0);
+	for (i = 0; i < r->N; ++i) {
+		values[i] = r->v[i].u / (double)r->v[i].n;
+	}
+	*median = double_median(values, r->N);
+	*halfwidth = CI_Z * double_bootstrap_stderr(values, r->N, double_median);
+	free(values);
+	return (*median > 0.);
+}
+
+/*
+ * Format the confidence interval of a result derived from the median
+ * time of the last benchmp(), as " [lo-hi]" using fmt for each bound.
+ * Results that are inversely proportional to the time, such as
+ * bandwidths, set inverse.  Returns "" if there is no interval.
+ */
+static char*
+ci_format(char* fmt, double value, int inverse)
+{
+	static char	buf[128];
+	char	f[64];
+	double	lo = value * ci_lo;
+	double	hi = value * ci_hi;
+
+	buf[0] = 0;
+	if (ci_hi <= 0.) return (buf);
+	if (inverse) {
+		lo = value / ci_hi;
+		hi = ci_lo > 0. ? value / ci_lo : 0.;
+	}
+	sprintf(f, " [%s-%s]", fmt, fmt);
+	sprintf(buf, f, lo, hi);
+	return (buf);
+}
+
 /*
  * Redirect output someplace else.
  */
@@ -851,6 +1042,24 @@ delta(void)
 	}
 }
 
+/*
+ * Return a monotonic timestamp in nanoseconds, for benchmarks which
+ * need to time individual operations shorter than a microsecond.
+ * Falls back to gettimeofday() where there is no monotonic clock.
+ */
+uint64
+now_nsecs(void)
+{
+#ifdef	CLOCK_MONOTONIC
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+		return ((uint64)ts.tv_sec * 1000000000 + ts.tv_nsec);
+	}
+#endif
+	return (now() * 1000);
+}
+
 double
 Delta(void)
 {
@@ -910,9 +1119,11 @@ bandwidth(uint64 bytes, uint64 times, int verbose)
 			(void) fprintf(ftiming, "%.2f ", mb);
 		}
 		if (mb / secs < 1) {
-			(void) fprintf(ftiming, "%.6f\n", mb/secs);
+			(void) fprintf(ftiming, "%.6f%s\n", mb/secs,
+				       ci_format("%.6f", mb/secs, 1));
 		} else {
-			(void) fprintf(ftiming, "%.2f\n", mb/secs);
+			(void) fprintf(ftiming, "%.2f%s\n", mb/secs,
+				       ci_format("%.2f", mb/secs, 1));
 		}
 	}
 }
@@ -928,7 +1139,8 @@ kb(uint64 bytes)
 	bs = bytes / nz(s);
 	if (s == 0.0) return;
 	if (!ftiming) ftiming = stderr;
-	(void) fprintf(ftiming, "%.0f KB/sec\n", bs / KB);
+	(void) fprintf(ftiming, "%.0f KB/sec%s\n", bs / KB,
+		       ci_format("%.0f", bs / KB, 1));
 }
 
 void
@@ -942,7 +1154,8 @@ mb(uint64 bytes)
 	bs = bytes / nz(s);
 	if (s == 0.0) return;
 	if (!ftiming) ftiming = stderr;
-	(void) fprintf(ftiming, "%.2f MB/sec\n", bs / MB);
+	(void) fprintf(ftiming, "%.2f MB/sec%s\n", bs / MB,
+		       ci_format("%.2f", bs / MB, 1));
 }
 
 void
@@ -1001,7 +1214,8 @@ nano(char *s, uint64 n)
 	micro *= 1000;
 	if (micro == 0.0) return;
 	if (!ftiming) ftiming = stderr;
-	fprintf(ftiming, "%s: %.2f nanoseconds\n", s, micro / n);
+	fprintf(ftiming, "%s: %.2f nanoseconds%s\n", s, micro / n,
+		ci_format("%.2f", micro / n, 0));
 }
 
 void
@@ -1015,7 +1229,8 @@ micro(char *s, uint64 n)
 	micro /= n;
 	if (micro == 0.0) return;
 	if (!ftiming) ftiming = stderr;
-	fprintf(ftiming, "%s: %.4f microseconds\n", s, micro);
+	fprintf(ftiming, "%s: %.4f microseconds%s\n", s, micro,
+		ci_format("%.4f", micro, 0));
 #if 0
 	if (micro >= 100) {
 		fprintf(ftiming, "%s: %.1f microseconds\n", s, micro);
@@ -1041,9 +1256,11 @@ micromb(uint64 sz, uint64 n)
 	if (micro == 0.0) return;
 	if (!ftiming) ftiming = stderr;
 	if (micro >= 10) {
-		fprintf(ftiming, "%.6f %.0f\n", mb, micro);
+		fprintf(ftiming, "%.6f %.0f%s\n", mb, micro,
+			ci_format("%.0f", micro, 0));
 	} else {
-		fprintf(ftiming, "%.6f %.3f\n", mb, micro);
+		fprintf(ftiming, "%.6f %.3f%s\n", mb, micro,
+			ci_format("%.3f", micro, 0));
 	}
 }
 
@@ -1058,7 +1275,8 @@ milli(char *s, uint64 n)
 	milli /= n;
 	if (milli == 0.0) return;
 	if (!ftiming) ftiming = stderr;
-	fprintf(ftiming, "%s: %d milliseconds\n", s, (int)milli);
+	fprintf(ftiming, "%s: %d milliseconds%s\n", s, (int)milli,
+		ci_format("%.0f", (double)milli, 0));
 }
 
 void
@@ -1326,6 +1544,8 @@ l_overhead(void)
 	initialized = 1;
 	if (getenv("LOOP_O")) {
 		overhead = atof(getenv("LOOP_O"));
+	} else if (calibration.loop_o >= 0. && calibration_default()) {
+		overhead = calibration.loop_o;
 	} else {
 		r_save = get_results(); N_save = get_n(); u_save = gettime(); 
 		insertinit(&one);
@@ -1354,6 +1574,11 @@ l_overhead(void)
 		if (overhead < 0.) overhead = 0.;	/* Gag */
 
 		set_results(r_save); save_n(N_save); settime(u_save); 
+
+		if (calibration_default()) {
+			calibration.loop_o = overhead;
+			calibration_dirty = 1;
+		}
 	}
 	return (overhead);
 }
@@ -1376,22 +1601,30 @@ t_overhead(void)
 	initialized = 1;
 	if (getenv("TIMING_O")) {
 		overhead = atof(getenv("TIMING_O"));
-	} else if (get_enough(0) <= 50000) {
-		/* it is not in the noise, so compute it */
-		int		i;
-		result_t	r;
+	} else if (calibration.timing_o >= 0. && calibration_default()) {
+		overhead = (uint64)calibration.timing_o;
+	} else {
+		if (get_enough(0) <= 50000) {
+			/* it is not in the noise, so compute it */
+			int		i;
+			result_t	r;
+
+			r_save = get_results(); N_save = get_n(); u_save = gettime(); 
+			insertinit(&r);
+			for (i = 0; i < TRIES; ++i) {
+				BENCH_INNER(gettimeofday(&tv, 0), 0);
+				insertsort(gettime(), get_n(), &r);
+			}
+			set_results(&r);
+			save_minimum();
+			overhead = gettime() / get_n();
 
-		r_save = get_results(); N_save = get_n(); u_save = gettime(); 
-		insertinit(&r);
-		for (i = 0; i < TRIES; ++i) {
-			BENCH_INNER(gettimeofday(&tv, 0), 0);
-			insertsort(gettime(), get_n(), &r);
+			set_results(r_save); save_n(N_save); settime(u_save); 
+		}
+		if (calibration_default()) {
+			calibration.timing_o = (double)overhead;
+			calibration_dirty = 1;
 		}
-		set_results(&r);
-		save_minimum();
-		overhead = gettime() / get_n();
-
-		set_results(r_save); save_n(N_save); settime(u_save); 
 	}
 	return (overhead);
 }
@@ -1403,6 +1636,7 @@ t_overhead(void)
  */
 static	int	long_enough;
 static	int	compute_enough();
+static	uint64	duration(long N);
 
 int
 get_enough(int e)
@@ -1419,9 +1653,11 @@ init_timing(void)
 
 	if (done) return;
 	done = 1;
+	calibration_load();
 	long_enough = compute_enough();
 	t_overhead();
 	l_overhead();
+	calibration_save();
 }
 
 typedef long TYPE;
@@ -1541,16 +1777,222 @@ compute_enough()
 	if (getenv("ENOUGH")) {
 		return (atoi(getenv("ENOUGH")));
 	}
+	if (calibration.enough >= 0) {
+		return (calibration.enough);
+	}
+	calibration_dirty = 1;
 	for (i = 0; i < sizeof(possibilities) / sizeof(int); ++i) {
 		if (test_time(possibilities[i]))
-			return (possibilities[i]);
+			return (calibration.enough = possibilities[i]);
 	}
 
 	/* 
 	 * if we can't find a timing interval that is sufficient, 
 	 * then use SHORT as a default.
 	 */
-	return (SHORT);
+	return (calibration.enough = SHORT);
+}
+
+/*
+ * The calibration cache.
+ *
+ * Computing get_enough(), t_overhead() and l_overhead() takes a few
+ * seconds, and every benchmark would otherwise redo it.  The results
+ * are kept in a small file keyed by the host, kernel, processor model
+ * and clock source, and reused for as long as a short timing probe
+ * still runs at the speed it did when they were computed.
+ *
+ * LMBENCH_CALIBRATION names the file; if it is set but empty, or
+ * "none", the cache is not used.  The default name is easy to guess,
+ * so the file is only believed if it is a plain file which belongs
+ * to us and which nobody else can write.  The ENOUGH, TIMING_O and LOOP_O
+ * variables still override the cached values.
+ */
+static char*
+calibration_file(void)
+{
+#ifndef WIN32
+	static char	path[1024];
+	char*	s = getenv("LMBENCH_CALIBRATION");
+
+	if (s) {
+		if (*s == 0 || !strcmp(s, "none"))
+			return (NULL);
+		return (s);
+	}
+	sprintf(path, "%s.%d", CALIBRATION, (int)getuid());
+	return (path);
+#else
+	return (NULL);
+#endif
+}
+
+static void
+calibration_readline(char* file, char* prefix, char* buf, int len)
+{
+	FILE*	f;
+	char	line[1024];
+
+	*buf = 0;
+	if ((f = fopen(file, "r")) == NULL) return;
+	while (fgets(line, sizeof(line), f)) {
+		if (!strncmp(line, prefix, strlen(prefix))) {
+			line[strcspn(line, "\n")] = 0;
+			strncpy(buf, line, len - 1);
+			buf[len - 1] = 0;
+			break;
+		}
+	}
+	fclose(f);
+}
+
+static char*
+calibration_key(void)
+{
+	static char	key[1024];
+#ifndef WIN32
+	struct utsname	u;
+	char	cpu[256];
+	char	clock[256];
+
+	if (key[0]) return (key);
+	bzero(&u, sizeof(u));
+	uname(&u);
+	calibration_readline("/proc/cpuinfo", "model name", cpu, sizeof(cpu));
+	if (!cpu[0]) 
+		calibration_readline("/proc/cpuinfo", "Processor", cpu, sizeof(cpu));
+	calibration_readline("/sys/devices/system/clocksource/clocksource0/current_clocksource", "", clock, sizeof(clock));
+	sprintf(key, "%.64s %.64s %.64s %.64s %.64s|%.200s|%.64s|%s %s",
+		u.nodename, u.sysname, u.release, u.version, u.machine,
+		cpu, clock, __DATE__, __TIME__);
+#endif
+	return (key);
+}
+
+/* the fastest of a few runs of duration(N) */
+static uint64
+calibration_time(iter_t N)
+{
+	int	i;
+	uint64	usecs, best = 0;
+
+	for (i = 0; i < 5; ++i) {
+		usecs = duration(N);
+		if (i == 0 || usecs < best) best = usecs;
+	}
+	return (best);
+}
+
+static void
+calibration_load(void)
+{
+	FILE*	f;
+	char*	file = calibration_file();
+	char*	key;
+	char	buf[1024];
+	int	fd, valid = 0;
+	unsigned long	n;
+	unsigned long long	u;
+	uint64	usecs;
+	struct stat	sb;
+	calibration_t	c;
+
+	if (!file || (fd = open(file, O_RDONLY|O_NOFOLLOW)) < 0) return;
+	if (fstat(fd, &sb) < 0 || !S_ISREG(sb.st_mode)
+	    || sb.st_uid != getuid() || (sb.st_mode & (S_IWGRP|S_IWOTH))) {
+#ifdef _DEBUG
+		fprintf(stderr, "calibration_load: not trusting %s\n", file);
+#endif
+		close(fd);
+		return;
+	}
+	if ((f = fdopen(fd, "r")) == NULL) {
+		close(fd);
+		return;
+	}
+
+	key = calibration_key();
+	c.enough = -1; c.timing_o = -1.; c.loop_o = -1.;
+	c.probe_n = 0; c.probe_usecs = 0;
+	while (fgets(buf, sizeof(buf), f)) {
+		buf[strcspn(buf, "\n")] = 0;
+		if (!strncmp(buf, "key ", 4)) {
+			valid = !strcmp(buf + 4, key);
+		} else if (sscanf(buf, "probe %lu %llu", &n, &u) == 2) {
+			c.probe_n = n;
+			c.probe_usecs = u;
+		} else {
+			sscanf(buf, "enough %d", &c.enough);
+			sscanf(buf, "timing_o %lf", &c.timing_o);
+			sscanf(buf, "loop_o %lf", &c.loop_o);
+		}
+	}
+	fclose(f);
+	if (!valid || c.probe_n == 0 || c.probe_usecs == 0) return;
+
+	/* is this still the machine we calibrated? */
+	usecs = calibration_time(c.probe_n);
+	if (ABS((double)usecs - (double)c.probe_usecs) 
+	    > CALIBRATION_SLOP * (double)c.probe_usecs) {
+#ifdef _DEBUG
+		fprintf(stderr, "calibration_load: probe took %llu, not %llu usecs\n", usecs, c.probe_usecs);
+#endif
+		return;
+	}
+	calibration = c;
+}
+
+static void
+calibration_save(void)
+{
+	int	fd;
+	FILE*	f;
+	char*	file = calibration_file();
+	char	tmp[1100];
+	iter_t	N;
+
+	if (!calibration_dirty || !file) return;
+	calibration_dirty = 0;
+
+	if (calibration.probe_n == 0) {
+		for (N = 1000; N < (iter_t)1<<30; N <<= 1) {
+			if (duration(N) >= CALIBRATION_PROBE) break;
+		}
+		calibration.probe_n = N;
+		calibration.probe_usecs = calibration_time(N);
+	}
+
+	/* write a private copy and rename it, so readers never see a partial file */
+	sprintf(tmp, "%.1024s.%d", file, (int)getpid());
+	if ((fd = open(tmp, O_CREAT|O_EXCL|O_WRONLY, 0644)) < 0) return;
+	if ((f = fdopen(fd, "w")) == NULL) {
+		close(fd);
+		unlink(tmp);
+		return;
+	}
+	fprintf(f, "key %s\n", calibration_key());
+	if (calibration.enough >= 0)
+		fprintf(f, "enough %d\n", calibration.enough);
+	if (calibration.timing_o >= 0.)
+		fprintf(f, "timing_o %.8f\n", calibration.timing_o);
+	if (calibration.loop_o >= 0.)
+		fprintf(f, "loop_o %.8f\n", calibration.loop_o);
+	fprintf(f, "probe %lu %llu\n", (unsigned long)calibration.probe_n,
+		(unsigned long long)calibration.probe_usecs);
+	if (fclose(f) != 0 || rename(tmp, file) < 0)
+		unlink(tmp);
+}
+
+/*
+ * Cached overheads are only valid if they were computed with the
+ * same timing interval that we are going to use.
+ */
+static int
+calibration_default(void)
+{
+	if (!getenv("ENOUGH")) return (1);
+	return (calibration.enough >= 0 
+		&& calibration.enough == atoi(getenv("ENOUGH")));
 }
 
 /*
@@ -1629,32 +2071,52 @@ touch(char *buf, size_t nbytes)
 	}
 }
 
+struct _permutation {
+	size_t*	result;
+	size_t	max;
+	size_t	scale;
+	uint64	seed;
+};
+
+static void
+permutation_range(size_t start, size_t end, void* cookie)
+{
+	struct _permutation* p = (struct _permutation*)cookie;
+	size_t	i;
+
+	for (i = start; i < end; ++i) {
+		p->result[i] = mem_permute(i, p->max, p->seed) * p->scale;
+	}
+}
+
+/*
+ * A random permutation of {0, scale, ..., (max - 1) * scale}.  Each
+ * element is computed on its own, so large permutations are filled
+ * in by several threads, each writing a block of the result.
+ */
 size_t*
 permutation(size_t max, size_t scale)
 {
-	size_t	i, v, o;
 	static size_t r = 0;
+	static uint64 calls = 0;
+	struct _permutation p;
 	size_t*	result = (size_t*)malloc(max * sizeof(size_t));
 
 	if (result == NULL) return NULL;
 
-	for (i = 0; i < max; ++i) {
-		result[i] = i * scale;
-	}
-
 	if (r == 0)
 		r = (getpid()<<6) ^ getppid() ^ rand() ^ (rand()<<10);
 
 	/* randomize the sequence */
-	for (i = 0; i < max; ++i) {
-		r = (r << 1) ^ rand();
-		o = r % max;
-		v = result[o];
-		result[o] = result[i];
-		result[i] = v;
-	}
+	p.result = result;
+	p.max = max;
+	p.scale = scale;
+	p.seed = mem_random(r, calls++);
+	mem_parallel(max, max * sizeof(size_t), permutation_range, &p);
 
 #ifdef _DEBUG
+	{
+	size_t	i;
 	fprintf(stderr, "permutation(%d): {", max);
 	for (i = 0; i < max; ++i) {
 	  fprintf(stderr, "%d", result[i]);
@@ -1663,6 +2125,7 @@ permutation(size_t max, size_t scale)
 	}
 	fprintf(stderr, "}\n");
 	fflush(stderr);
+	}
 #endif /* _DEBUG */
 
 	return (result);
@@ -1690,6 +2153,135 @@ cp(char* src, char* dst, mode_t mode)
 	return 0;
 }
 
+/*
+ * Evict a file's pages from the buffer cache, without needing root
+ * or a block device like flushdisk() does.  Dirty pages are written
+ * back first, since the kernel will only drop clean pages, and then
+ * mincore() is used to check that nothing is left resident.  Pages
+ * which are mapped by some process cannot be evicted.
+ *
+ * returns the number of pages still resident, or -1 on error
+ */
+#define	EVICT_TRIES	3
+
+int
+evict_file(int fd)
+{
+#if defined(POSIX_FADV_DONTNEED) && !defined(WIN32)
+	int	i;
+	int	resident = -1;
+	size_t	j, npages, pagesize = getpagesize();
+	struct stat sbuf;
+	unsigned char* vec;
+	void*	where;
+
+	if (fstat(fd, &sbuf) < 0 || !S_ISREG(sbuf.st_mode))
+		return (-1);
+	if (sbuf.st_size == 0)
+		return (0);
+
+	npages = (sbuf.st_size + pagesize - 1) / pagesize;
+	vec = (unsigned char*)malloc(npages);
+	if (!vec) return (-1);
+
+	for (i = 0; i < EVICT_TRIES && resident != 0; ++i) {
+		fsync(fd);
+		if (posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) != 0)
+			break;
+
+		/* mapping the file does not fault any of it in */
+		where = mmap(0, sbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (where == MAP_FAILED)
+			break;
+		if (mincore(where, sbuf.st_size, (void*)vec) == 0) {
+			for (j = 0, resident = 0; j < npages; ++j) {
+				if (vec[j] & 1) resident++;
+			}
+		}
+		munmap(where, sbuf.st_size);
+	}
+	free(vec);
+	return (resident);
+#else
+	return (-1);
+#endif
+}
+
+/*
+ * Ask for a pipe (or fifo) capacity of size bytes; size 0 just asks.
+ * The kernel rounds the capacity up to a power of two pages, and
+ * unprivileged processes may not go above /proc/sys/fs/pipe-max-size.
+ *
+ * returns the capacity of the pipe, or -1 on error
+ */
+int
+pipe_size(int fd, int size)
+{
+#if defined(linux) || defined(__linux__)
+#ifndef F_SETPIPE_SZ
+#define	F_SETPIPE_SZ	1031
+#define	F_GETPIPE_SZ	1032
+#endif
+	if (size > 0 && fcntl(fd, F_SETPIPE_SZ, size) < 0)
+		return (-1);
+	return (fcntl(fd, F_GETPIPE_SZ));
+#else
+	return (-1);
+#endif
+}
+
+/*
+ * Make a pipe, in packet mode (O_DIRECT) if asked, and ask for a
+ * capacity of size bytes unless size is 0.
+ *
+ * returns the capacity the pipe got (0 if it cannot be told),
+ * or -1 on error
+ */
+int
+make_pipe(int p[2], int size, int packet)
+{
+	int	capacity;
+
+	if (packet) {
+#ifdef O_DIRECT
+		if (pipe2(p, O_DIRECT) == -1) return (-1);
+#else
+		errno = EINVAL;
+		return (-1);
+#endif
+	} else if (pipe(p) == -1) {
+		return (-1);
+	}
+	if ((capacity = pipe_size(p[1], size)) == -1) {
+		if (size) {
+			close(p[0]);
+			close(p[1]);
+			return (-1);
+		}
+		capacity = 0;
+	}
+	return (capacity);
+}
+
+/*
+ * Write one message and read one back; a read may return less than
+ * a message.
+ *
+ * returns 0, or -1 on error
+ */
+int
+xfer(int w, int r, char* buf, int msize)
+{
+	int	n, done;
+
+	if (write(w, buf, msize) != msize) return (-1);
+	for (done = 0; done < msize; done += n) {
+		if ((n = read(r, buf + done, msize - done)) <= 0)
+			return (-1);
+	}
+	return (0);
+}
+
 #define	BIGSEEK	(1<<30)
 
 off64_t
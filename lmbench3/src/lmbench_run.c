@@ -0,0 +1,243 @@
+/*
+ * lmbench_run.c - run many benchmarks from one executable
+ *
+ * Usage: lmbench-run [-F <flush size>] <benchmark> [args ...]
+ *	  lmbench-run [-F <flush size>] -f <plan>
+ *	  lmbench-run -l
+ *	  <benchmark> [args ...]	(via a link named after the benchmark)
+ *
+ * Every benchmark listed in lmbench_run.h is linked into lmbench-run
+ * with its main() renamed to <benchmark>_main() and all of its other
+ * symbols made local, so a whole section of the suite can be run
+ * without exec'ing and dynamically linking a new program for every
+ * test.
+ *
+ * A plan file holds one benchmark command line per line; blank lines
+ * and lines starting with '#' are ignored.  Each command runs in its
+ * own child process, so that a benchmark which calls exit() or leaves
+ * state behind cannot disturb the next one, but all of them inherit
+ * the timing calibration that the parent does once up front, and the
+ * parent's address space.
+ * With -F, the parent writes a buffer of the given size between
+ * commands so that every benchmark starts with the same cache and
+ * TLB contents.
+ *
+ * Copyright (c) 1994 Larry McVoy.  Distributed under the FSF GPL with
+ * additional restriction that results may published only if
+ * (1) the benchmark is unmodified, and
+ * (2) the version in the sccsid below is included in the report.
+ */
+char	*id = "$Id$\n";
+
+#include "bench.h"
+
+#define	MAX_ARGS	256
+
+typedef int (*main_f)(int ac, char **av);
+
+#define	BENCHMARK(name)	extern int name##_main(int ac, char **av);
+#include "lmbench_run.h"
+#undef	BENCHMARK
+
+struct _benchmark {
+	char*	name;
+	main_f	main;
+} benchmarks[] = {
+#define	BENCHMARK(name)	{ #name, name##_main },
+#include "lmbench_run.h"
+#undef	BENCHMARK
+	{ NULL, NULL }
+};
+
+main_f	lookup(char* name);
+int	run(int ac, char** av);
+int	plan(char* file);
+void	flush(void);
+
+char*	flush_buf = NULL;
+size_t	flush_size = 0;
+
+int
+main(int ac, char **av)
+{
+	int	c;
+	int	i;
+	char*	file = NULL;
+	char*	name;
+	main_f	f;
+	char	*usage = "[-F <flush size>] -f <plan> | -l | <benchmark> [args ...]\n";
+
+	/* invoked through a link named after a benchmark? */
+	if ((name = strrchr(av[0], '/')) != NULL) {
+		name++;
+	} else {
+		name = av[0];
+	}
+	if ((f = lookup(name)) != NULL) {
+		return ((*f)(ac, av));
+	}
+
+	/*
+	 * getopt() must stop at the benchmark name, the remaining
+	 * options belong to the benchmark.
+	 */
+	while (( c = getopt(ac, av, "F:f:l")) != EOF) {
+		switch(c) {
+		case 'F':
+			flush_size = bytes(optarg);
+			break;
+		case 'f':
+			file = optarg;
+			break;
+		case 'l':
+			for (i = 0; benchmarks[i].name; ++i) {
+				printf("%s\n", benchmarks[i].name);
+			}
+			return (0);
+		default:
+			lmbench_usage(ac, av, usage);
+			break;
+		}
+	}
+	if ((file && optind != ac) || (!file && optind >= ac)) {
+		lmbench_usage(ac, av, usage);
+	}
+
+	if (flush_size > 0) {
+		flush_buf = (char*)malloc(flush_size);
+		if (!flush_buf) {
+			perror("malloc");
+			exit(1);
+		}
+		bzero(flush_buf, flush_size);
+	}
+
+	/* calibrate once, for all the benchmarks */
+	get_enough(0);
+
+	if (file) {
+		return (plan(file));
+	}
+	return (run(ac - optind, av + optind));
+}
+
+main_f
+lookup(char* name)
+{
+	int	i;
+
+	for (i = 0; benchmarks[i].name; ++i) {
+		if (!strcmp(name, benchmarks[i].name))
+			return (benchmarks[i].main);
+	}
+	return (NULL);
+}
+
+/*
+ * Run one benchmark in a child process, returning its exit status.
+ */
+int
+run(int ac, char** av)
+{
+	int	status;
+	pid_t	pid;
+	main_f	f = lookup(av[0]);
+
+	if (!f) {
+		fprintf(stderr, "lmbench-run: unknown benchmark %s\n", av[0]);
+		return (1);
+	}
+	flush();
+	fflush(stdout);
+	fflush(stderr);
+	switch (pid = fork()) {
+	case -1:
+		perror("fork");
+		return (1);
+	case 0:
+		optind = 0;
+		exit((*f)(ac, av));
+	default:
+		break;
+	}
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR) {
+			perror("waitpid");
+			return (1);
+		}
+	}
+	if (WIFSIGNALED(status)) {
+		fprintf(stderr, "lmbench-run: %s killed by signal %d\n",
+			av[0], WTERMSIG(status));
+		return (1);
+	}
+	return (WEXITSTATUS(status));
+}
+
+/*
+ * The whole plan is read before anything runs: a child which calls
+ * exit() would flush our stdio buffer and move the shared file offset.
+ */
+int
+plan(char* file)
+{
+	int	ac;
+	int	line = 0;
+	int	errors = 0;
+	int	n, size = 0;
+	char*	av[MAX_ARGS];
+	char*	buf = NULL;
+	char*	next;
+	char*	p;
+	int	fd;
+
+	if ((fd = open(file, O_RDONLY)) < 0) {
+		perror(file);
+		return (1);
+	}
+	do {
+		buf = (char*)realloc(buf, size + 8192 + 1);
+		if (!buf) {
+			perror("realloc");
+			exit(1);
+		}
+		n = read(fd, buf + size, 8192);
+		if (n > 0) size += n;
+	} while (n > 0);
+	buf[size] = 0;
+	close(fd);
+
+	for (p = buf; p && *p; p = next) {
+		line++;
+		if ((next = strchr(p, '\n')) != NULL) 
+			*next++ = 0;
+		for (ac = 0, p = strtok(p, " \t");
+		     p && ac < MAX_ARGS - 1; p = strtok(NULL, " \t")) {
+			av[ac++] = p;
+		}
+		av[ac] = NULL;
+		if (ac == 0 || av[0][0] == '#')
+			continue;
+		if (run(ac, av) != 0) {
+			fprintf(stderr, "lmbench-run: %s:%d: %s failed\n",
+				file, line, av[0]);
+			errors++;
+		}
+	}
+	free(buf);
+	return (errors ? 1 : 0);
+}
+
+/*
+ * Replace whatever the previous benchmark left in the caches and
+ * TLBs with our own buffer.
+ */
+void
+flush(void)
+{
+	size_t	i;
+
+	for (i = 0; i < flush_size; i += 64) {
+		flush_buf[i]++;
+	}
+}
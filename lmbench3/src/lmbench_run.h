@@ -0,0 +1,55 @@
+/*
+ * lmbench_run.h - the benchmarks built into lmbench-run
+ *
+ * Each entry must have a matching $O/<name>.run.o in RUN_OBJS
+ * in the Makefile.
+ *
+ * $Id$
+ */
+BENCHMARK(bw_file_rd)
+BENCHMARK(bw_mem)
+BENCHMARK(bw_mmap_rd)
+BENCHMARK(bw_pipe)
+BENCHMARK(bw_tcp)
+BENCHMARK(bw_udp)
+BENCHMARK(bw_unix)
+BENCHMARK(cache)
+BENCHMARK(lat_cmd)
+BENCHMARK(lat_connect)
+BENCHMARK(lat_ctx)
+BENCHMARK(lat_dram_page)
+BENCHMARK(lat_fcntl)
+BENCHMARK(lat_fifo)
+BENCHMARK(lat_fs)
+BENCHMARK(lat_http)
+BENCHMARK(lat_mem_rd)
+BENCHMARK(lat_mmap)
+BENCHMARK(lat_ops)
+BENCHMARK(lat_pagefault)
+BENCHMARK(lat_pipe)
+BENCHMARK(lat_pmake)
+BENCHMARK(lat_proc)
+BENCHMARK(lat_rand)
+BENCHMARK(lat_rpc)
+BENCHMARK(lat_select)
+BENCHMARK(lat_sem)
+BENCHMARK(lat_shootdown)
+BENCHMARK(lat_sig)
+BENCHMARK(lat_syscall)
+BENCHMARK(lat_tcp)
+BENCHMARK(lat_udp)
+BENCHMARK(lat_unix)
+BENCHMARK(lat_unix_connect)
+BENCHMARK(lat_usleep)
+BENCHMARK(lat_xact)
+BENCHMARK(line)
+BENCHMARK(lmdd)
+BENCHMARK(lmhttp)
+BENCHMARK(memscan)
+BENCHMARK(memsize)
+BENCHMARK(mhz)
+BENCHMARK(msleep)
+BENCHMARK(par_mem)
+BENCHMARK(par_ops)
+BENCHMARK(stream)
+BENCHMARK(tlb)
@@ -10,6 +10,7 @@ char	*id = "$Id: lmdd.c,v 1.23 1997/12/01 23:47:59 lm Exp $\n";
  *	mismatch=0
  *	rusage=0
  *	flush=0
+ *	cold=0
  *	rand=0
  *	print=0
  *	direct=0
@@ -83,6 +84,7 @@ int	getfile(char *s, int ac, char **av);
 char   *cmds[] = {
 	"bs",			/* block size */
 	"bufs",			/* use this many buffers round robin */
+	"cold",			/* evict input from the buffer cache first */
 	"count",		/* number of blocks */
 #ifdef	DBG
 	"debug",		/* set external variable "dbg" */
@@ -303,6 +305,14 @@ main(int ac, char **av)
 		start(NULL);
 	}
 	in = getfile("if=", ac, av);
+	if (getarg("cold=", ac, av) != -1 && in >= 0) {
+		uint64	t = now();
+
+		if (evict_file(in) != 0) {
+			fprintf(stderr, "lmdd: could not evict input from the buffer cache\n");
+		}
+		if (timeopen != -1) adjust((int)(now() - t));
+	}
 	out = getfile("of=", ac, av);
 	if (timeopen == -1) {
 		start(NULL);
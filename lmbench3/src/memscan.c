@@ -0,0 +1,496 @@
+/*
+ * memscan.c - time every page of memory to find slow or misplaced memory
+ *
+ * Usage: memscan [-P <parallelism>] [-M len[K|M]] [-u <unit>] [-n <passes>]
+ *		[-t <threshold>] [-r <max ranges>] [-b <bin size>] [-o <heatmap file>]
+ *
+ * Each of the P workers is pinned to its own processor, maps its share
+ * of len bytes and touches it, so that the memory comes from the
+ * processor's own node if it can.  Then every unit (a page by default)
+ * is timed twice: the latency of a dependent walk through its lines in
+ * a random order, and the bandwidth of reading it from start to end.
+ * Each pass goes through all of the worker's memory before coming back,
+ * so every unit is read from memory rather than from the caches.
+ * Each unit keeps its best time over several passes, so that a unit
+ * is only slow if it is slow every time.
+ *
+ * Units which are much slower than the median, in either latency or
+ * bandwidth, are reported as ranges of physical addresses along with
+ * the NUMA node the memory is on.  Physical addresses come from
+ * /proc/self/pagemap, which usually needs root; otherwise the report
+ * uses offsets into the scanned memory.  The heatmap file has the
+ * mean latency and bandwidth for each bin of physical memory.
+ *
+ * Copyright (c) 2000 Carl Staelin.
+ * Copyright (c) 1994 Larry McVoy.  Distributed under the FSF GPL with
+ * additional restriction that results may published only if
+ * (1) the benchmark is unmodified, and
+ * (2) the version in the sccsid below is included in the report.
+ */
+char	*id = "$Id$\n";
+
+#include "bench.h"
+
+#if defined(linux) || defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#ifndef MAP_ANONYMOUS
+#define	MAP_ANONYMOUS	MAP_ANON
+#endif
+
+#define	LINE		64
+#define	SAMPLES		(1024 * 1024)	/* units used for the medians */
+
+struct unit {
+	uint64	phys;		/* physical address, or offset */
+	float	latency;	/* nanoseconds per load */
+	float	bandwidth;	/* MB/s */
+	short	node;		/* NUMA node of the memory */
+	short	cpunode;	/* NUMA node of the worker */
+};
+
+/*
+ * The heatmap file is a header followed by nbins bins, all in the
+ * byte order of the machine which wrote it.
+ */
+struct heatmap_header {
+	char	magic[8];	/* "memscan" */
+	uint	version;	/* 1 */
+	uint	physical;	/* 1 if bins are physical addresses */
+	uint64	binsize;	/* bytes of memory per bin */
+	uint64	nbins;
+};
+
+struct heatmap_bin {
+	float	latency;	/* mean nanoseconds per load, 0 if unscanned */
+	float	bandwidth;	/* mean MB/s */
+	uint	units;		/* units scanned in this bin */
+	uint	remote;		/* of which on another node */
+};
+
+int	page_frames(char* p, size_t npages, uint64* frames);
+void	scan(int worker, char* p, size_t len, size_t unit, int passes,
+	     size_t* lines, struct unit* units);
+void	report(struct unit* units, size_t nunits, size_t unit,
+	       double threshold, int maxranges, int physical);
+int	heatmap(char* file, struct unit* units, size_t nunits,
+		size_t binsize, int physical);
+int	unit_cmp(const void* a, const void* b);
+int	float_cmp(const void* a, const void* b);
+double	median(struct unit* units, size_t nunits, int bandwidth);
+
+int
+main(int ac, char **av)
+{
+	int	c, i, parallel = sched_ncpus();
+	int	maxranges = 50, passes = 3;
+	int	physical, status;
+	size_t	len = 0, unit = getpagesize();
+	size_t	binsize = 1024 * 1024;
+	size_t	share, nunits, *lines;
+	uint64	frame;
+	double	threshold = 1.5;
+	char	*file = NULL;
+	char	*p;
+	pid_t	*pids;
+	struct unit* units;
+	char   *usage = "[-P <parallelism>] [-M len[K|M]] [-u <unit>] [-n <passes>] [-t <threshold>] [-r <max ranges>] [-b <bin size>] [-o <heatmap file>]\n";
+
+	while (( c = getopt(ac, av, "P:M:u:n:t:r:b:o:")) != EOF) {
+		switch(c) {
+		case 'P':
+			parallel = atoi(optarg);
+			if (parallel <= 0) lmbench_usage(ac, av, usage);
+			break;
+		case 'M':
+			len = bytes(optarg);
+			break;
+		case 'u':
+			unit = bytes(optarg);
+			if (unit < getpagesize() || unit % getpagesize())
+				lmbench_usage(ac, av, usage);
+			break;
+		case 'n':
+			passes = atoi(optarg);
+			if (passes <= 0) lmbench_usage(ac, av, usage);
+			break;
+		case 't':
+			threshold = atof(optarg);
+			if (threshold <= 1.) lmbench_usage(ac, av, usage);
+			break;
+		case 'r':
+			maxranges = atoi(optarg);
+			break;
+		case 'b':
+			binsize = bytes(optarg);
+			if (binsize < getpagesize()) lmbench_usage(ac, av, usage);
+			break;
+		case 'o':
+			file = optarg;
+			break;
+		default:
+			lmbench_usage(ac, av, usage);
+			break;
+		}
+	}
+	if (optind < ac) lmbench_usage(ac, av, usage);
+
+	/* by default, three quarters of the memory which is free now */
+	if (len == 0) {
+		len = mem_available() / 4 * 3;
+#ifdef _SC_AVPHYS_PAGES
+		if (len == 0)
+			len = (size_t)sysconf(_SC_AVPHYS_PAGES) / 4 * 3 * getpagesize();
+#endif
+		if (len == 0) len = 64 * 1024 * 1024;
+	}
+	share = len / parallel / unit * unit;
+	if (share == 0) {
+		fprintf(stderr, "memscan: less than a unit per worker\n");
+		exit(1);
+	}
+	nunits = share / unit * parallel;
+
+	units = (struct unit*)mmap(0, nunits * sizeof(struct unit),
+				   PROT_READ|PROT_WRITE,
+				   MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	pids = (pid_t*)malloc(parallel * sizeof(pid_t));
+	lines = permutation(getpagesize() / LINE, LINE);
+	if (units == (struct unit*)MAP_FAILED || !pids || !lines) {
+		perror("memscan: malloc");
+		exit(1);
+	}
+
+	for (i = 0; i < parallel; ++i) {
+		switch (pids[i] = fork()) {
+		case -1:
+			perror("memscan: fork");
+			exit(1);
+		case 0:
+			sched_pin(i);
+			p = (char*)mmap(0, share, PROT_READ|PROT_WRITE,
+					MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+			if (p == (char*)MAP_FAILED) {
+				perror("memscan: mmap");
+				exit(1);
+			}
+			scan(i, p, share, unit, passes, lines,
+			     units + i * (share / unit));
+			exit(0);
+		default:
+			break;
+		}
+	}
+	for (i = 0; i < parallel; ++i) {
+		if (waitpid(pids[i], &status, 0) < 0
+		    || !WIFEXITED(status) || WEXITSTATUS(status)) {
+			fprintf(stderr, "memscan: worker %d failed\n", i);
+			exit(1);
+		}
+	}
+
+	frame = 0;
+	physical = page_frames((char*)&frame, 1, &frame);
+	fprintf(stderr, "memscan: %lu MB in %d workers, %lu byte units\n",
+		(unsigned long)(share * parallel >> 20), parallel,
+		(unsigned long)unit);
+	report(units, nunits, unit, threshold, maxranges, physical);
+	if (file && heatmap(file, units, nunits, binsize, physical))
+		exit(1);
+	return (0);
+}
+
+/*
+ * The page frame of every page, from /proc/self/pagemap, read a
+ * batch of pages at a time; 0 where it does not say.  Returns the
+ * number of pages whose frame is known.
+ */
+int
+page_frames(char* p, size_t npages, uint64* frames)
+{
+	int	fd, known = 0;
+	size_t	i, n, pagesize = getpagesize();
+	ssize_t	got;
+	off_t	offset = ((unsigned long)p / pagesize) * sizeof(uint64);
+
+	bzero(frames, npages * sizeof(uint64));
+	if ((fd = open("/proc/self/pagemap", O_RDONLY)) < 0) return (0);
+	for (i = 0; i < npages; i += n) {
+		n = npages - i < 4096 ? npages - i : 4096;
+		got = pread(fd, frames + i, n * sizeof(uint64),
+			    offset + i * sizeof(uint64));
+		if (got != n * sizeof(uint64)) break;
+	}
+	close(fd);
+	for (i = 0; i < npages; ++i) {
+		if (frames[i] & ((uint64)1 << 63)) {
+			frames[i] &= ((uint64)1 << 55) - 1;
+		} else {
+			frames[i] = 0;
+		}
+		if (frames[i]) ++known;
+	}
+	return (known);
+}
+
+/*
+ * The NUMA node of each page, or -1
+ */
+void
+page_nodes(char* p, size_t npages, size_t unit, struct unit* units)
+{
+	size_t	i, c, n;
+	void*	pages[1024];
+	int	status[1024];
+
+	for (i = 0; i < npages; ++i)
+		units[i].node = -1;
+#if defined(SYS_move_pages)
+	for (i = 0; i < npages; i += n) {
+		n = npages - i < 1024 ? npages - i : 1024;
+		for (c = 0; c < n; ++c) {
+			pages[c] = p + (i + c) * unit;
+		}
+		if (syscall(SYS_move_pages, 0, n, pages, NULL, status, 0) < 0)
+			return;
+		for (c = 0; c < n; ++c) {
+			units[i + c].node = (status[c] >= 0 ? status[c] : -1);
+		}
+	}
+#endif
+}
+
+void
+scan(int worker, char* p, size_t len, size_t unit, int passes,
+     size_t* lines, struct unit* units)
+{
+	int	pass;
+	size_t	i, j, k, nunits = len / unit;
+	double	t;
+	size_t	pagesize = getpagesize();
+	size_t	nlines = pagesize / LINE;
+	uint64	start, *frames;
+	unsigned int cpu, node = 0;
+	register char **q;
+	register uint64 sum;
+	char	*page;
+
+	/* first touch, and a random walk through the lines of each page */
+	for (i = 0; i < len; i += pagesize) {
+		page = p + i;
+		for (k = 0; k < nlines; ++k) {
+			*(char**)(page + lines[k]) =
+				page + lines[(k + 1) % nlines];
+		}
+	}
+
+	frames = (uint64*)malloc((len / pagesize) * sizeof(uint64));
+	if (!frames) {
+		perror("memscan: malloc");
+		exit(1);
+	}
+	page_frames(p, len / pagesize, frames);
+#if defined(SYS_getcpu)
+	if (syscall(SYS_getcpu, &cpu, &node, NULL) < 0) node = 0;
+#endif
+	page_nodes(p, nunits, unit, units);
+	for (i = 0; i < nunits; ++i) {
+		k = i * (unit / pagesize);
+		units[i].phys = frames[k] ? frames[k] * pagesize
+			: (uint64)worker * len + i * unit;
+		units[i].cpunode = node;
+	}
+	free(frames);
+
+	for (i = 0; i < nunits; ++i) {
+		units[i].latency = 0.;
+		units[i].bandwidth = 0.;
+	}
+	for (pass = 0; pass < passes; ++pass) {
+		/* latency: every load depends on the one before */
+		for (i = 0; i < nunits; ++i) {
+			start = now_nsecs();
+			for (j = 0; j < unit; j += pagesize) {
+				q = (char**)(p + i * unit + j + lines[0]);
+				for (k = 0; k < nlines; ++k)
+					q = (char**)*q;
+				use_pointer((void*)q);
+			}
+			t = (double)(now_nsecs() - start) / (double)(unit / LINE);
+			if (pass == 0 || t < units[i].latency)
+				units[i].latency = t;
+		}
+
+		/* bandwidth: read each word */
+		for (i = 0; i < nunits; ++i) {
+			start = now_nsecs();
+			sum = 0;
+			for (j = 0; j < unit; j += 8 * sizeof(uint64)) {
+				uint64* w = (uint64*)(p + i * unit + j);
+				sum += w[0] + w[1] + w[2] + w[3]
+					+ w[4] + w[5] + w[6] + w[7];
+			}
+			use_int((int)sum);
+			start = now_nsecs() - start;
+			t = start ? (1000. * unit) / start : 0.;
+			if (t > units[i].bandwidth)
+				units[i].bandwidth = t;
+		}
+	}
+}
+
+int
+float_cmp(const void* a, const void* b)
+{
+	float	x = *(float*)a;
+	float	y = *(float*)b;
+
+	return (x < y ? -1 : (x > y ? 1 : 0));
+}
+
+int
+unit_cmp(const void* a, const void* b)
+{
+	uint64	x = ((struct unit*)a)->phys;
+	uint64	y = ((struct unit*)b)->phys;
+
+	return (x < y ? -1 : (x > y ? 1 : 0));
+}
+
+/*
+ * The median latency or bandwidth, from a sample of the units
+ */
+double
+median(struct unit* units, size_t nunits, int bandwidth)
+{
+	size_t	i, n = nunits < SAMPLES ? nunits : SAMPLES;
+	float	*v = (float*)malloc(n * sizeof(float));
+	double	m;
+
+	if (!v) {
+		perror("memscan: malloc");
+		exit(1);
+	}
+	for (i = 0; i < n; ++i) {
+		struct unit* u = &units[(size_t)((double)i * nunits / n)];
+		v[i] = bandwidth ? u->bandwidth : u->latency;
+	}
+	qsort(v, n, sizeof(float), float_cmp);
+	m = v[n / 2];
+	free(v);
+	return (m);
+}
+
+/*
+ * Print the medians, the memory on other nodes, and the ranges of
+ * slow units in physical address order.
+ */
+void
+report(struct unit* units, size_t nunits, size_t unit,
+       double threshold, int maxranges, int physical)
+{
+	size_t	i, j, n, remote = 0;
+	int	ranges = 0;
+	double	lat, bw, sum_lat, sum_bw;
+	struct unit* slow;
+
+	lat = median(units, nunits, 0);
+	bw = median(units, nunits, 1);
+	fprintf(stderr, "median latency %.2f nanoseconds, bandwidth %.2f MB/sec\n",
+		lat, bw);
+
+	for (i = n = 0; i < nunits; ++i) {
+		if (units[i].node >= 0 && units[i].node != units[i].cpunode)
+			++remote;
+		if (units[i].latency > threshold * lat
+		    || units[i].bandwidth < bw / threshold)
+			++n;
+	}
+	fprintf(stderr, "remote node: %lu units (%.2f%%)\n",
+		(unsigned long)remote, 100. * remote / nunits);
+	fprintf(stderr, "slow: %lu units (%.4f%%)\n",
+		(unsigned long)n, 100. * n / nunits);
+	if (n == 0) return;
+
+	slow = (struct unit*)malloc(n * sizeof(struct unit));
+	if (!slow) {
+		perror("memscan: malloc");
+		exit(1);
+	}
+	for (i = n = 0; i < nunits; ++i) {
+		if (units[i].latency > threshold * lat
+		    || units[i].bandwidth < bw / threshold)
+			slow[n++] = units[i];
+	}
+	qsort(slow, n, sizeof(struct unit), unit_cmp);
+
+	for (i = 0; i < n && ranges < maxranges; i = j, ++ranges) {
+		sum_lat = sum_bw = 0.;
+		for (j = i; j < n && (j == i
+			     || (slow[j].phys == slow[j-1].phys + unit
+				 && slow[j].node == slow[i].node)); ++j) {
+			sum_lat += slow[j].latency;
+			sum_bw += slow[j].bandwidth;
+		}
+		fprintf(stderr, "%s 0x%llx-0x%llx: %lu units %.2f nanoseconds %.2f MB/sec node %d (cpu node %d)\n",
+			physical ? "physical" : "offset",
+			(unsigned long long)slow[i].phys,
+			(unsigned long long)(slow[j-1].phys + unit),
+			(unsigned long)(j - i), sum_lat / (j - i),
+			sum_bw / (j - i), slow[i].node, slow[i].cpunode);
+	}
+	if (i < n) fprintf(stderr, "...\n");
+	free(slow);
+}
+
+int
+heatmap(char* file, struct unit* units, size_t nunits,
+	size_t binsize, int physical)
+{
+	size_t	i, b;
+	uint64	max = 0;
+	FILE	*f;
+	struct heatmap_header h;
+	struct heatmap_bin* bins;
+
+	for (i = 0; i < nunits; ++i) {
+		if (units[i].phys > max) max = units[i].phys;
+	}
+	bzero(&h, sizeof(h));
+	strcpy(h.magic, "memscan");
+	h.version = 1;
+	h.physical = physical;
+	h.binsize = binsize;
+	h.nbins = max / binsize + 1;
+
+	bins = (struct heatmap_bin*)calloc(h.nbins, sizeof(struct heatmap_bin));
+	if (!bins) {
+		perror("memscan: malloc");
+		return (1);
+	}
+	for (i = 0; i < nunits; ++i) {
+		b = units[i].phys / binsize;
+		bins[b].latency += units[i].latency;
+		bins[b].bandwidth += units[i].bandwidth;
+		bins[b].units++;
+		if (units[i].node >= 0 && units[i].node != units[i].cpunode)
+			bins[b].remote++;
+	}
+	for (b = 0; b < h.nbins; ++b) {
+		if (bins[b].units == 0) continue;
+		bins[b].latency /= bins[b].units;
+		bins[b].bandwidth /= bins[b].units;
+	}
+
+	if (!(f = fopen(file, "w"))
+	    || fwrite(&h, sizeof(h), 1, f) != 1
+	    || fwrite(bins, sizeof(struct heatmap_bin), h.nbins, f) != h.nbins
+	    || fclose(f)) {
+		perror(file);
+		free(bins);
+		return (1);
+	}
+	free(bins);
+	return (0);
+}
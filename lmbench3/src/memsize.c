@@ -3,6 +3,11 @@
  *
  * Usage: memsize [max_wanted_in_MB]
  *
+ * Where the system says how much memory is free, memsize maps that
+ * much, up to max_wanted, with MAP_POPULATE and checks that all of it
+ * stays resident.  Only if that fails does it search for the size by
+ * touching ever larger ranges, which takes minutes on big machines.
+ *
  * Copyright (c) 1995 Larry McVoy.  Distributed under the FSF GPL with
  * additional restriction that results may published only if
  * (1) the benchmark is unmodified, and
@@ -23,6 +28,8 @@ int	alarm_triggered = 0;
 void	timeit(char *where, size_t size);
 static	void touchRange(char *p, size_t range, ssize_t stride);
 int	test_malloc(size_t size);
+int	test_populate(size_t size);
+int	resident(char* p, size_t len);
 void	set_alarm(uint64 usecs);
 void	clear_alarm();
 
@@ -33,6 +40,7 @@ main(int ac, char **av)
 	size_t	size = 0;
 	size_t	max = 0;
 	size_t	delta;
+	size_t	avail;
 
 	if (ac == 2) {
 		max = size = bytes(av[1]) * 1024 * 1024;
@@ -40,6 +48,14 @@ main(int ac, char **av)
 	if (max < 1024 * 1024) {
 		max = size = 1024 * 1024 * 1024;
 	}
+	if ((avail = mem_available()) >= 1024 * 1024) {
+		if (avail < size) size = avail;
+		if (test_populate(size)) {
+			printf("%d\n", (int)(size>>20));
+			exit(0);
+		}
+		size = max;
+	}
 	/*
 	 * Binary search down and then binary search up
 	 */
@@ -123,6 +139,113 @@ touchRange(char *p, size_t range, ssize_t stride)
 	}
 }
 
+/*
+ * Fault in size bytes and check that all of it is resident.  The
+ * memory is split between one child per processor, so that a big
+ * machine clears it in parallel, and the children hold on to it
+ * until they have all finished.  If it takes much longer than a
+ * small region says it should, the system is probably swapping,
+ * so the children are killed and the answer is no.
+ */
+int
+test_populate(size_t size)
+{
+#if defined(MAP_POPULATE)
+	int	i, n, result, ok = 1;
+	int	res[2], go[2];
+	size_t	ref, share;
+	uint64	usecs;
+	pid_t	*pids;
+	char	*p;
+
+	ref = size < 64 * 1024 * 1024 ? size : 64 * 1024 * 1024;
+	start(0);
+	p = (char*)mmap(0, ref, PROT_READ|PROT_WRITE,
+			MAP_PRIVATE|MAP_ANONYMOUS|MAP_POPULATE, -1, 0);
+	usecs = stop(0, 0);
+	if (p == (char*)MAP_FAILED) return 0;
+	munmap(p, ref);
+	/* swapping is a hundred times slower than clearing memory */
+	usecs = 20 * (usecs + 1) * (size / ref) + 1000000;
+
+	n = sched_ncpus();
+	if (size / n < ref) n = size / ref;
+	if (n < 1) n = 1;
+	share = (size / n + getpagesize() - 1) / getpagesize() * getpagesize();
+	if (pipe(res) < 0) return 0;
+	if (pipe(go) < 0 || !(pids = (pid_t*)malloc(n * sizeof(pid_t)))) {
+		close(res[0]);
+		close(res[1]);
+		return 0;
+	}
+
+	for (i = 0; i < n; ++i) {
+		switch (pids[i] = fork()) {
+		case -1:
+			ok = 0;
+			break;
+		case 0:
+			close(res[0]);
+			close(go[1]);
+			p = (char*)mmap(0, share, PROT_READ|PROT_WRITE,
+					MAP_PRIVATE|MAP_ANONYMOUS|MAP_POPULATE,
+					-1, 0);
+			result = (p != (char*)MAP_FAILED && resident(p, share));
+			write(res[1], &result, sizeof(int));
+			read(go[0], &result, sizeof(int));
+			exit(0);
+		default:
+			break;
+		}
+		if (!ok) break;
+	}
+	n = i;
+	close(res[1]);
+	close(go[0]);
+
+	set_alarm(usecs);
+	for (i = 0; ok && i < n; ++i) {
+		if (read(res[0], &result, sizeof(int)) != sizeof(int)
+		    || !result)
+			ok = 0;
+	}
+	clear_alarm();
+	close(res[0]);
+	close(go[1]);
+	for (i = 0; i < n; ++i) {
+		if (!ok) kill(pids[i], SIGKILL);
+		waitpid(pids[i], NULL, 0);
+	}
+	free(pids);
+	return ok;
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Is every page of p resident?
+ */
+int
+resident(char* p, size_t len)
+{
+#if defined(MAP_POPULATE)
+	unsigned char vec[4096];
+	size_t	i, n, off, pagesize = getpagesize();
+
+	for (off = 0; off < len; off += n * pagesize) {
+		n = (len - off + pagesize - 1) / pagesize;
+		if (n > sizeof(vec)) n = sizeof(vec);
+		if (mincore(p + off, n * pagesize, vec) < 0)
+			return 0;
+		for (i = 0; i < n; ++i) {
+			if (!(vec[i] & 1)) return 0;
+		}
+	}
+#endif
+	return 1;
+}
+
 int
 test_malloc(size_t size)
 {
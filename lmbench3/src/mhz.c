@@ -2,6 +2,7 @@
  * mhz.c - calculate clock rate and megahertz
  *
  * Usage: mhz [-c]
+ *        mhz -l [-t scalar|avx2|avx512] [-P <max cores>]
  *
  *******************************************************************
  *
@@ -106,6 +107,22 @@ char	*id = "$Id$\n";
 #include "bench.h"
 #include <math.h>
 
+#if defined(linux) || defined(__linux__)
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+/* the vector loads need GNU C target attributes and cpuid */
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__)) \
+	&& (defined(__x86_64__) || defined(__i386__))
+#define	HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#ifndef MAP_ANONYMOUS
+#define	MAP_ANONYMOUS	MAP_ANON
+#endif
+
 typedef	long	TYPE;
 
 #define TEN(A)		A A A A A A A A A A
@@ -439,14 +456,372 @@ print_data(double mhz, result_t* data)
 	printf("};\n");
 }
 
+/*
+ * Load mode: measure the clock rate of each core while 1..N cores
+ * run a scalar, AVX2 or AVX-512 load.  Turbo frequencies depend on
+ * the number of busy cores, and wide vector instructions lower the
+ * frequency further, so one idle number does not describe a machine.
+ *
+ * The cycles come from the APERF MSR through /dev/cpu/N/msr, or from
+ * the cycles counter of perf_event_open(2).  APERF only counts while
+ * the core runs, and the cores are kept busy, so cycles over elapsed
+ * time is the frequency they ran at.  Without either, each worker
+ * times a dependent chain between rounds of its load, and the idle
+ * clock rate found above turns the time into cycles.
+ */
+#define	LOAD_SCALAR	0
+#define	LOAD_AVX2	1
+#define	LOAD_AVX512	2
+#define	NLOADS		3
+
+char	*load_names[NLOADS] = { "scalar", "avx2", "avx512" };
+
+#define	COUNT_TIMING	0
+#define	COUNT_MSR	1
+#define	COUNT_PERF	2
+
+#define	MSR_APERF	0xE8
+
+#define	LOAD_ROUNDS	20000	/* load iterations between chains */
+#define	CHAIN		2000	/* chain iterations, 100 expressions each */
+
+struct core {
+	int	cpu;		/* processor the worker runs on */
+	int	ready;
+	double	chain;		/* least usecs for a chain, 0 if none */
+};
+
+TYPE
+load_scalar(long n, TYPE a, TYPE b)
+{
+	register TYPE c = a + 1, d = b + 1;
+
+	for (; n > 0; --n) {
+		TEN(a ^= a + b; c ^= c + d; b += a; d += c;)
+	}
+	return (a + b + c + d);
+}
+
+#ifdef HAVE_X86_SIMD
+__attribute__((target("avx2,fma"))) TYPE
+load_avx2(long n, double x, double y)
+{
+	__m256d	m = _mm256_set1_pd(x), c = _mm256_set1_pd(y);
+	__m256d	r0 = m, r1 = m, r2 = m, r3 = m, r4 = m, r5 = m, r6 = m, r7 = m;
+
+	for (; n > 0; --n) {
+		TEN(r0 = _mm256_fmadd_pd(r0, m, c); r1 = _mm256_fmadd_pd(r1, m, c);
+		    r2 = _mm256_fmadd_pd(r2, m, c); r3 = _mm256_fmadd_pd(r3, m, c);
+		    r4 = _mm256_fmadd_pd(r4, m, c); r5 = _mm256_fmadd_pd(r5, m, c);
+		    r6 = _mm256_fmadd_pd(r6, m, c); r7 = _mm256_fmadd_pd(r7, m, c);)
+	}
+	r0 = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(r0, r1),
+					 _mm256_add_pd(r2, r3)),
+			   _mm256_add_pd(_mm256_add_pd(r4, r5),
+					 _mm256_add_pd(r6, r7)));
+	return ((TYPE)_mm_cvtsd_f64(_mm256_castpd256_pd128(r0)));
+}
+
+__attribute__((target("avx512f"))) TYPE
+load_avx512(long n, double x, double y)
+{
+	__m512d	m = _mm512_set1_pd(x), c = _mm512_set1_pd(y);
+	__m512d	r0 = m, r1 = m, r2 = m, r3 = m, r4 = m, r5 = m, r6 = m, r7 = m;
+
+	for (; n > 0; --n) {
+		TEN(r0 = _mm512_fmadd_pd(r0, m, c); r1 = _mm512_fmadd_pd(r1, m, c);
+		    r2 = _mm512_fmadd_pd(r2, m, c); r3 = _mm512_fmadd_pd(r3, m, c);
+		    r4 = _mm512_fmadd_pd(r4, m, c); r5 = _mm512_fmadd_pd(r5, m, c);
+		    r6 = _mm512_fmadd_pd(r6, m, c); r7 = _mm512_fmadd_pd(r7, m, c);)
+	}
+	r0 = _mm512_add_pd(_mm512_add_pd(_mm512_add_pd(r0, r1),
+					 _mm512_add_pd(r2, r3)),
+			   _mm512_add_pd(_mm512_add_pd(r4, r5),
+					 _mm512_add_pd(r6, r7)));
+	return ((TYPE)_mm_cvtsd_f64(_mm512_castpd512_pd128(r0)));
+}
+#endif /* HAVE_X86_SIMD */
+
+int
+load_supported(int load)
+{
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+	switch (load) {
+	case LOAD_AVX2:
+		return (__builtin_cpu_supports("avx2")
+			&& __builtin_cpu_supports("fma"));
+	case LOAD_AVX512:
+		return (__builtin_cpu_supports("avx512f"));
+	}
+#endif
+	return (load == LOAD_SCALAR);
+}
+
+void
+run_load(int load, long n)
+{
+	TYPE	sum = 0;
+
+	switch (load) {
+	case LOAD_SCALAR:
+		sum = load_scalar(n, 1, 2);
+		break;
+#ifdef HAVE_X86_SIMD
+	case LOAD_AVX2:
+		sum = load_avx2(n, 1.0, 0.0);
+		break;
+	case LOAD_AVX512:
+		sum = load_avx512(n, 1.0, 0.0);
+		break;
+#endif
+	}
+	use_int((int)sum);
+}
+
+/* usecs for one chain of CHAIN * 100 dependent expressions */
+double
+time_chain()
+{
+	TYPE	*x = (TYPE*)&x, **p = (TYPE**)x;
+	struct timeval	start_tv, stop_tv;
+
+	gettimeofday(&start_tv, NULL);
+	p = _mhz_7(CHAIN, p, 1, 1);
+	gettimeofday(&stop_tv, NULL);
+	use_pointer((void*)p);
+	return ((double)(stop_tv.tv_sec - start_tv.tv_sec) * 1000000.
+		+ (stop_tv.tv_usec - start_tv.tv_usec));
+}
+
+int
+current_cpu()
+{
+	unsigned int	cpu = 0;
+
+#if defined(SYS_getcpu)
+	if (syscall(SYS_getcpu, &cpu, NULL, NULL) < 0) cpu = 0;
+#endif
+	return ((int)cpu);
+}
+
+/*
+ * Open the cycle counter of a processor, returns a file descriptor
+ * or -1.
+ */
+int
+counter_open(int method, int cpu)
+{
+#if defined(linux) || defined(__linux__)
+	char	path[64];
+	struct perf_event_attr attr;
+
+	switch (method) {
+	case COUNT_MSR:
+		sprintf(path, "/dev/cpu/%d/msr", cpu);
+		return (open(path, O_RDONLY));
+#ifdef SYS_perf_event_open
+	case COUNT_PERF:
+		bzero(&attr, sizeof(attr));
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = PERF_COUNT_HW_CPU_CYCLES;
+		return ((int)syscall(SYS_perf_event_open, &attr,
+				     -1, cpu, -1, 0));
+#endif
+	}
+#endif
+	return (-1);
+}
+
+/* returns 0 on success */
+int
+counter_read(int method, int fd, uint64* cycles)
+{
+	switch (method) {
+	case COUNT_MSR:
+		return (pread(fd, cycles, sizeof(*cycles), MSR_APERF)
+			!= sizeof(*cycles));
+	case COUNT_PERF:
+		return (read(fd, cycles, sizeof(*cycles)) != sizeof(*cycles));
+	}
+	return (-1);
+}
+
+/* the first way of counting cycles that works on this system */
+int
+counter_method()
+{
+	int	fd, method;
+	uint64	cycles;
+
+	for (method = COUNT_MSR; method <= COUNT_PERF; ++method) {
+		if ((fd = counter_open(method, current_cpu())) < 0)
+			continue;
+		if (counter_read(method, fd, &cycles) == 0) {
+			close(fd);
+			return (method);
+		}
+		close(fd);
+	}
+	return (COUNT_TIMING);
+}
+
+void
+load_worker(int load, int timed, struct core* core)
+{
+	double	t;
+
+	core->cpu = current_cpu();
+	core->ready = 1;
+	for (;;) {
+		run_load(load, LOAD_ROUNDS);
+		if (!timed) continue;
+		t = time_chain();
+		if (t > 0 && (core->chain == 0 || t < core->chain))
+			core->chain = t;
+	}
+}
+
+/*
+ * Run the load on ncores cores and print the clock rate of each.
+ * chain_cycles is the cycles in a chain for COUNT_TIMING.
+ */
+void
+load_mhz(int load, int ncores, int method, double chain_cycles)
+{
+	int	i, *fds;
+	uint64	*start, *stop;
+	pid_t	*pids;
+	double	usecs, mhz;
+	struct timeval	start_tv, stop_tv;
+	struct core* cores;
+
+	cores = (struct core*)mmap(0, ncores * sizeof(struct core),
+				   PROT_READ|PROT_WRITE,
+				   MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	fds = (int*)malloc(ncores * sizeof(int));
+	start = (uint64*)malloc(ncores * sizeof(uint64));
+	stop = (uint64*)malloc(ncores * sizeof(uint64));
+	pids = (pid_t*)malloc(ncores * sizeof(pid_t));
+	if (cores == (struct core*)MAP_FAILED
+	    || !fds || !start || !stop || !pids) {
+		perror("mhz: malloc");
+		exit(1);
+	}
+	bzero(cores, ncores * sizeof(struct core));
+
+	for (i = 0; i < ncores; ++i) {
+		switch (pids[i] = fork()) {
+		case -1:
+			perror("mhz: fork");
+			exit(1);
+		case 0:
+			sched_pin(i);
+			load_worker(load, method == COUNT_TIMING, &cores[i]);
+			exit(0);
+		default:
+			break;
+		}
+	}
+	for (i = 0; i < ncores; ++i) {
+		while (!cores[i].ready) usleep(1000);
+	}
+
+	/* let the turbo and vector frequencies settle */
+	usleep(200000);
+	for (i = 0; i < ncores; ++i) {
+		fds[i] = -1;
+		cores[i].chain = 0;
+		if (method != COUNT_TIMING
+		    && ((fds[i] = counter_open(method, cores[i].cpu)) < 0
+			|| counter_read(method, fds[i], &start[i]))) {
+			perror("mhz: cycle counter");
+			exit(1);
+		}
+	}
+	gettimeofday(&start_tv, NULL);
+	usleep(500000);
+	gettimeofday(&stop_tv, NULL);
+	for (i = 0; i < ncores; ++i) {
+		if (method != COUNT_TIMING
+		    && counter_read(method, fds[i], &stop[i])) {
+			perror("mhz: cycle counter");
+			exit(1);
+		}
+	}
+	for (i = 0; i < ncores; ++i) {
+		kill(pids[i], SIGTERM);
+		waitpid(pids[i], NULL, 0);
+	}
+
+	usecs = (double)(stop_tv.tv_sec - start_tv.tv_sec) * 1000000.
+		+ (stop_tv.tv_usec - start_tv.tv_usec);
+	printf("%s, %d cores:", load_names[load], ncores);
+	for (i = 0; i < ncores; ++i) {
+		if (method == COUNT_TIMING) {
+			mhz = cores[i].chain > 0 ?
+				chain_cycles / cores[i].chain : 0.;
+		} else {
+			mhz = (double)(stop[i] - start[i]) / usecs;
+			close(fds[i]);
+		}
+		printf(" cpu%d %.0f", cores[i].cpu, mhz);
+	}
+	printf(" MHz\n");
+	fflush(stdout);
+	munmap((void*)cores, ncores * sizeof(struct core));
+	free(fds);
+	free(start);
+	free(stop);
+	free(pids);
+}
+
+void
+load_table(int mhz, int loads, int maxcores)
+{
+	int	i, load, method;
+	double	t, best = 0., chain_cycles = 0.;
+
+	if (maxcores > sched_ncpus()) maxcores = sched_ncpus();
+	method = counter_method();
+	if (method == COUNT_TIMING) {
+		if (mhz <= 0) {
+			fprintf(stderr, "mhz: no clock rate to calibrate with\n");
+			exit(1);
+		}
+		for (i = 0; i < TRIES; ++i) {
+			t = time_chain();
+			if (t > 0 && (best == 0. || t < best)) best = t;
+		}
+		chain_cycles = best * mhz;
+	}
+	fprintf(stderr, "mhz: cycles from %s\n",
+		method == COUNT_MSR ? "APERF" :
+		method == COUNT_PERF ? "perf cycles" : "timing loops");
+
+	for (load = 0; load < NLOADS; ++load) {
+		if (!(loads & (1 << load))) continue;
+		if (!load_supported(load)) {
+			fprintf(stderr, "mhz: no %s on this processor\n",
+				load_names[load]);
+			continue;
+		}
+		for (i = 1; i <= maxcores; ++i) {
+			load_mhz(load, i, method, chain_cycles);
+		}
+	}
+}
+
 int
 main(int ac, char **av)
 {
 	int	c, i, j, k, mhz = -1;
+	int	load = 0, loads = 0, maxcores = sched_ncpus();
 	double	runtime;
 	result_t data[NTESTS];
 	result_t data_save[NTESTS];
-	char   *usage = "[-d] [-c]\n";
+	char   *usage = "[-d] [-c] [-l [-t scalar|avx2|avx512] [-P <max cores>]]\n";
 
 	putenv("LOOP_O=0.0"); /* should be at most 1% */
 
@@ -477,7 +852,7 @@ main(int ac, char **av)
 	    mhz = compute_mhz(data);
 	}
 
-	while (( c = getopt(ac, av, "cd")) != EOF) {
+	while (( c = getopt(ac, av, "cdlt:P:")) != EOF) {
 		switch(c) {
 		case 'c':
 			if (mhz > 0) {
@@ -488,12 +863,31 @@ main(int ac, char **av)
 		case 'd':
 			print_data(mhz, data_save);
 			break;
+		case 'l':
+			load = 1;
+			break;
+		case 't':
+			for (k = 0; k < NLOADS; ++k) {
+				if (!strcmp(optarg, load_names[k])) break;
+			}
+			if (k == NLOADS) lmbench_usage(ac, av, usage);
+			loads |= 1 << k;
+			break;
+		case 'P':
+			maxcores = atoi(optarg);
+			if (maxcores <= 0) lmbench_usage(ac, av, usage);
+			break;
 		default:
 			lmbench_usage(ac, av, usage);
 			break;
 		}
 	}
 
+	if (load) {
+		load_table(mhz, loads ? loads : (1 << NLOADS) - 1, maxcores);
+		exit(0);
+	}
+
 	if (mhz < 0) {
 		printf("-1 System too busy\n");
 		exit(1);
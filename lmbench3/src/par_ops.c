@@ -12,6 +12,17 @@ char	*id = "$Id$\n";
 
 #include "bench.h"
 
+/*
+ * The vector benchmarks need GNU C target attributes and
+ * __builtin_cpu_supports, which looks at cpuid, so that each
+ * instruction set is only run where the CPU and OS support it.
+ */
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__)) \
+	&& (defined(__x86_64__) || defined(__i386__))
+#define	HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
 void	initialize(iter_t iterations, void* cookie);
 
 #define	FIVE(m)		m m m m m
@@ -27,6 +38,7 @@ struct _state {
 	int	K;
 	int	int_data[MAX_LOAD_PARALLELISM];
 	double	double_data[MAX_LOAD_PARALLELISM];
+	int	gather_data[16];	/* indexes into itself */
 };
 
 double
@@ -77,8 +89,11 @@ max_parallelism(benchmp_f* benchmarks,
 #define REPEAT_14(m)	REPEAT_13(m) m(14)
 #define REPEAT_15(m)	REPEAT_14(m) m(15)
 
+/* the instruction set the benchmarks are compiled for */
+#define	TARGET
+
 #define BENCHMARK(benchmark,N,repeat)					\
-void benchmark##_##N(iter_t iterations, void *cookie) 			\
+TARGET void benchmark##_##N(iter_t iterations, void *cookie) 		\
 {									\
 	register iter_t i = iterations;					\
 	struct _state* state = (struct _state*)cookie;			\
@@ -355,6 +370,264 @@ PARALLEL_BENCHMARKS(double_div)
 #undef	PREAMBLE
 #undef	SAVE
 
+#ifdef HAVE_X86_SIMD
+/*
+ * Vector operations: each chain is one vector register, and the
+ * operations are chosen so that the values stay normal numbers.
+ */
+#define	SSE_INIT(N)	r##N = _mm_set1_ps((float)state->double_data[N]);
+#define	SSE_SAVE(N)	use_int(_mm_cvtsi128_si32(_mm_castps_si128(r##N)));
+#define	SSEI_INIT(N)	r##N = _mm_set1_epi32(state->int_data[N]);
+#define	SSEI_SAVE(N)	use_int(_mm_cvtsi128_si32(r##N));
+#define	AVX_INIT(N)	r##N = _mm256_set1_ps((float)state->double_data[N]);
+#define	AVX_SAVE(N)	use_int(_mm_cvtsi128_si32(_mm_castps_si128(	\
+				_mm256_castps256_ps128(r##N))));
+#define	AVXI_INIT(N)	r##N = _mm256_set1_epi32(state->int_data[N]);
+#define	AVXI_SAVE(N)	use_int(_mm_cvtsi128_si32(_mm256_castsi256_si128(r##N)));
+#define	AVX512_INIT(N)	r##N = _mm512_set1_ps((float)state->double_data[N]);
+#define	AVX512_SAVE(N)	use_int(_mm_cvtsi128_si32(_mm_castps_si128(	\
+				_mm512_castps512_ps128(r##N))));
+#define	AVX512I_INIT(N)	r##N = _mm512_set1_epi32(state->int_data[N]);
+#define	AVX512I_SAVE(N)	use_int(_mm_cvtsi128_si32(_mm512_castsi512_si128(r##N)));
+
+/*
+ * Shuffle indexes come from memory so that the compiler cannot
+ * combine a chain of shuffles into one.
+ */
+#define	SSE_INDEX	_mm_loadu_si128((__m128i*)state->gather_data)
+#define	AVX_INDEX	_mm256_loadu_si256((__m256i*)state->gather_data)
+#define	AVX512_INDEX	_mm512_loadu_si512(state->gather_data)
+
+#undef	TARGET
+#define	TARGET	__attribute__((target("sse4.2")))
+#define PREAMBLE(N)
+
+#define BODY(N)		r##N = _mm_add_ps(r##N, _mm_set1_ps(1.0f));
+#define DECLARE(N)	register __m128 r##N;
+#define INIT(N)		SSE_INIT(N)
+#define SAVE(N)		SSE_SAVE(N)
+PARALLEL_BENCHMARKS(sse_add)
+#undef	BODY
+
+#define BODY(N)		r##N = _mm_mul_ps(r##N, r##N);
+PARALLEL_BENCHMARKS(sse_mul)
+#undef	BODY
+
+#define BODY(N)		r##N = _mm_castsi128_ps(_mm_shuffle_epi8(		\
+				_mm_castps_si128(r##N), SSE_INDEX));
+PARALLEL_BENCHMARKS(sse_shuffle)
+#undef	BODY
+
+#define BODY(N)		r##N = _mm_cvtepi32_ps(_mm_cvtps_epi32(r##N));
+PARALLEL_BENCHMARKS(sse_convert)
+#undef	BODY
+#undef	DECLARE
+#undef	INIT
+#undef	SAVE
+
+#define BODY(N)		r##N = _mm_cmpgt_epi32(r##N,				\
+				_mm_set1_epi32(state->int_data[0]));
+#define DECLARE(N)	register __m128i r##N;
+#define INIT(N)		SSEI_INIT(N)
+#define SAVE(N)		SSEI_SAVE(N)
+PARALLEL_BENCHMARKS(sse_compare)
+#undef	BODY
+#undef	DECLARE
+#undef	INIT
+#undef	SAVE
+
+#undef	TARGET
+#define	TARGET	__attribute__((target("fma")))
+#define BODY(N)		r##N = _mm_fmadd_ps(r##N, r##N, _mm_setzero_ps());
+#define DECLARE(N)	register __m128 r##N;
+#define INIT(N)		SSE_INIT(N)
+#define SAVE(N)		SSE_SAVE(N)
+PARALLEL_BENCHMARKS(sse_fma)
+#undef	BODY
+#undef	DECLARE
+#undef	INIT
+#undef	SAVE
+
+#undef	TARGET
+#define	TARGET	__attribute__((target("avx2,fma")))
+#define BODY(N)		r##N = _mm256_add_ps(r##N, _mm256_set1_ps(1.0f));
+#define DECLARE(N)	register __m256 r##N;
+#define INIT(N)		AVX_INIT(N)
+#define SAVE(N)		AVX_SAVE(N)
+PARALLEL_BENCHMARKS(avx2_add)
+#undef	BODY
+
+#define BODY(N)		r##N = _mm256_mul_ps(r##N, r##N);
+PARALLEL_BENCHMARKS(avx2_mul)
+#undef	BODY
+
+#define BODY(N)		r##N = _mm256_fmadd_ps(r##N, r##N, _mm256_setzero_ps());
+PARALLEL_BENCHMARKS(avx2_fma)
+#undef	BODY
+
+#define BODY(N)		r##N = _mm256_permutevar8x32_ps(r##N, AVX_INDEX);
+PARALLEL_BENCHMARKS(avx2_shuffle)
+#undef	BODY
+
+#define BODY(N)		r##N = _mm256_cvtepi32_ps(_mm256_cvtps_epi32(r##N));
+PARALLEL_BENCHMARKS(avx2_convert)
+#undef	BODY
+#undef	DECLARE
+#undef	INIT
+#undef	SAVE
+
+/* the chains start at an index inside gather_data[] */
+#define BODY(N)		r##N = _mm256_i32gather_epi32(state->gather_data, r##N, 4);
+#define DECLARE(N)	register __m256i r##N;
+#define INIT(N)		r##N = _mm256_set1_epi32(state->int_data[N] & 15);
+#define SAVE(N)		AVXI_SAVE(N)
+PARALLEL_BENCHMARKS(avx2_gather)
+#undef	BODY
+#undef	INIT
+
+#define INIT(N)		AVXI_INIT(N)
+
+#define BODY(N)		r##N = _mm256_cmpgt_epi32(r##N,			\
+				_mm256_set1_epi32(state->int_data[0]));
+PARALLEL_BENCHMARKS(avx2_compare)
+#undef	BODY
+#undef	DECLARE
+#undef	INIT
+#undef	SAVE
+
+#undef	TARGET
+#define	TARGET	__attribute__((target("avx512f")))
+#define BODY(N)		r##N = _mm512_add_ps(r##N, _mm512_set1_ps(1.0f));
+#define DECLARE(N)	register __m512 r##N;
+#define INIT(N)		AVX512_INIT(N)
+#define SAVE(N)		AVX512_SAVE(N)
+PARALLEL_BENCHMARKS(avx512_add)
+#undef	BODY
+
+#define BODY(N)		r##N = _mm512_mul_ps(r##N, r##N);
+PARALLEL_BENCHMARKS(avx512_mul)
+#undef	BODY
+
+#define BODY(N)		r##N = _mm512_fmadd_ps(r##N, r##N, _mm512_setzero_ps());
+PARALLEL_BENCHMARKS(avx512_fma)
+#undef	BODY
+
+#define BODY(N)		r##N = _mm512_permutexvar_ps(AVX512_INDEX, r##N);
+PARALLEL_BENCHMARKS(avx512_shuffle)
+#undef	BODY
+
+#define BODY(N)		r##N = _mm512_cvtepi32_ps(_mm512_cvtps_epi32(r##N));
+PARALLEL_BENCHMARKS(avx512_convert)
+#undef	BODY
+#undef	DECLARE
+#undef	INIT
+#undef	SAVE
+
+#define BODY(N)		r##N = _mm512_i32gather_epi32(r##N, state->gather_data, 4);
+#define DECLARE(N)	register __m512i r##N;
+#define INIT(N)		r##N = _mm512_set1_epi32(state->int_data[N] & 15);
+#define SAVE(N)		AVX512I_SAVE(N)
+PARALLEL_BENCHMARKS(avx512_gather)
+#undef	BODY
+#undef	INIT
+
+/*
+ * compares produce a mask, which has to be turned back into a vector
+ * for the next compare, so this times the pair
+ */
+#define INIT(N)		AVX512I_INIT(N)
+#define BODY(N)		r##N = _mm512_maskz_mov_epi32(_mm512_cmpgt_epi32_mask(\
+				r##N, _mm512_set1_epi32(state->int_data[0])),\
+				_mm512_set1_epi32(state->int_data[1]));
+PARALLEL_BENCHMARKS(avx512_compare)
+#undef	BODY
+#undef	DECLARE
+#undef	INIT
+#undef	SAVE
+#undef	PREAMBLE
+
+#undef	TARGET
+#define	TARGET
+
+#define	SSE	1
+#define	FMA	2
+#define	AVX2	3
+#define	AVX512	4
+
+struct vector_op {
+	char*		name;
+	int		isa;
+	benchmp_f*	benchmarks;
+	int		ops;	/* operations per BODY */
+} vector_ops[] = {
+	{ "sse add",		SSE,	sse_add_benchmarks,	1 },
+	{ "sse mul",		SSE,	sse_mul_benchmarks,	1 },
+	{ "sse fma",		FMA,	sse_fma_benchmarks,	1 },
+	{ "sse shuffle",	SSE,	sse_shuffle_benchmarks,	1 },
+	{ "sse compare",	SSE,	sse_compare_benchmarks,	1 },
+	{ "sse convert",	SSE,	sse_convert_benchmarks,	2 },
+	{ "avx2 add",		AVX2,	avx2_add_benchmarks,	1 },
+	{ "avx2 mul",		AVX2,	avx2_mul_benchmarks,	1 },
+	{ "avx2 fma",		AVX2,	avx2_fma_benchmarks,	1 },
+	{ "avx2 shuffle",	AVX2,	avx2_shuffle_benchmarks,	1 },
+	{ "avx2 gather",	AVX2,	avx2_gather_benchmarks,	1 },
+	{ "avx2 compare",	AVX2,	avx2_compare_benchmarks,	1 },
+	{ "avx2 convert",	AVX2,	avx2_convert_benchmarks,	2 },
+	{ "avx512 add",		AVX512,	avx512_add_benchmarks,	1 },
+	{ "avx512 mul",		AVX512,	avx512_mul_benchmarks,	1 },
+	{ "avx512 fma",		AVX512,	avx512_fma_benchmarks,	1 },
+	{ "avx512 shuffle",	AVX512,	avx512_shuffle_benchmarks,	1 },
+	{ "avx512 gather",	AVX512,	avx512_gather_benchmarks,	1 },
+	{ "avx512 compare+mov",	AVX512,	avx512_compare_benchmarks,	1 },
+	{ "avx512 convert",	AVX512,	avx512_convert_benchmarks,	2 },
+	{ NULL, 0, NULL, 0 }
+};
+
+int
+vector_supported(int isa)
+{
+	__builtin_cpu_init();
+	switch (isa) {
+	case SSE:	return __builtin_cpu_supports("sse4.2");
+	case FMA:	return __builtin_cpu_supports("fma");
+	case AVX2:	return __builtin_cpu_supports("avx2")
+				&& __builtin_cpu_supports("fma");
+	case AVX512:	return __builtin_cpu_supports("avx512f");
+	}
+	return 0;
+}
+
+/*
+ * The latency is the time per operation of a single chain, and the
+ * reciprocal throughput is the best time per operation with any
+ * number of independent chains.
+ */
+void
+vector_table(int warmup, int repetitions, void* cookie)
+{
+	int	n;
+	double	t, latency, throughput;
+	struct vector_op* op;
+
+	for (op = vector_ops; op->name; ++op) {
+		if (!vector_supported(op->isa)) continue;
+		latency = throughput = 0.;
+		for (n = 0; n < MAX_LOAD_PARALLELISM; ++n) {
+			benchmp(initialize, op->benchmarks[n], NULL,
+				0, 1, warmup, repetitions, cookie);
+			save_minimum();
+			if (gettime() == 0) break;
+			t = 1000. * (double)gettime() / ((double)get_n()
+				* 10 * op->ops * (n + 1));
+			if (n == 0) latency = t;
+			if (n == 0 || t < throughput) throughput = t;
+		}
+		if (latency <= 0.) continue;
+		fprintf(stderr, "%s: latency %.2f nanoseconds, throughput %.2f nanoseconds, parallelism %.2f\n",
+			op->name, latency, throughput, latency / throughput);
+	}
+}
+#endif /* HAVE_X86_SIMD */
 
 void
 initialize(iter_t iterations, void* cookie)
@@ -368,6 +641,9 @@ initialize(iter_t iterations, void* cookie)
 		state->int_data[i] = i+1;
 		state->double_data[i] = 1.;
 	}
+	for (i = 0; i < 16; ++i) {
+		state->gather_data[i] = (i * 5 + 3) & 15;
+	}
 }
 
 int
@@ -378,14 +654,18 @@ main(int ac, char **av)
 	int	repetitions = (1000000 <= get_enough(0) ? 1 : TRIES);
 	double	par;
 	struct _state	state;
-	char   *usage = "[-W <warmup>] [-N <repetitions>]\n";
+	int	vector = 0;
+	char   *usage = "[-W <warmup>] [-N <repetitions>] [-v]\n";
 
 	state.N = 1;
 	state.M = 1000;
 	state.K = -1023;
 
-	while (( c = getopt(ac, av, "W:N:")) != EOF) {
+	while (( c = getopt(ac, av, "W:N:v")) != EOF) {
 		switch(c) {
+		case 'v':
+			vector = 1;
+			break;
 		case 'W':
 			warmup = atoi(optarg);
 			break;
@@ -398,6 +678,15 @@ main(int ac, char **av)
 		}
 	}
 
+	if (vector) {
+#ifdef HAVE_X86_SIMD
+		vector_table(warmup, repetitions, &state);
+#else
+		fprintf(stderr, "par_ops: no vector benchmarks for this machine\n");
+#endif
+		return (0);
+	}
+
 	par = max_parallelism(integer_bit_benchmarks, 
 			      warmup, repetitions, &state);
 	if (par > 0.)
@@ -30,6 +30,10 @@ int	int_max(int *values, int size);
 uint64	uint64_max(uint64 *values, int size);
 double	double_max(double *values, int size);
 
+int	int_percentile(double p, int *values, int size);
+uint64	uint64_percentile(double p, uint64 *values, int size);
+double	double_percentile(double p, double *values, int size);
+
 double	int_variance(int *values, int size);
 double	uint64_variance(uint64 *values, int size);
 double	double_variance(double *values, int size);
@@ -8,10 +8,11 @@ char	*p64(uint64 big);
 char	*p64sz(uint64 big);
 double	Delta(void);
 double	Now(void);
-void	adjust(int usec);
+void	adjust(int usecs);
 void	bandwidth(uint64 bytes, uint64 times, int verbose);
 uint64	bytes(char *s);
 void	context(uint64 xfers);
+uint64	cpu_usecs(int who);
 uint64	delta(void);
 int	get_enough(int);
 uint64	get_n(void);
@@ -26,6 +27,7 @@ void	milli(char *s, uint64 n);
 void	morefds(void);
 void	nano(char *s, uint64 n);
 uint64	now(void);
+uint64	now_nsecs(void);
 void	ptime(uint64 n);
 void	rusage(void);
 void	save_n(uint64);
@@ -43,6 +45,10 @@ uint64	usecs_spent(void);
 void	touch(char *buf, size_t size);
 size_t*	permutation(size_t max, size_t scale);
 int	cp(char* src, char* dst, mode_t mode);
+int	evict_file(int fd);
+int	pipe_size(int fd, int size);
+int	make_pipe(int p[2], int size, int packet);
+int	xfer(int w, int r, char* buf, int msize);
 long	bread(void* src, long count);
 
 #if defined(hpux) || defined(__hpux)
@@ -1,7 +1,7 @@
 /*
  * tlb.c - guess the cache line size
  *
- * usage: tlb [-c] [-L <line size>] [-M len[K|M]] [-W <warmup>] [-N <repetitions>]
+ * usage: tlb [-c] [-a] [-p <pagesize>[,<pagesize>...]] [-L <line size>] [-M len[K|M]] [-W <warmup>] [-N <repetitions>]
  *
  * Copyright (c) 2000 Carl Staelin.
  * Copyright (c) 1994 Larry McVoy.  Distributed under the FSF GPL with
@@ -13,10 +13,39 @@
 char	*id = "$Id$\n";
 
 #include "bench.h"
+#if defined(linux) || defined(__linux__)
+#include <dirent.h>
+#endif
+
+/*
+ * One level of the TLB hierarchy: the number of pages it maps,
+ * a guess at its associativity, the cost of missing it when the
+ * level above also misses, and the total cost over a cache hit
+ * of missing it and every level before it.
+ */
+struct tlb_level {
+	int	entries;
+	int	ways;
+	double	miss;
+	double	cost;
+};
+
+#define	MAX_LEVELS	4
+#define	MAX_SIZES	8
 
 int find_tlb(int start, int maxpages, int warmup, int repetitions, 
 	     double* tlb_time, double* cache_time, struct mem_state* state);
-void compute_times(int pages, int warmup, int repetitions,
+int find_levels(int start, int maxpages, int warmup, int repetitions,
+	     struct tlb_level* levels, int max, struct mem_state* state);
+void find_ways(struct tlb_level* levels, int nlevels, int warmup,
+	     int repetitions, struct mem_state* state);
+void page_walk(struct tlb_level* levels, int nlevels, int maxpages,
+	     int warmup, int repetitions, struct mem_state* state);
+void tlb_table(size_t pagesize, int maxpages, int warmup, int repetitions,
+	     struct mem_state* state);
+int page_sizes(size_t* sizes, int max);
+char* page_name(size_t pagesize);
+int compute_times(int pages, int warmup, int repetitions,
 	     double* tlb_time, double* cache_time, struct mem_state* state);
 
 #define THRESHOLD 1.15
@@ -31,33 +60,51 @@ void compute_times(int pages, int warmup, int repetitions,
 int
 main(int ac, char **av)
 {
-	int	tlb, maxpages;
+	int	i, tlb, maxpages, nsizes = 0;
 	int	c;
 	int	print_cost = 0;
+	int	all = 0;
 	int	warmup = 0;
 	int	repetitions = (1000000 <= get_enough(0) ? 1 : TRIES);
+	size_t	maxbytes = 0;
+	size_t	sizes[MAX_SIZES];
+	char	*p;
 	double	tlb_time, cache_time;
 	struct mem_state state;
-	char   *usage = "[-c] [-L <line size>] [-M len[K|M]] [-W <warmup>] [-N <repetitions>]\n";
+	char   *usage = "[-c] [-a] [-p <pagesize>[,<pagesize>...]] [-L <line size>] [-M len[K|M]] [-W <warmup>] [-N <repetitions>]\n";
 
 	maxpages = 16 * 1024;
 	state.width = 1;
 	state.pagesize = getpagesize();
-	state.line = sizeof(char*);
+	state.stride = 1;
+	state.line = 0;
 
 	tlb = 2;
 
-	while (( c = getopt(ac, av, "cL:M:W:N:")) != EOF) {
+	while (( c = getopt(ac, av, "acp:L:M:W:N:")) != EOF) {
 		switch(c) {
+		case 'a':
+			all = 1;
+			break;
 		case 'c':
 			print_cost = 1;
 			break;
+		case 'p':
+			for (p = strtok(optarg, ","); p && nsizes < MAX_SIZES;
+			     p = strtok(NULL, ",")) {
+				sizes[nsizes] = bytes(p);
+				if (sizes[nsizes] < (size_t)getpagesize()
+				    || sizes[nsizes] % getpagesize())
+					lmbench_usage(ac, av, usage);
+				++nsizes;
+			}
+			break;
 		case 'L':
 			state.line = atoi(optarg);
 			break;
 		case 'M':
-			maxpages = bytes(optarg);	/* max in bytes */
-			maxpages /= getpagesize();	/* max in pages */
+			maxbytes = bytes(optarg);	/* max in bytes */
+			maxpages = maxbytes / getpagesize(); /* max in pages */
 			break;
 		case 'W':
 			warmup = atoi(optarg);
@@ -71,6 +118,48 @@ main(int ac, char **av)
 		}
 	}
 
+	if (all || nsizes) {
+		if (nsizes == 0)
+			nsizes = page_sizes(sizes, MAX_SIZES);
+#ifdef _SC_LEVEL1_DCACHE_LINESIZE
+		if (state.line == 0 && sysconf(_SC_LEVEL1_DCACHE_LINESIZE) > 0)
+			state.line = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+#endif
+		if (state.line == 0)
+			state.line = sizeof(char*);
+
+		fprintf(stderr, "%-8s %5s %8s %5s %10s %10s\n", "pagesize", 
+			"level", "entries", "ways", "miss ns", "total ns");
+		for (i = 0; i < nsizes; ++i) {
+			/*
+			 * Huge pages get the same number of pages as base
+			 * pages do, unless that is more than a quarter
+			 * of memory.
+			 */
+			if (maxbytes) {
+				maxpages = maxbytes / sizes[i];
+			} else if (sizes[i] > (size_t)getpagesize()) {
+				maxpages = 16 * 1024;
+#ifdef _SC_PHYS_PAGES
+				if ((double)maxpages * sizes[i] > 
+				    (double)sysconf(_SC_PHYS_PAGES) * getpagesize() / 4.)
+					maxpages = (double)sysconf(_SC_PHYS_PAGES) 
+						* getpagesize() / 4. / sizes[i];
+#endif
+			}
+			if (maxpages < 2) {
+				fprintf(stderr, "%-8s ", page_name(sizes[i]));
+				fprintf(stderr, "needs -M >= %s\n", 
+					page_name(2 * sizes[i]));
+				continue;
+			}
+			tlb_table(sizes[i], maxpages, warmup, repetitions, &state);
+		}
+		return (0);
+	}
+	if (state.line == 0)
+		state.line = sizeof(char*);
+
 	/* assumption: no TLB will have less than 16 entries */
 	tlb = find_tlb(8, maxpages, warmup, repetitions, &tlb_time, &cache_time, &state);
 
@@ -129,11 +218,242 @@ find_tlb(int start, int maxpages, int warmup, int repetitions,
 	return (lower);
 }
 
+/*
+ * find_levels
+ *
+ * Like find_tlb, but keeps going once the first TLB is found: every
+ * time the cost per load jumps again, there is another level whose
+ * size is found by a binary search.  Returns the number of levels
+ * found, or -1 if there are no pages of this size to be had.
+ */
+int
+find_levels(int start, int maxpages, int warmup, int repetitions,
+	    struct tlb_level* levels, int max, struct mem_state* state)
+{
+	int	i, lower, upper, n = 0;
+	double	tlb_time, cache_time, cost = 0.;
+
+	for (i = start; i <= maxpages && n < max; i <<= 1) {
+		if (!compute_times(i, warmup, repetitions, 
+				   &tlb_time, &cache_time, state))
+			return (n == 0 && i == start ? -1 : n);
+		if (tlb_time <= THRESHOLD * (cache_time + cost)
+		    || (i >> 1) < 1)
+			continue;
+
+		/* binary search for the point at which this level misses */
+		lower = i >> 1;
+		upper = i;
+		while (lower + 1 < upper) {
+			i = lower + (upper - lower) / 2;
+			if (!compute_times(i, warmup, repetitions, 
+					   &tlb_time, &cache_time, state))
+				return (n);
+			if (tlb_time > THRESHOLD * (cache_time + cost)) {
+				upper = i;
+			} else {
+				lower = i;
+			}
+		}
+
+		/* the cost of a miss is measured at twice the size */
+		i = 2 * lower <= maxpages ? 2 * lower : upper;
+		if (!compute_times(i, warmup, repetitions, 
+				   &tlb_time, &cache_time, state))
+			return (n);
+		levels[n].entries = lower;
+		levels[n].ways = 0;
+		levels[n].miss = tlb_time - cache_time - cost;
+		levels[n].cost = cost = tlb_time - cache_time;
+		++n;
+	}
+	return (n);
+}
+
+/*
+ * find_ways
+ *
+ * With the pages a large power of two apart, every page falls into
+ * the same set of a set-associative TLB, so the levels found are
+ * the number of ways of each TLB.  Each such level is matched to the
+ * first TLB level whose miss cost it reaches.  TLBs which hash the
+ * page number into the set index will look fully associative.
+ */
+void
+find_ways(struct tlb_level* levels, int nlevels, int warmup,
+	  int repetitions, struct mem_state* state)
+{
+	int	i, j, n;
+	size_t	stride;
+	double	target;
+	struct tlb_level ways[MAX_LEVELS];
+
+	if (nlevels <= 0) return;
+
+	for (stride = 1; stride < (size_t)levels[nlevels-1].entries; stride <<= 1)
+		;
+	state->stride = stride;
+	n = find_levels(2, 2 * levels[0].entries, warmup, repetitions, 
+			ways, MAX_LEVELS, state);
+	state->stride = 1;
+
+	for (i = j = 0; i < nlevels && j < n; ++i) {
+		target = ((i ? levels[i-1].cost : 0.) + levels[i].cost) / 2.;
+		while (j < n && ways[j].cost < target)
+			++j;
+		if (j < n)
+			levels[i].ways = ways[j].entries;
+	}
+}
+
+/*
+ * page_walk
+ *
+ * Once the last TLB level misses every time, the cost of a miss
+ * depends on where the page table entries are found.  Spreading the
+ * pages out so that each page table entry is on its own cache line,
+ * and then so that each page has its own page table page, shows how
+ * much the data cache and the page walk caches help.
+ */
 void
+page_walk(struct tlb_level* levels, int nlevels, int maxpages,
+	  int warmup, int repetitions, struct mem_state* state)
+{
+	int	i, pages;
+	size_t	strides[3];
+	double	tlb_time, cache_time;
+
+	if (nlevels <= 0) return;
+
+	pages = 4 * levels[nlevels-1].entries;
+	if (pages > maxpages) pages = maxpages;
+	if (pages < 2 * levels[nlevels-1].entries) return;
+
+	strides[0] = 1;
+	strides[1] = state->line / sizeof(char*);	/* entries per line */
+	strides[2] = getpagesize() / sizeof(char*);	/* entries per page */
+
+	fprintf(stderr, "%-8s %5s %8d", page_name(state->pagesize), "walk", pages);
+	for (i = 0; i < 3; ++i) {
+		state->stride = strides[i];
+		if (compute_times(pages, warmup, repetitions, 
+				  &tlb_time, &cache_time, state)) {
+			fprintf(stderr, " stride %lu: %.2f", 
+				(unsigned long)strides[i], tlb_time - cache_time);
+		}
+	}
+	state->stride = 1;
+	fprintf(stderr, "\n");
+}
+
+/*
+ * tlb_table
+ *
+ * Print the TLB levels found for one page size, with one line per
+ * level and a line for the page walk.
+ */
+void
+tlb_table(size_t pagesize, int maxpages, int warmup, int repetitions,
+	  struct mem_state* state)
+{
+	int	i, n;
+	char	ways[16];
+	struct tlb_level levels[MAX_LEVELS];
+
+	state->pagesize = pagesize;
+	state->stride = 1;
+
+	/* 1GB pages may have as few as four TLB entries */
+	n = find_levels(2, maxpages, warmup, repetitions, 
+			levels, MAX_LEVELS, state);
+	if (n < 0) {
+		fprintf(stderr, "%-8s no pages available\n", page_name(pagesize));
+		state->pagesize = getpagesize();
+		return;
+	}
+	if (n == 0) {
+		fprintf(stderr, "%-8s no TLB effect in %d pages\n", 
+			page_name(pagesize), maxpages);
+	}
+	find_ways(levels, n, warmup, repetitions, state);
+
+	for (i = 0; i < n; ++i) {
+		if (levels[i].ways == 0) {
+			strcpy(ways, "-");
+		} else if (levels[i].ways >= levels[i].entries) {
+			strcpy(ways, "full");
+		} else {
+			sprintf(ways, "%d", levels[i].ways);
+		}
+		fprintf(stderr, "%-8s %5d %8d %5s %10.2f %10.2f\n", 
+			page_name(pagesize), i + 1, levels[i].entries, 
+			ways, levels[i].miss, levels[i].cost);
+	}
+	page_walk(levels, n, maxpages, warmup, repetitions, state);
+	state->pagesize = getpagesize();
+}
+
+/*
+ * page_sizes
+ *
+ * The base page size, followed by the huge page sizes the kernel
+ * supports, smallest first.
+ */
+int
+page_sizes(size_t* sizes, int max)
+{
+	int	i, n = 0;
+	size_t	size;
+#if defined(linux) || defined(__linux__)
+	DIR*	dir;
+	struct dirent* d;
+	unsigned long kb;
+#endif
+
+	sizes[n++] = getpagesize();
+#if defined(linux) || defined(__linux__)
+	if ((dir = opendir("/sys/kernel/mm/hugepages"))) {
+		while (n < max && (d = readdir(dir))) {
+			if (sscanf(d->d_name, "hugepages-%lukB", &kb) != 1)
+				continue;
+			size = (size_t)kb * 1024;
+			for (i = n; i > 1 && sizes[i-1] > size; --i)
+				sizes[i] = sizes[i-1];
+			sizes[i] = size;
+			++n;
+		}
+		closedir(dir);
+	}
+#endif
+	return (n);
+}
+
+char*
+page_name(size_t pagesize)
+{
+	static char name[32];
+
+	if (pagesize % (1024 * 1024 * 1024) == 0) {
+		sprintf(name, "%luG", (unsigned long)(pagesize >> 30));
+	} else if (pagesize % (1024 * 1024) == 0) {
+		sprintf(name, "%luM", (unsigned long)(pagesize >> 20));
+	} else {
+		sprintf(name, "%luK", (unsigned long)(pagesize >> 10));
+	}
+	return (name);
+}
+
+/*
+ * compute_times
+ *
+ * Returns 0 if the pages for the TLB chain could not be had.
+ */
+int
 compute_times(int pages, int warmup, int repetitions,
 	 double* tlb_time, double* cache_time, struct mem_state* state)
 {
 	int i;
+	size_t pagesize = state->pagesize;
 	result_t tlb_results, cache_results, *r_save;
 
 	r_save = get_results();
@@ -143,14 +463,18 @@ compute_times(int pages, int warmup, int repetitions,
 	state->len = pages * state->pagesize;
 	state->maxlen = pages * state->pagesize;
 	tlb_initialize(0, state);
-	if (state->initialized) {
-		for (i = 0; i < TRIES; ++i) {
-			BENCH1(mem_benchmark_0(__n, state); __n = 1;, 0);
-			insertsort(gettime(), get_n(), &tlb_results);
-		}
+	if (!state->initialized) {
+		tlb_cleanup(0, state);
+		return (0);
+	}
+	for (i = 0; i < TRIES; ++i) {
+		BENCH1(mem_benchmark_0(__n, state); __n = 1;, 0);
+		insertsort(gettime(), get_n(), &tlb_results);
 	}
 	tlb_cleanup(0, state);
 	
+	/* the cache chain is always built from base pages */
+	state->pagesize = getpagesize();
 	state->len = pages * state->line;
 	state->maxlen = pages * state->line;
 	mem_initialize(0, state);
@@ -161,6 +485,7 @@ compute_times(int pages, int warmup, int repetitions,
 		}
 	}
 	mem_cleanup(0, state);
+	state->pagesize = pagesize;
 
 	/* We want nanoseconds / load. */
 	set_results(&tlb_results);
@@ -174,5 +499,5 @@ compute_times(int pages, int warmup, int repetitions,
 	/*
 	fprintf(stderr, "%d %.5f %.5f\n", pages, *tlb_time, *cache_time);
 	/**/
+	return (1);
 }
-